@@ -124,6 +124,7 @@ static apr_status_t block_BINARY_RECV(worker_t * worker, worker_t *parent, apr_p
       != APR_SUCCESS) {
     goto out_err;
   }
+  sockreader_release(sockreader);
 
 out_err:
   status = worker_assert(worker, status);
@@ -43,6 +43,9 @@
 #include <apr_portable.h>
 #include <apr_support.h>
 
+#include <math.h>
+#include <stdlib.h>
+
 #if APR_HAVE_UNISTD_H
 #include <unistd.h> /* for getpid() */
 #endif
@@ -53,14 +56,34 @@
 #include "util.h"
 #include "body.h"
 #include "module.h"
+#include "dispatch.h"
+#include "shaper.h"
 
 /************************************************************************
  * Defines 
  ***********************************************************************/
+#define RPS_CLOSED   0
+#define RPS_CONSTANT 1
+#define RPS_POISSON  2
 
 /************************************************************************
  * Structurs
  ***********************************************************************/
+/* open loop _RPS arrivals, shared by the clients of one script line */
+typedef struct rps_sched_s {
+  /* script line, key in global rps_scheds or NULL if private */
+  const char *key;
+  int mode;
+  double mean;
+  apr_time_t init;
+  apr_time_t end;
+  apr_time_t next;
+  apr_uint64_t seed;
+  int arrivals;
+  /* clients following the schedule */
+  int users;
+} rps_sched_t;
+
 typedef struct milestone_s {
   int failures;
   int milestones;
@@ -74,89 +97,115 @@ extern command_t global_commands[];
 extern command_t local_commands[]; 
      
 /************************************************************************
- * Private 
+ * Local 
  ***********************************************************************/
 /**
- * Lookup function
+ * Find the _END of the body command at cmd, nested bodies are skipped
  *
- * @param line IN line where the command resides
+ * @param worker IN worker object
+ * @param lines IN lines the body command is part of
+ * @param cmd IN index of the body command
+ * @param body_lines IN table to copy the body lines to
  *
- * @return command index
+ * @return index of _END or -1 if there is none
  */
-static command_t *lookup_command(command_t *commands, const char *line) {
-  int k;
-  apr_size_t len;
-
-  k = 0;
-  /* lookup command function */
-  while (commands[k].name) {
-    len = strlen(commands[k].name);
-    if (len <= strlen(line)
-	&& strncmp(line, commands[k].name, len) == 0) {
-      break;
+static int worker_body_find_end(worker_t *worker, apr_table_t *lines, int cmd,
+                                apr_table_t *body_lines) {
+  char *line;
+  apr_table_entry_t *e; 
+  const char *end = "_END";
+  int end_len = strlen(end);
+  int ends = 1;
+  int nelts = apr_table_elts(lines)->nelts;
+
+  e = (apr_table_entry_t *) apr_table_elts(lines)->elts;
+  for (cmd += 1; cmd < nelts; cmd++) {
+    command_t *command;
+    line = e[cmd].val;
+    command = dispatch_get_command(worker_get_dispatch(worker), line);
+
+    if (command && command->flags & COMMAND_FLAGS_BODY) {
+      ++ends;
+      worker_log(worker, LOG_DEBUG, "Increment bodies: %d for line %s", ends, line);
     }
-    ++k;
+    if (ends == 1 && strlen(line) >= end_len && strncmp(line, end, end_len) == 0) {
+      return cmd;
+    }
+    else if (strlen(line) >= end_len && strncmp(line, end, end_len) == 0) {
+      --ends;
+      worker_log(worker, LOG_DEBUG, "Decrement bodies: %d for line %s", ends, line);
+    }
+    apr_table_addn(body_lines, e[cmd].key, line);
   }
-
-  return &commands[k];
+  return -1;
 }
 
 /************************************************************************
  * Public 
  ***********************************************************************/
 /**
- * Clone and copy a body of lines
+ * Compile the body of a body command once with the program it is part of,
+ * the body program shares the ops of program
+ *
+ * @param worker IN worker object
+ * @param program IN program of the body command
+ * @param cmd IN index of the body command
+ * @param pool IN pool of program
+ *
+ * @return body program or NULL if there is no _END
+ */
+program_t *worker_body_compile(worker_t *worker, program_t *program, int cmd,
+                               apr_pool_t *pool) {
+  program_t *body;
+  apr_table_t *lines = apr_table_make(pool, 20);
+  int end = worker_body_find_end(worker, program->lines, cmd, lines);
+
+  if (end < 0) {
+    return NULL;
+  }
+  body = apr_pcalloc(pool, sizeof(*body));
+  body->lines = lines;
+  body->nelts = end - cmd - 1;
+  body->ops = &program->ops[cmd + 1];
+  return body;
+}
+
+/**
+ * Clone and copy a body of lines, take lines and program compiled with the
+ * calling op if there is one
  *
  * @param body OUT body which has been copied
  * @param worker IN  worker from which we copy the lines for body
- * @param end IN this bodys terminate string
  *
  * @return APR_SUCCESS
  */
 apr_status_t worker_body(worker_t **body, worker_t *worker) {
-  char *file_and_line;
-  char *line = "";
-  apr_table_entry_t *e; 
   apr_pool_t *p;
-  char *end;
-  int ends;
-  int end_len;
+  op_t *op = worker->op;
+  int end;
 
   HT_POOL_CREATE(&p);
-  end = apr_pstrdup(p, "_END");
-  end_len = strlen(end);
-  ends = 1;
   (*body) = apr_pcalloc(p, sizeof(worker_t));
   memcpy(*body, worker, sizeof(worker_t));
   (*body)->heartbeat = p;
 
+  if (op && op->body && worker->program && 
+      op == &worker->program->ops[worker->cmd]) {
+    (*body)->lines = op->body->lines;
+    (*body)->program = op->body;
+    worker->cmd += op->body->nelts + 1;
+    return APR_SUCCESS;
+  }
+
   /* fill lines */
   (*body)->lines = apr_table_make(p, 20);
-  e = (apr_table_entry_t *) apr_table_elts(worker->lines)->elts;
-  for (worker->cmd += 1; worker->cmd < apr_table_elts(worker->lines)->nelts; worker->cmd++) {
-    command_t *command;
-    file_and_line = e[worker->cmd].key;
-    line = e[worker->cmd].val;
-    command = lookup_command(local_commands, line);
-
-    if (command && command->flags & COMMAND_FLAGS_BODY) {
-      ++ends;
-      worker_log(worker, LOG_DEBUG, "Increment bodies: %d for line %s", ends, line);
-    }
-    if (ends == 1 && strlen(line) >= end_len && strncmp(line, end, end_len) == 0) {
-      break;
-    }
-    else if (strlen(line) >= end_len && strncmp(line, end, end_len) == 0) {
-      --ends;
-      worker_log(worker, LOG_DEBUG, "Decrement bodies: %d for line %s", ends, line);
-    }
-    apr_table_addn((*body)->lines, file_and_line, line);
-  }
-  /* check for end */
-  if (strlen(line) < end_len || strncmp(line, end, end_len) != 0) {
-    worker_log(worker, LOG_ERR, "Interpreter failed: no %s found", end);
+  if ((end = worker_body_find_end(worker, worker->lines, worker->cmd, 
+                                  (*body)->lines)) < 0) {
+    worker->cmd = apr_table_elts(worker->lines)->nelts;
+    worker_log(worker, LOG_ERR, "Interpreter failed: no _END found");
     return APR_EGENERAL;
   }
+  worker->cmd = end;
 
   return APR_SUCCESS;
 }
@@ -172,6 +221,7 @@ void worker_body_end(worker_t *body, worker_t *worker) {
   /* write back sockets and state */
   worker->socket = body->socket;
   worker->listener = body->listener;
+  worker->sched_missed = body->sched_missed;
 
   /* destroy body */
   worker_destroy(body);
@@ -304,7 +354,7 @@ apr_status_t command_IF(command_t * self, worker_t * worker, char *data,
     }
    
     if (strcmp(middle, "MATCH") == 0) {
-      if (!(compiled = htt_regexcomp(ptmp, right, &err, &off))) {
+      if (!(compiled = htt_regexcomp_cached(ptmp, right, 0, &err, &off))) {
 	worker_log(worker, LOG_ERR, "IF MATCH regcomp failed: %s", right);
 	return APR_EINVAL;
       }
@@ -565,8 +615,6 @@ apr_status_t command_BPS(command_t *self, worker_t *worker, char *data,
   int duration;
   char **argv;
   apr_time_t init;
-  apr_time_t start;
-  apr_time_t cur;
 
   COMMAND_NEED_ARG("Byte/s and duration time in second"); 
 
@@ -578,43 +626,28 @@ apr_status_t command_BPS(command_t *self, worker_t *worker, char *data,
   if ((status = worker_body(&body, worker)) != APR_SUCCESS) {
     return status;
   }
+
+  /* sent data of the body is shaped by a token bucket on top of the
+   * one inherited from worker */
+  if (bps > 0) {
+    body->shaper = shaper_new(ptmp, bps, 0, 0);
+    shaper_stack(body->shaper, worker->shaper);
+  }
   
   /* loop */
   init = apr_time_now();
   for (;;) {
     /* interpret */
-    start = apr_time_now();
     if ((status = body->interpret(body, worker, NULL)) != APR_SUCCESS) {
       break;
     }
-    cur = apr_time_now();
-
-    if (bps > 0) {
-      /* avoid division by zero, do happen on windows */
-      while ((cur - start == 0)) {
-        /* wait 1 ms */
-        apr_sleep(1000);
-        cur = apr_time_now();
-      }
-      
-      /* wait loop until we are below the max bps */
-      while (((body->sent * APR_USEC_PER_SEC) / (cur - start)) > bps ) {
-        /* wait 1 ms */
-        apr_sleep(1000);
-        cur = apr_time_now();
-      }
-    }
-
-    /* reset sent bytes */
-    body->sent = 0;
 
     /* test termination */
-    if (apr_time_sec(cur - init) >= duration) {
-      goto end;
+    if (apr_time_sec(apr_time_now() - init) >= duration) {
+      break;
     }
   }
   
-end:
   worker_log(worker, LOG_CMD, "_END");
   
   worker_body_end(body, worker);
@@ -622,6 +655,191 @@ end:
   return status;
 }
 
+/**
+ * Exponential distributed time to the next poisson arrival
+ *
+ * @param seed INOUT xorshift state, must not be 0
+ * @param mean IN mean interval in usec
+ *
+ * @return interval in usec
+ */
+static apr_time_t rps_poisson_next(apr_uint64_t *seed, double mean) {
+  double u;
+
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  /* uniform in (0,1] */
+  u = ((*seed >> 11) + 1) * (1.0 / 9007199254740992.0);
+  return (apr_time_t)(-log(u) * mean);
+}
+
+/**
+ * Step schedule to its next arrival, call with global mutex held
+ *
+ * @param sched IN schedule
+ */
+static void rps_sched_advance(rps_sched_t *sched) {
+  ++sched->arrivals;
+  if (sched->mode == RPS_POISSON) {
+    sched->next += rps_poisson_next(&sched->seed, sched->mean);
+  }
+  else {
+    sched->next = sched->init + (apr_time_t)(sched->arrivals * sched->mean);
+  }
+}
+
+/**
+ * Join the running schedule of this _RPS line or start a new one. Clients
+ * running the same line share one schedule, the first one sets rate and
+ * duration.
+ *
+ * @param worker IN thread data object
+ * @param rps IN arrivals per second
+ * @param duration IN duration in seconds
+ * @param mode IN RPS_CONSTANT or RPS_POISSON
+ *
+ * @return schedule or NULL if out of memory
+ */
+static rps_sched_t *rps_sched_join(worker_t *worker, int rps, int duration,
+                                   int mode) {
+  global_t *global = worker->global;
+  const char *key = worker->op ? worker->op->file_and_line : NULL;
+  apr_time_t now = apr_time_now();
+  rps_sched_t *sched = NULL;
+
+  lock(global->mutex);
+  if (key) {
+    sched = apr_hash_get(global->rps_scheds, key, APR_HASH_KEY_STRING);
+  }
+  if (!sched || now >= sched->end) {
+    if (!(sched = calloc(1, sizeof(*sched)))) {
+      unlock(global->mutex);
+      return NULL;
+    }
+    sched->key = key;
+    sched->mode = mode;
+    sched->mean = (double)APR_USEC_PER_SEC / rps;
+    sched->init = now;
+    sched->end = now + apr_time_from_sec(duration);
+    sched->next = now;
+    sched->seed = (apr_uint64_t)now ^ (apr_uintptr_t)sched;
+    if (sched->seed == 0) {
+      sched->seed = 1;
+    }
+    if (key) {
+      apr_hash_set(global->rps_scheds, key, APR_HASH_KEY_STRING, sched);
+    }
+  }
+  ++sched->users;
+  unlock(global->mutex);
+
+  return sched;
+}
+
+/**
+ * Claim the next arrival of a schedule, overdue arrivals go to the first
+ * client asking
+ *
+ * @param worker IN thread data object
+ * @param sched IN schedule
+ * @param start OUT intended start of the claimed arrival
+ *
+ * @return 1 if claimed, 0 if the schedule is over
+ */
+static int rps_sched_claim(worker_t *worker, rps_sched_t *sched, 
+                           apr_time_t *start) {
+  int claimed = 0;
+
+  lock(worker->global->mutex);
+  if (sched->next < sched->end && apr_time_now() < sched->end) {
+    *start = sched->next;
+    rps_sched_advance(sched);
+    claimed = 1;
+  }
+  unlock(worker->global->mutex);
+
+  return claimed;
+}
+
+/**
+ * Leave a schedule, the last client counts the arrivals nobody started
+ * and drops the schedule
+ *
+ * @param worker IN thread data object
+ * @param sched IN schedule
+ *
+ * @return missed arrivals, counted only by the last client
+ */
+static int rps_sched_leave(worker_t *worker, rps_sched_t *sched) {
+  global_t *global = worker->global;
+  int missed = 0;
+
+  lock(global->mutex);
+  if (--sched->users == 0) {
+    while (sched->next < sched->end) {
+      ++missed;
+      rps_sched_advance(sched);
+    }
+    if (sched->key && 
+        apr_hash_get(global->rps_scheds, sched->key, 
+                     APR_HASH_KEY_STRING) == sched) {
+      apr_hash_set(global->rps_scheds, sched->key, APR_HASH_KEY_STRING, NULL);
+    }
+    free(sched);
+  }
+  unlock(global->mutex);
+
+  return missed;
+}
+
+/**
+ * Run body on a fixed arrival schedule independent of response times.
+ * The schedule is shared by all clients running this _RPS line, a client
+ * done with its body claims the next arrival and starts it at once if it
+ * is overdue. Latency counts from the intended start. Arrivals not
+ * started until the end of duration are counted as missed.
+ *
+ * @param body IN body to run
+ * @param worker IN thread data object
+ * @param rps IN arrivals per second
+ * @param duration IN duration in seconds
+ * @param mode IN RPS_CONSTANT or RPS_POISSON
+ *
+ * @return APR_SUCCESS or status of body
+ */
+static apr_status_t rps_open_loop(worker_t *body, worker_t *worker, int rps,
+                                  int duration, int mode) {
+  apr_status_t status = APR_SUCCESS;
+  apr_time_t start;
+  apr_time_t now;
+  rps_sched_t *sched;
+  int started = 0;
+  int missed;
+
+  if (!(sched = rps_sched_join(worker, rps, duration, mode))) {
+    return APR_ENOMEM;
+  }
+  while (rps_sched_claim(worker, sched, &start)) {
+    now = apr_time_now();
+    if (start > now) {
+      engine_sleep(start - now);
+    }
+    body->sched_start = start;
+    ++started;
+    if ((status = body->interpret(body, worker, NULL)) != APR_SUCCESS) {
+      break;
+    }
+  }
+  body->sched_start = 0;
+
+  missed = rps_sched_leave(worker, sched);
+  body->sched_missed += missed;
+  worker_log(worker, LOG_INFO, "_RPS started %d, missed %d", started, missed);
+
+  return status;
+}
+
 /**
  * RPS command
  *
@@ -644,18 +862,37 @@ apr_status_t command_RPS(command_t *self, worker_t *worker, char *data,
   apr_time_t cur_sec;
   apr_time_t cur;
   apr_time_t elapsed;
+  int mode = RPS_CLOSED;
 
-  COMMAND_NEED_ARG("Byte/s and duration time in second"); 
+  COMMAND_NEED_ARG("Requests/s, duration time in second and optional arrival"); 
 
   my_tokenize_to_argv(copy, &argv, ptmp, 0);
   rps = apr_atoi64(argv[0]);
   ideal_req_time = 1.0 / rps;
   duration = apr_atoi64(argv[1]);
+  if (argv[1] && argv[2]) {
+    if (strcmp(argv[2], "constant") == 0) {
+      mode = RPS_CONSTANT;
+    }
+    else if (strcmp(argv[2], "poisson") == 0) {
+      mode = RPS_POISSON;
+    }
+    else {
+      worker_log(worker, LOG_ERR, "Unknown arrival \"%s\", need constant "
+                 "or poisson", argv[2]);
+      return APR_EGENERAL;
+    }
+  }
   
   /* create a new worker body */
   if ((status = worker_body(&body, worker)) != APR_SUCCESS) {
     return status;
   }
+
+  if (mode != RPS_CLOSED && rps > 0) {
+    status = rps_open_loop(body, worker, rps, duration, mode);
+    goto end;
+  }
   
   /* loop */
   cur_sec = init = apr_time_now();
@@ -671,7 +908,7 @@ apr_status_t command_RPS(command_t *self, worker_t *worker, char *data,
       apr_time_t ideal_time = (ideal_req_time * body->req_cnt) * APR_USEC_PER_SEC;
       apr_time_t act_time   = cur - cur_sec;
       while (act_time < ideal_time) {
-        apr_sleep(ideal_time - act_time);
+        engine_sleep(ideal_time - act_time);
         cur = apr_time_now();
         act_time = cur - cur_sec;
       }
@@ -732,7 +969,7 @@ apr_status_t command_ERROR(command_t *self, worker_t *worker, char *data,
   }
 
   /* store value by his index */
-  if (!(compiled = htt_regexcomp(ptmp, argv[0], &err, &off))) {
+  if (!(compiled = htt_regexcomp_cached(ptmp, argv[0], 0, &err, &off))) {
     worker_log(worker, LOG_ERR, "ERROR condition compile failed: \"%s\"", argv[0]);
     return APR_EINVAL;
   }
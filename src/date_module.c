@@ -166,7 +166,7 @@ apr_status_t block_DATE_SYNC(worker_t *worker, worker_t *parent, apr_pool_t *ptm
     next_full = apr_time_from_sec(seconds);
   }
 
-  apr_sleep(next_full - now);
+  engine_sleep(next_full - now);
   
   return APR_SUCCESS;
 }
@@ -0,0 +1,283 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Implementation of the HTTP Test Tool command dispatch index.
+ *
+ * Commands are matched by prefix, the first command in table order which
+ * is a prefix of the line wins. The index is a character trie over all
+ * command names, every node remembers the lowest table index ending there.
+ * Walking the line through the trie gives the same result as the linear
+ * scan in O(length of name). Module commands and module blocks are indexed
+ * by the name a script uses to call them, e.g. "_SYS:SLEEP". The module
+ * hash and the block hash of every module are copied, so modules and
+ * blocks can be looked up by workers while the script parser still adds
+ * to the live hashes.
+ *
+ * An index is immutable after creation, it can be read without locks.
+ */
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <apr.h>
+#include <apr_strings.h>
+#include <apr_hash.h>
+
+#include "defines.h"
+#include "worker.h"
+#include "dispatch.h"
+
+
+/************************************************************************
+ * Definitions
+ ***********************************************************************/
+
+typedef struct dispatch_node_s dispatch_node_t;
+struct dispatch_node_s {
+  char c;
+  /* lowest command index ending at this node, -1 if none */
+  int index;
+  dispatch_node_t *child;
+  dispatch_node_t *next;
+};
+
+struct dispatch_s {
+  apr_pool_t *pool;
+  command_t *commands;
+  /* index of the terminating NULL entry */
+  int end;
+  dispatch_node_t *root;
+  /* "<module>:<block>" -> block worker */
+  apr_hash_t *blocks;
+  /* module block hash -> immutable copy taken at creation */
+  apr_hash_t *snapshots;
+  /* copy of the module hash taken at creation */
+  apr_hash_t *modules;
+};
+
+
+/************************************************************************
+ * Forward declaration
+ ***********************************************************************/
+
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+
+/**
+ * Get or add child node for character c
+ *
+ * @param self IN dispatch index
+ * @param node IN parent node
+ * @param c IN character
+ *
+ * @return child node
+ */
+static dispatch_node_t *dispatch_node_child(dispatch_t *self,
+                                            dispatch_node_t *node, char c) {
+  dispatch_node_t *child;
+
+  for (child = node->child; child; child = child->next) {
+    if (child->c == c) {
+      return child;
+    }
+  }
+  child = apr_pcalloc(self->pool, sizeof(*child));
+  child->c = c;
+  child->index = -1;
+  child->next = node->child;
+  node->child = child;
+  return child;
+}
+
+/**
+ * Add all blocks of a module under the names a script can call them
+ *
+ * @param self IN dispatch index
+ * @param module IN module name
+ * @param blocks IN blocks of this module
+ */
+static void dispatch_add_module(dispatch_t *self, const char *module,
+                                apr_hash_t *blocks) {
+  apr_hash_index_t *hi;
+  apr_hash_t **key = apr_palloc(self->pool, sizeof(*key));
+
+  *key = blocks;
+  apr_hash_set(self->snapshots, key, sizeof(*key), 
+               apr_hash_copy(self->pool, blocks));
+
+  for (hi = apr_hash_first(self->pool, blocks); hi; hi = apr_hash_next(hi)) {
+    const void *key;
+    void *val;
+    const char *block_name;
+
+    apr_hash_this(hi, &key, NULL, &val);
+    block_name = key;
+    /* see command_CALL: "_MOD:CMD" is block "_CMD" of module "MOD" */
+    if (block_name[0] == '_') {
+      apr_hash_set(self->blocks,
+                   apr_pstrcat(self->pool, "_", module, ":", &block_name[1],
+                               NULL),
+                   APR_HASH_KEY_STRING, val);
+    }
+    apr_hash_set(self->blocks,
+                 apr_pstrcat(self->pool, module, ":", block_name, NULL),
+                 APR_HASH_KEY_STRING, val);
+  }
+}
+
+/**
+ * Create a dispatch index for a command table and modules
+ *
+ * @param pool IN pool
+ * @param commands IN command table terminated with a NULL name
+ * @param modules IN module hash, may be NULL
+ *
+ * @return dispatch index
+ */
+dispatch_t *dispatch_new(apr_pool_t *pool, command_t *commands,
+                         apr_hash_t *modules) {
+  int k;
+  dispatch_t *self = apr_pcalloc(pool, sizeof(*self));
+
+  self->pool = pool;
+  self->commands = commands;
+  self->root = apr_pcalloc(pool, sizeof(*self->root));
+  self->root->index = -1;
+  self->blocks = apr_hash_make(pool);
+  self->snapshots = apr_hash_make(pool);
+
+  for (k = 0; commands[k].name; k++) {
+    const char *cur;
+    dispatch_node_t *node = self->root;
+
+    for (cur = commands[k].name; *cur; cur++) {
+      node = dispatch_node_child(self, node, *cur);
+    }
+    if (node->index == -1) {
+      node->index = k;
+    }
+  }
+  self->end = k;
+
+  if (modules) {
+    apr_hash_index_t *hi;
+    self->modules = apr_hash_copy(pool, modules);
+    for (hi = apr_hash_first(pool, modules); hi; hi = apr_hash_next(hi)) {
+      const void *key;
+      void *val;
+
+      apr_hash_this(hi, &key, NULL, &val);
+      dispatch_add_module(self, key, val);
+    }
+  }
+
+  return self;
+}
+
+/**
+ * Lookup command for a line, same result as a linear scan over the table
+ *
+ * @param self IN dispatch index
+ * @param line IN line where the command resides
+ *
+ * @return command, the terminating table entry if none match
+ */
+command_t *dispatch_get_command(dispatch_t *self, const char *line) {
+  const char *cur;
+  int index = self->end;
+  dispatch_node_t *node = self->root;
+
+  for (cur = line; *cur && node; cur++) {
+    dispatch_node_t *child;
+
+    for (child = node->child; child && child->c != *cur; child = child->next);
+    node = child;
+    if (node && node->index != -1 && node->index < index) {
+      index = node->index;
+    }
+  }
+
+  return &self->commands[index];
+}
+
+/**
+ * Lookup a module block by its calling name
+ *
+ * @param self IN dispatch index, may be NULL
+ * @param name IN name as called e.g. "_SYS:SLEEP"
+ * @param len IN length of name or APR_HASH_KEY_STRING
+ *
+ * @return block worker or NULL if not indexed
+ */
+worker_t *dispatch_get_block(dispatch_t *self, const char *name,
+                             apr_ssize_t len) {
+  if (!self) {
+    return NULL;
+  }
+  return apr_hash_get(self->blocks, name, len);
+}
+
+/**
+ * Get the module hash as it was at creation, the parser may still add
+ * modules to the live one
+ *
+ * @param self IN dispatch index
+ *
+ * @return module hash or NULL if created without modules
+ */
+apr_hash_t *dispatch_get_modules(dispatch_t *self) {
+  return self->modules;
+}
+
+/**
+ * Lookup a block in the snapshot of a module block hash
+ *
+ * @param self IN dispatch index, may be NULL
+ * @param blocks IN live block hash of a module
+ * @param name IN block name
+ * @param len IN length of name or APR_HASH_KEY_STRING
+ * @param block OUT block worker or NULL if not in the snapshot
+ *
+ * @return APR_SUCCESS or APR_ENOENT if there is no snapshot of blocks
+ */
+apr_status_t dispatch_get_local_block(dispatch_t *self, apr_hash_t *blocks,
+                                      const char *name, apr_ssize_t len,
+                                      worker_t **block) {
+  apr_hash_t *snapshot;
+
+  *block = NULL;
+  if (!self) {
+    return APR_ENOENT;
+  }
+  snapshot = apr_hash_get(self->snapshots, &blocks, sizeof(blocks));
+  if (!snapshot) {
+    return APR_ENOENT;
+  }
+  *block = apr_hash_get(snapshot, name, len);
+  return APR_SUCCESS;
+}
+
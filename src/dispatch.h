@@ -0,0 +1,40 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Interface of the HTTP Test Tool command dispatch index.
+ */
+
+#ifndef HTTEST_DISPATCH_H
+#define HTTEST_DISPATCH_H
+
+typedef struct dispatch_s dispatch_t;
+
+dispatch_t *dispatch_new(apr_pool_t *pool, command_t *commands,
+                         apr_hash_t *modules);
+command_t *dispatch_get_command(dispatch_t *self, const char *line);
+worker_t *dispatch_get_block(dispatch_t *self, const char *name,
+                             apr_ssize_t len);
+apr_status_t dispatch_get_local_block(dispatch_t *self, apr_hash_t *blocks,
+                                      const char *name, apr_ssize_t len,
+                                      worker_t **block);
+apr_hash_t *dispatch_get_modules(dispatch_t *self);
+
+#endif
@@ -0,0 +1,1098 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Implementation of the HTTP Test Tool event engine.
+ *
+ * Virtual users run as user space contexts on a few carrier threads. Every
+ * user is bound to one carrier, which runs its ready users one after the
+ * other and waits on an epoll set and a timer heap for the next ones. A
+ * user which would block on a socket or a sleep registers its fd or its
+ * wakeup time and switches back to the carrier, so scripts and commands
+ * keep their blocking style. Outside of a user all functions fall back to
+ * the plain blocking calls.
+ *
+ * User stacks are mapped on demand with a guard page below, so only the
+ * touched pages cost memory. On x86_64 a user switch saves and restores
+ * the callee saved registers only, elsewhere ucontext is used, which also
+ * saves the signal mask with a system call.
+ */
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <apr.h>
+#include <apr_errno.h>
+#include <apr_general.h>
+#include <apr_time.h>
+#include <apr_portable.h>
+#include <apr_network_io.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+
+#include "defines.h"
+#include "engine.h"
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H) && \
+    defined(HAVE_UCONTEXT_H)
+#define ENGINE_EVENT 1
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+#define ENGINE_ASM 1
+#endif
+#endif
+
+/************************************************************************
+ * Definitions
+ ***********************************************************************/
+#ifdef ENGINE_EVENT
+
+#define ENGINE_EVENTS 64
+
+#ifdef MSG_NOSIGNAL
+#define ENGINE_MSG_FLAGS (MSG_DONTWAIT | MSG_NOSIGNAL)
+#else
+#define ENGINE_MSG_FLAGS MSG_DONTWAIT
+#endif
+
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+
+typedef struct engine_carrier_s engine_carrier_t;
+typedef struct engine_user_s engine_user_t;
+
+#ifdef ENGINE_ASM
+typedef struct engine_ctx_s {
+  void *sp;
+} engine_ctx_t;
+#else
+typedef ucontext_t engine_ctx_t;
+#endif
+
+struct engine_user_s {
+  engine_ctx_t ctx;
+  engine_carrier_t *carrier;
+  apr_thread_start_t func;
+  void *data;
+  /* mapping including the guard page */
+  char *stack;
+  apr_size_t mapped;
+  /* wakeup time and index in timer heap, -1 if no timer */
+  apr_time_t wakeup;
+  int timer;
+  /* fd waiting for, -1 if none */
+  int fd;
+  apr_status_t wait_status;
+  int done;
+  engine_user_t *next;
+};
+
+struct engine_carrier_s {
+  engine_t *engine;
+  apr_thread_t *thread;
+  int epfd;
+  int evfd;
+  engine_ctx_t ctx;
+  /* running user */
+  engine_user_t *cur;
+  engine_user_t *ready;
+  engine_user_t *ready_tail;
+  /* spawned users not yet seen by the carrier */
+  apr_thread_mutex_t *mutex;
+  engine_user_t *incoming;
+  /* min heap of users by wakeup time */
+  engine_user_t **timers;
+  int ntimers;
+  int max_timers;
+};
+
+struct engine_s {
+  apr_pool_t *pool;
+  apr_size_t stacksize;
+  apr_size_t pagesize;
+  int n;
+  engine_carrier_t *carriers;
+  int next;
+  /* live users */
+  int users;
+  engine_stat_t stat;
+  apr_thread_mutex_t *mutex;
+  apr_thread_cond_t *cond;
+};
+
+#endif
+
+struct engine_cond_s {
+  /* threads waiting outside of any user */
+  apr_thread_cond_t *cond;
+#ifdef ENGINE_EVENT
+  int threads;
+  /* users waiting, first in first out */
+  engine_user_t *first;
+  engine_user_t *last;
+#endif
+};
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+#ifdef ENGINE_EVENT
+/* carrier of the calling thread */
+static apr_threadkey_t *engine_key = NULL;
+#endif
+
+#ifdef ENGINE_ASM
+/* save callee saved registers, sse and x87 control words on the current
+ * stack, store stack pointer in *from and restore all from stack to */
+void engine_ctx_switch(void **from, void *to);
+__asm__(
+  ".text\n"
+  ".globl engine_ctx_switch\n"
+  ".hidden engine_ctx_switch\n"
+  ".type engine_ctx_switch,@function\n"
+  "engine_ctx_switch:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $8, %rsp\n"
+  "  stmxcsr (%rsp)\n"
+  "  fnstcw 4(%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  "  ldmxcsr (%rsp)\n"
+  "  fldcw 4(%rsp)\n"
+  "  addq $8, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+  ".size engine_ctx_switch,.-engine_ctx_switch\n"
+);
+#endif
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+#ifdef ENGINE_EVENT
+
+/**
+ * Get carrier of the calling thread
+ * @return carrier or NULL if not called from a carrier
+ */
+static engine_carrier_t *engine_get_carrier(void) {
+  void *carrier = NULL;
+  if (engine_key) {
+    apr_threadkey_private_get(&carrier, engine_key);
+  }
+  return carrier;
+}
+
+/**
+ * Swap two timer heap entries
+ * @param carrier IN carrier
+ * @param i IN index
+ * @param j IN index
+ */
+static void engine_timer_swap(engine_carrier_t *carrier, int i, int j) {
+  engine_user_t *tmp = carrier->timers[i];
+  carrier->timers[i] = carrier->timers[j];
+  carrier->timers[j] = tmp;
+  carrier->timers[i]->timer = i;
+  carrier->timers[j]->timer = j;
+}
+
+/**
+ * Restore heap order from index i
+ * @param carrier IN carrier
+ * @param i IN index
+ */
+static void engine_timer_fix(engine_carrier_t *carrier, int i) {
+  while (i > 0 && carrier->timers[(i - 1) / 2]->wakeup >
+                  carrier->timers[i]->wakeup) {
+    engine_timer_swap(carrier, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  for (;;) {
+    int min = i;
+    int l = 2 * i + 1;
+    int r = 2 * i + 2;
+    if (l < carrier->ntimers &&
+        carrier->timers[l]->wakeup < carrier->timers[min]->wakeup) {
+      min = l;
+    }
+    if (r < carrier->ntimers &&
+        carrier->timers[r]->wakeup < carrier->timers[min]->wakeup) {
+      min = r;
+    }
+    if (min == i) {
+      break;
+    }
+    engine_timer_swap(carrier, i, min);
+    i = min;
+  }
+}
+
+/**
+ * Add user to timer heap
+ * @param carrier IN carrier
+ * @param user IN user with wakeup time
+ */
+static void engine_timer_add(engine_carrier_t *carrier, engine_user_t *user) {
+  if (carrier->ntimers == carrier->max_timers) {
+    carrier->max_timers = carrier->max_timers ? carrier->max_timers * 2 : 64;
+    carrier->timers = realloc(carrier->timers,
+                              carrier->max_timers * sizeof(*carrier->timers));
+  }
+  user->timer = carrier->ntimers++;
+  carrier->timers[user->timer] = user;
+  engine_timer_fix(carrier, user->timer);
+}
+
+/**
+ * Remove user from timer heap
+ * @param carrier IN carrier
+ * @param user IN user in heap
+ */
+static void engine_timer_remove(engine_carrier_t *carrier,
+                                engine_user_t *user) {
+  int i = user->timer;
+
+  user->timer = -1;
+  if (i != --carrier->ntimers) {
+    carrier->timers[i] = carrier->timers[carrier->ntimers];
+    carrier->timers[i]->timer = i;
+    engine_timer_fix(carrier, i);
+  }
+}
+
+/**
+ * Append user to the ready queue
+ * @param carrier IN carrier
+ * @param user IN user
+ */
+static void engine_ready(engine_carrier_t *carrier, engine_user_t *user) {
+  user->next = NULL;
+  if (carrier->ready_tail) {
+    carrier->ready_tail->next = user;
+  }
+  else {
+    carrier->ready = user;
+  }
+  carrier->ready_tail = user;
+}
+
+/**
+ * Stop waiting for the fd of a user
+ * @param carrier IN carrier
+ * @param user IN user
+ */
+static void engine_unwatch(engine_carrier_t *carrier, engine_user_t *user) {
+  if (user->fd != -1) {
+    epoll_ctl(carrier->epfd, EPOLL_CTL_DEL, user->fd, NULL);
+    user->fd = -1;
+  }
+  if (user->timer != -1) {
+    engine_timer_remove(carrier, user);
+  }
+}
+
+/**
+ * Save the running context in from and continue with to
+ * @param from OUT saved context
+ * @param to IN context to continue
+ */
+static void engine_ctx_swap(engine_ctx_t *from, engine_ctx_t *to) {
+#ifdef ENGINE_ASM
+  engine_ctx_switch(&from->sp, to->sp);
+#else
+  swapcontext(from, to);
+#endif
+}
+
+/**
+ * Switch from the running user back to its carrier
+ * @param carrier IN carrier
+ */
+static void engine_suspend(engine_carrier_t *carrier) {
+  engine_user_t *user = carrier->cur;
+  engine_ctx_swap(&user->ctx, &carrier->ctx);
+}
+
+/**
+ * Hand a suspended user back to its carrier, callable from any thread
+ * @param user IN user
+ */
+static void engine_wakeup(engine_user_t *user) {
+  engine_carrier_t *carrier = user->carrier;
+
+  apr_thread_mutex_lock(carrier->mutex);
+  user->next = carrier->incoming;
+  carrier->incoming = user;
+  apr_thread_mutex_unlock(carrier->mutex);
+  eventfd_write(carrier->evfd, 1);
+}
+
+/**
+ * Entry of a user context, switches back to the carrier for good
+ */
+static void engine_user_main(void) {
+  engine_carrier_t *carrier = engine_get_carrier();
+  engine_user_t *user = carrier->cur;
+
+  user->func(NULL, user->data);
+  user->done = 1;
+  engine_ctx_swap(&user->ctx, &carrier->ctx);
+}
+
+/**
+ * Prepare the context of a new user to start in engine_user_main
+ * @param user IN user with mapped stack
+ * @param top IN end of the usable stack
+ */
+static void engine_ctx_make(engine_user_t *user, char *top) {
+#ifdef ENGINE_ASM
+  void **sp = (void **)((apr_uintptr_t)top & ~(apr_uintptr_t)15);
+
+  /* fake return address of engine_user_main, keeps the abi alignment */
+  *--sp = NULL;
+  *--sp = (void *)engine_user_main;
+  /* rbp, rbx, r12 - r15 */
+  sp -= 6;
+  memset(sp, 0, 6 * sizeof(*sp));
+  /* default mxcsr and x87 control word */
+  --sp;
+  ((apr_uint32_t *)sp)[0] = 0x1f80;
+  ((apr_uint16_t *)sp)[2] = 0x037f;
+  user->ctx.sp = sp;
+#else
+  getcontext(&user->ctx);
+  user->ctx.uc_stack.ss_sp = user->stack;
+  user->ctx.uc_stack.ss_size = top - user->stack;
+  user->ctx.uc_link = NULL;
+  makecontext(&user->ctx, engine_user_main, 0);
+#endif
+}
+
+/**
+ * Count resident bytes of the stack of a user
+ * @param engine IN engine
+ * @param user IN user
+ * @return resident bytes
+ */
+static apr_size_t engine_stack_resident(engine_t *engine,
+                                        engine_user_t *user) {
+  apr_size_t i;
+  apr_size_t resident = 0;
+  apr_size_t pages = user->mapped / engine->pagesize;
+  unsigned char *vec = malloc(pages);
+
+  if (vec && mincore(user->stack, user->mapped, (void *)vec) == 0) {
+    for (i = 0; i < pages; i++) {
+      if (vec[i] & 1) {
+        resident += engine->pagesize;
+      }
+    }
+  }
+  free(vec);
+  return resident;
+}
+
+/**
+ * Free a finished user and wake up joiners if it was the last one
+ * @param engine IN engine
+ * @param user IN finished user
+ */
+static void engine_user_free(engine_t *engine, engine_user_t *user) {
+  apr_size_t resident = engine_stack_resident(engine, user);
+
+  munmap(user->stack, user->mapped);
+  free(user);
+  apr_thread_mutex_lock(engine->mutex);
+  ++engine->stat.finished;
+  engine->stat.stack_resident += resident;
+  if (resident > engine->stat.stack_resident_max) {
+    engine->stat.stack_resident_max = resident;
+  }
+  if (--engine->users == 0) {
+    apr_thread_cond_broadcast(engine->cond);
+  }
+  apr_thread_mutex_unlock(engine->mutex);
+}
+
+/**
+ * Carrier thread, runs ready users and waits for fds and timers
+ * @param thread IN thread object
+ * @param data IN carrier
+ * @return NULL
+ */
+static void * APR_THREAD_FUNC engine_carrier_main(apr_thread_t *thread,
+                                                  void *data) {
+  engine_carrier_t *carrier = data;
+  struct epoll_event events[ENGINE_EVENTS];
+
+  apr_threadkey_private_set(carrier, engine_key);
+  for (;;) {
+    int i;
+    int n;
+    int timeout;
+    apr_time_t now;
+    engine_user_t *user;
+
+    apr_thread_mutex_lock(carrier->mutex);
+    user = carrier->incoming;
+    carrier->incoming = NULL;
+    apr_thread_mutex_unlock(carrier->mutex);
+    while (user) {
+      engine_user_t *next = user->next;
+      engine_ready(carrier, user);
+      user = next;
+    }
+
+    while ((user = carrier->ready)) {
+      carrier->ready = user->next;
+      if (!carrier->ready) {
+        carrier->ready_tail = NULL;
+      }
+      carrier->cur = user;
+      engine_ctx_swap(&carrier->ctx, &user->ctx);
+      carrier->cur = NULL;
+      if (user->done) {
+        engine_user_free(carrier->engine, user);
+      }
+    }
+
+    timeout = -1;
+    if (carrier->ntimers) {
+      apr_time_t wait = carrier->timers[0]->wakeup - apr_time_now();
+      timeout = wait > 0 ? (int)((wait + 999) / 1000) : 0;
+    }
+    n = epoll_wait(carrier->epfd, events, ENGINE_EVENTS, timeout);
+    for (i = 0; i < n; i++) {
+      user = events[i].data.ptr;
+      if (!user) {
+        eventfd_t value;
+        eventfd_read(carrier->evfd, &value);
+        continue;
+      }
+      engine_unwatch(carrier, user);
+      user->wait_status = APR_SUCCESS;
+      engine_ready(carrier, user);
+    }
+
+    now = apr_time_now();
+    while (carrier->ntimers && carrier->timers[0]->wakeup <= now) {
+      user = carrier->timers[0];
+      engine_timer_remove(carrier, user);
+      if (user->fd != -1) {
+        engine_unwatch(carrier, user);
+        user->wait_status = APR_TIMEUP;
+      }
+      engine_ready(carrier, user);
+    }
+  }
+
+  return NULL;
+}
+
+#endif
+
+/**
+ * Create an engine and start its carrier threads
+ * @param engine OUT engine
+ * @param pool IN pool, must live until exit
+ * @param carriers IN number of carrier threads, 0 for number of cores
+ * @param stacksize IN stack size of every user
+ * @return APR_SUCCESS, APR_ENOTIMPL if not supported on this platform
+ */
+apr_status_t engine_create(engine_t **engine, apr_pool_t *pool,
+                           int carriers, apr_size_t stacksize) {
+#ifdef ENGINE_EVENT
+  int i;
+  apr_status_t status;
+  engine_t *self;
+
+  if (!engine_key &&
+      (status = apr_threadkey_private_create(&engine_key, NULL, pool))
+      != APR_SUCCESS) {
+    return status;
+  }
+
+  if (carriers <= 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    carriers = cores > 0 ? cores : 1;
+  }
+
+  self = apr_pcalloc(pool, sizeof(*self));
+  self->pool = pool;
+  self->pagesize = sysconf(_SC_PAGESIZE);
+  self->stacksize = APR_ALIGN(stacksize, self->pagesize);
+  self->n = carriers;
+  self->stat.carriers = carriers;
+  self->stat.stacksize = self->stacksize;
+  self->carriers = apr_pcalloc(pool, carriers * sizeof(*self->carriers));
+  if ((status = apr_thread_mutex_create(&self->mutex,
+                                        APR_THREAD_MUTEX_DEFAULT, pool))
+      != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_thread_cond_create(&self->cond, pool)) != APR_SUCCESS) {
+    return status;
+  }
+
+  for (i = 0; i < carriers; i++) {
+    struct epoll_event ev;
+    engine_carrier_t *carrier = &self->carriers[i];
+
+    carrier->engine = self;
+    if ((status = apr_thread_mutex_create(&carrier->mutex,
+                                          APR_THREAD_MUTEX_DEFAULT, pool))
+        != APR_SUCCESS) {
+      return status;
+    }
+    if ((carrier->epfd = epoll_create(ENGINE_EVENTS)) == -1 ||
+        (carrier->evfd = eventfd(0, EFD_NONBLOCK)) == -1) {
+      return apr_get_os_error();
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(carrier->epfd, EPOLL_CTL_ADD, carrier->evfd, &ev) == -1) {
+      return apr_get_os_error();
+    }
+    if ((status = apr_thread_create(&carrier->thread, NULL,
+                                    engine_carrier_main, carrier, pool))
+        != APR_SUCCESS) {
+      return status;
+    }
+  }
+
+  *engine = self;
+  return APR_SUCCESS;
+#else
+  *engine = NULL;
+  return APR_ENOTIMPL;
+#endif
+}
+
+/**
+ * Start func as a new user on the next carrier
+ * @param engine IN engine
+ * @param func IN user function, called with a NULL thread
+ * @param data IN user data for func
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t engine_spawn(engine_t *engine, apr_thread_start_t func,
+                          void *data) {
+#ifdef ENGINE_EVENT
+  engine_carrier_t *carrier;
+  engine_user_t *user;
+
+  if (!(user = calloc(1, sizeof(*user)))) {
+    return APR_ENOMEM;
+  }
+  user->mapped = engine->stacksize + engine->pagesize;
+  user->stack = mmap(NULL, user->mapped, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (user->stack == MAP_FAILED) {
+    free(user);
+    return APR_ENOMEM;
+  }
+  /* guard page, a stack overflow crashes instead of corrupting memory */
+  mprotect(user->stack, engine->pagesize, PROT_NONE);
+  user->func = func;
+  user->data = data;
+  user->timer = -1;
+  user->fd = -1;
+
+  apr_thread_mutex_lock(engine->mutex);
+  ++engine->users;
+  if (engine->users > engine->stat.peak_users) {
+    engine->stat.peak_users = engine->users;
+  }
+  carrier = &engine->carriers[engine->next++ % engine->n];
+  apr_thread_mutex_unlock(engine->mutex);
+
+  user->carrier = carrier;
+  engine_ctx_make(user, user->stack + user->mapped);
+
+  engine_wakeup(user);
+
+  return APR_SUCCESS;
+#else
+  return APR_ENOTIMPL;
+#endif
+}
+
+/**
+ * Wait until all users have finished
+ * @param engine IN engine
+ * @return APR_SUCCESS
+ */
+apr_status_t engine_join(engine_t *engine) {
+#ifdef ENGINE_EVENT
+  apr_thread_mutex_lock(engine->mutex);
+  while (engine->users) {
+    apr_thread_cond_wait(engine->cond, engine->mutex);
+  }
+  apr_thread_mutex_unlock(engine->mutex);
+#endif
+  return APR_SUCCESS;
+}
+
+/**
+ * Set stack size of users spawned from now on
+ * @param engine IN engine
+ * @param stacksize IN stack size of every new user
+ */
+void engine_set_stacksize(engine_t *engine, apr_size_t stacksize) {
+#ifdef ENGINE_EVENT
+  apr_thread_mutex_lock(engine->mutex);
+  engine->stacksize = APR_ALIGN(stacksize, engine->pagesize);
+  engine->stat.stacksize = engine->stacksize;
+  apr_thread_mutex_unlock(engine->mutex);
+#endif
+}
+
+/**
+ * Get statistics of an engine
+ * @param engine IN engine
+ * @param stat OUT statistics
+ */
+void engine_get_stat(engine_t *engine, engine_stat_t *stat) {
+#ifdef ENGINE_EVENT
+  apr_thread_mutex_lock(engine->mutex);
+  *stat = engine->stat;
+  stat->users = engine->users;
+  apr_thread_mutex_unlock(engine->mutex);
+#else
+  memset(stat, 0, sizeof(*stat));
+#endif
+}
+
+/**
+ * Test if the caller runs as a user of an engine
+ * @return 1 if running in a user else 0
+ */
+int engine_is_user(void) {
+#ifdef ENGINE_EVENT
+  engine_carrier_t *carrier = engine_get_carrier();
+  return carrier && carrier->cur;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Suspend the calling user until fd is ready or timeout
+ * @param fd IN fd to wait for
+ * @param events IN ENGINE_READ and/or ENGINE_WRITE
+ * @param timeout IN timeout, negative waits forever
+ * @return APR_SUCCESS, APR_TIMEUP or APR_ENOTIMPL if not called in a user
+ */
+apr_status_t engine_wait_fd(int fd, int events, apr_interval_time_t timeout) {
+#ifdef ENGINE_EVENT
+  struct epoll_event ev;
+  engine_user_t *user;
+  engine_carrier_t *carrier = engine_get_carrier();
+
+  if (!carrier || !carrier->cur) {
+    return APR_ENOTIMPL;
+  }
+  user = carrier->cur;
+
+  ev.events = EPOLLONESHOT;
+  ev.events |= (events & ENGINE_READ) ? EPOLLIN : 0;
+  ev.events |= (events & ENGINE_WRITE) ? EPOLLOUT : 0;
+  ev.data.ptr = user;
+  if (epoll_ctl(carrier->epfd, EPOLL_CTL_ADD, fd, &ev) == -1 &&
+      (errno != EEXIST ||
+       epoll_ctl(carrier->epfd, EPOLL_CTL_MOD, fd, &ev) == -1)) {
+    return apr_get_os_error();
+  }
+  user->fd = fd;
+  if (timeout >= 0) {
+    user->wakeup = apr_time_now() + timeout;
+    engine_timer_add(carrier, user);
+  }
+  user->wait_status = APR_SUCCESS;
+  engine_suspend(carrier);
+  return user->wait_status;
+#else
+  return APR_ENOTIMPL;
+#endif
+}
+
+/**
+ * Sleep, suspends only the calling user if running in a user
+ * @param t IN time to sleep
+ */
+void engine_sleep(apr_interval_time_t t) {
+#ifdef ENGINE_EVENT
+  engine_user_t *user;
+  engine_carrier_t *carrier = engine_get_carrier();
+
+  if (carrier && carrier->cur) {
+    user = carrier->cur;
+    user->wakeup = apr_time_now() + t;
+    engine_timer_add(carrier, user);
+    engine_suspend(carrier);
+    return;
+  }
+#endif
+  apr_sleep(t);
+}
+
+/**
+ * Create a condition users and plain threads can wait on
+ * @param cond OUT condition
+ * @param pool IN pool
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t engine_cond_create(engine_cond_t **cond, apr_pool_t *pool) {
+  *cond = apr_pcalloc(pool, sizeof(**cond));
+  return apr_thread_cond_create(&(*cond)->cond, pool);
+}
+
+/**
+ * Wait on cond, suspends only the calling user if running in a user.
+ * Like apr_thread_cond_wait mutex must be held and callers must recheck
+ * their predicate after return.
+ * @param cond IN condition
+ * @param mutex IN locked mutex guarding the predicate and cond
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t engine_cond_wait(engine_cond_t *cond, apr_thread_mutex_t *mutex) {
+#ifdef ENGINE_EVENT
+  apr_status_t status;
+  engine_user_t *user;
+  engine_carrier_t *carrier = engine_get_carrier();
+
+  if (carrier && carrier->cur) {
+    user = carrier->cur;
+    user->next = NULL;
+    if (cond->last) {
+      cond->last->next = user;
+    }
+    else {
+      cond->first = user;
+    }
+    cond->last = user;
+    apr_thread_mutex_unlock(mutex);
+    /* a wakeup can not overtake us, our carrier is busy until we suspend */
+    engine_suspend(carrier);
+    return apr_thread_mutex_lock(mutex);
+  }
+  ++cond->threads;
+  status = apr_thread_cond_wait(cond->cond, mutex);
+  --cond->threads;
+  return status;
+#else
+  return apr_thread_cond_wait(cond->cond, mutex);
+#endif
+}
+
+/**
+ * Wake one waiter of cond, users first, call with the mutex held
+ * @param cond IN condition
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t engine_cond_signal(engine_cond_t *cond) {
+#ifdef ENGINE_EVENT
+  engine_user_t *user = cond->first;
+
+  if (user) {
+    cond->first = user->next;
+    if (!cond->first) {
+      cond->last = NULL;
+    }
+    engine_wakeup(user);
+    return APR_SUCCESS;
+  }
+  if (!cond->threads) {
+    return APR_SUCCESS;
+  }
+#endif
+  return apr_thread_cond_signal(cond->cond);
+}
+
+/**
+ * Wake all waiters of cond, call with the mutex held
+ * @param cond IN condition
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t engine_cond_broadcast(engine_cond_t *cond) {
+#ifdef ENGINE_EVENT
+  engine_user_t *user = cond->first;
+
+  cond->first = NULL;
+  cond->last = NULL;
+  while (user) {
+    engine_user_t *next = user->next;
+    engine_wakeup(user);
+    user = next;
+  }
+  if (!cond->threads) {
+    return APR_SUCCESS;
+  }
+#endif
+  return apr_thread_cond_broadcast(cond->cond);
+}
+
+/**
+ * Connect socket, suspends only the calling user if running in a user
+ * @param socket IN socket
+ * @param sa IN address to connect to
+ * @return apr status
+ */
+apr_status_t engine_socket_connect(apr_socket_t *socket, apr_sockaddr_t *sa) {
+#ifdef ENGINE_EVENT
+  if (engine_is_user()) {
+    apr_status_t status;
+    apr_interval_time_t t;
+
+    apr_socket_timeout_get(socket, &t);
+    apr_socket_timeout_set(socket, 0);
+    status = apr_socket_connect(socket, sa);
+    if (APR_STATUS_IS_EINPROGRESS(status) || APR_STATUS_IS_EAGAIN(status)) {
+      apr_os_sock_t fd;
+
+      apr_os_sock_get(&fd, socket);
+      if ((status = engine_wait_fd(fd, ENGINE_WRITE, t)) == APR_SUCCESS) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+          status = apr_get_netos_error();
+        }
+        else if (err) {
+          status = APR_FROM_OS_ERROR(err);
+        }
+        else {
+          /* let apr take over the connected state */
+          status = apr_socket_connect(socket, sa);
+        }
+      }
+    }
+    apr_socket_timeout_set(socket, t);
+    return status;
+  }
+#endif
+  return apr_socket_connect(socket, sa);
+}
+
+/**
+ * Receive from socket, suspends only the calling user if running in a user
+ * @param socket IN socket
+ * @param buf IN buffer
+ * @param len INOUT buffer size and received bytes
+ * @return apr status, APR_EOF if peer closed, APR_TIMEUP on socket timeout
+ */
+apr_status_t engine_socket_recv(apr_socket_t *socket, char *buf,
+                                apr_size_t *len) {
+#ifdef ENGINE_EVENT
+  if (engine_is_user()) {
+    apr_status_t status;
+    apr_interval_time_t t;
+    apr_os_sock_t fd;
+
+    apr_os_sock_get(&fd, socket);
+    apr_socket_timeout_get(socket, &t);
+    for (;;) {
+      ssize_t rc = recv(fd, buf, *len, MSG_DONTWAIT);
+      if (rc > 0) {
+        *len = rc;
+        return APR_SUCCESS;
+      }
+      if (rc == 0) {
+        *len = 0;
+        return APR_EOF;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno != EAGAIN && errno != EWOULDBLOCK) || t == 0) {
+        *len = 0;
+        return apr_get_netos_error();
+      }
+      if ((status = engine_wait_fd(fd, ENGINE_READ, t)) != APR_SUCCESS) {
+        *len = 0;
+        return status;
+      }
+    }
+  }
+#endif
+  return apr_socket_recv(socket, buf, len);
+}
+
+/**
+ * Send to socket, suspends only the calling user if running in a user
+ * @param socket IN socket
+ * @param buf IN buffer
+ * @param len INOUT bytes to send and bytes sent
+ * @return apr status, APR_TIMEUP on socket timeout
+ */
+apr_status_t engine_socket_send(apr_socket_t *socket, const char *buf,
+                                apr_size_t *len) {
+#ifdef ENGINE_EVENT
+  if (engine_is_user()) {
+    apr_status_t status;
+    apr_interval_time_t t;
+    apr_os_sock_t fd;
+
+    apr_os_sock_get(&fd, socket);
+    apr_socket_timeout_get(socket, &t);
+    for (;;) {
+      ssize_t rc = send(fd, buf, *len, ENGINE_MSG_FLAGS);
+      if (rc >= 0) {
+        *len = rc;
+        return APR_SUCCESS;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno != EAGAIN && errno != EWOULDBLOCK) || t == 0) {
+        *len = 0;
+        return apr_get_netos_error();
+      }
+      if ((status = engine_wait_fd(fd, ENGINE_WRITE, t)) != APR_SUCCESS) {
+        *len = 0;
+        return status;
+      }
+    }
+  }
+#endif
+  return apr_socket_send(socket, buf, len);
+}
+
+/**
+ * Send several buffers to socket with one call, suspends only the calling
+ * user if running in a user
+ * @param socket IN socket
+ * @param vec IN buffers
+ * @param nvec IN number of buffers
+ * @param len OUT bytes sent, may be less than all buffers
+ * @return apr status, APR_TIMEUP on socket timeout
+ */
+apr_status_t engine_socket_sendv(apr_socket_t *socket, const struct iovec *vec,
+                                 apr_int32_t nvec, apr_size_t *len) {
+#ifdef ENGINE_EVENT
+  if (engine_is_user()) {
+    apr_status_t status;
+    apr_interval_time_t t;
+    apr_os_sock_t fd;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *)vec;
+    msg.msg_iovlen = nvec;
+    apr_os_sock_get(&fd, socket);
+    apr_socket_timeout_get(socket, &t);
+    for (;;) {
+      ssize_t rc = sendmsg(fd, &msg, ENGINE_MSG_FLAGS);
+      if (rc >= 0) {
+        *len = rc;
+        return APR_SUCCESS;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno != EAGAIN && errno != EWOULDBLOCK) || t == 0) {
+        *len = 0;
+        return apr_get_netos_error();
+      }
+      if ((status = engine_wait_fd(fd, ENGINE_WRITE, t)) != APR_SUCCESS) {
+        *len = 0;
+        return status;
+      }
+    }
+  }
+#endif
+  return apr_socket_sendv(socket, vec, nvec, len);
+}
+
+/**
+ * Send a file region to a socket without copy through user space, in a
+ * user waits on the engine if the socket is full
+ * @param socket IN socket
+ * @param file IN file to send from
+ * @param offset IN file offset
+ * @param len INOUT bytes to send, on return bytes sent
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t engine_socket_sendfile(apr_socket_t *socket, apr_file_t *file,
+                                    apr_off_t offset, apr_size_t *len) {
+#ifdef ENGINE_EVENT
+  if (engine_is_user()) {
+    apr_status_t status;
+    apr_interval_time_t t;
+    apr_os_sock_t fd;
+    apr_os_file_t in;
+    off_t off = offset;
+
+    apr_os_sock_get(&fd, socket);
+    apr_os_file_get(&in, file);
+    apr_socket_timeout_get(socket, &t);
+    for (;;) {
+      ssize_t rc = sendfile(fd, in, &off, *len);
+      if (rc >= 0) {
+        *len = rc;
+        return APR_SUCCESS;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno != EAGAIN && errno != EWOULDBLOCK) || t == 0) {
+        *len = 0;
+        return apr_get_netos_error();
+      }
+      if ((status = engine_wait_fd(fd, ENGINE_WRITE, t)) != APR_SUCCESS) {
+        *len = 0;
+        return status;
+      }
+    }
+  }
+#endif
+#if APR_HAS_SENDFILE
+  return apr_socket_sendfile(socket, file, NULL, &offset, len, 0);
+#else
+  *len = 0;
+  return APR_ENOTIMPL;
+#endif
+}
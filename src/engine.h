@@ -0,0 +1,76 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Interface of the HTTP Test Tool event engine.
+ */
+
+#ifndef HTTEST_ENGINE_H
+#define HTTEST_ENGINE_H
+
+#include <apr_pools.h>
+#include <apr_network_io.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+
+#define ENGINE_READ  0x1
+#define ENGINE_WRITE 0x2
+
+typedef struct engine_s engine_t;
+typedef struct engine_cond_s engine_cond_t;
+
+typedef struct engine_stat_s {
+  int carriers;
+  /* live users and most live users at once */
+  int users;
+  int peak_users;
+  int finished;
+  /* reserved stack per user */
+  apr_size_t stacksize;
+  /* resident stack bytes of finished users, sum and max */
+  apr_size_t stack_resident;
+  apr_size_t stack_resident_max;
+} engine_stat_t;
+
+apr_status_t engine_create(engine_t **engine, apr_pool_t *pool,
+                           int carriers, apr_size_t stacksize);
+apr_status_t engine_spawn(engine_t *engine, apr_thread_start_t func,
+                          void *data);
+apr_status_t engine_join(engine_t *engine);
+void engine_set_stacksize(engine_t *engine, apr_size_t stacksize);
+void engine_get_stat(engine_t *engine, engine_stat_t *stat);
+int engine_is_user(void);
+apr_status_t engine_wait_fd(int fd, int events, apr_interval_time_t timeout);
+void engine_sleep(apr_interval_time_t t);
+apr_status_t engine_cond_create(engine_cond_t **cond, apr_pool_t *pool);
+apr_status_t engine_cond_wait(engine_cond_t *cond, apr_thread_mutex_t *mutex);
+apr_status_t engine_cond_signal(engine_cond_t *cond);
+apr_status_t engine_cond_broadcast(engine_cond_t *cond);
+apr_status_t engine_socket_connect(apr_socket_t *socket, apr_sockaddr_t *sa);
+apr_status_t engine_socket_recv(apr_socket_t *socket, char *buf,
+                                apr_size_t *len);
+apr_status_t engine_socket_send(apr_socket_t *socket, const char *buf,
+                                apr_size_t *len);
+apr_status_t engine_socket_sendv(apr_socket_t *socket, const struct iovec *vec,
+                                 apr_int32_t nvec, apr_size_t *len);
+apr_status_t engine_socket_sendfile(apr_socket_t *socket, apr_file_t *file,
+                                    apr_off_t offset, apr_size_t *len);
+
+#endif
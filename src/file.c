@@ -48,7 +48,9 @@ struct bufreader_s {
   apr_size_t i;
   apr_size_t len;
   apr_bucket_alloc_t *alloc;
-  apr_bucket_brigade *line;
+  /* lines spanning a refill are joined here */
+  char *scratch;
+  apr_size_t scratch_size;
   char buf[BLOCK_MAX + 1];
 };
 
@@ -81,7 +83,6 @@ apr_status_t bufreader_new(bufreader_t ** self, apr_file_t * fp,
   *self = apr_pcalloc(p, sizeof(bufreader_t));
   (*self)->fp = fp;
   (*self)->alloc = apr_bucket_alloc_create(p);
-  (*self)->line = apr_brigade_create(p, (*self)->alloc);
   allocator = apr_pool_allocator_get(p);
   apr_allocator_max_free_set(allocator, 1024*1024);
   (*self)->pool = p;
@@ -95,50 +96,100 @@ apr_status_t bufreader_new(bufreader_t ** self, apr_file_t * fp,
   return APR_SUCCESS;
 }
 
+/**
+ * Append bytes to the scratch line, grow scratch if needed
+ *
+ * @param self IN bufreader object
+ * @param used IN bytes already in scratch
+ * @param buf IN bytes to append
+ * @param len IN number of bytes
+ */
+static void bufreader_scratch_add(bufreader_t *self, apr_size_t used,
+                                  const char *buf, apr_size_t len) {
+  if (used + len + 1 > self->scratch_size) {
+    char *scratch;
+    apr_size_t size = self->scratch_size ? self->scratch_size : 256;
+
+    while (used + len + 1 > size) {
+      size *= 2;
+    }
+    scratch = apr_palloc(self->pool, size);
+    if (used) {
+      memcpy(scratch, self->scratch, used);
+    }
+    self->scratch = scratch;
+    self->scratch_size = size;
+  }
+  if (len) {
+    memcpy(&self->scratch[used], buf, len);
+  }
+}
+
 /**
  * read line from file 
  *
  * @param self IN bufreader object
- * @param line OUT read line
+ * @param line OUT read line, valid till next read on this bufreader
  *
  * @return an apr status
+ * @note: a line within the read buffer is returned in place, only lines 
+ *        spanning a refill are copied
  */
 apr_status_t bufreader_read_line(bufreader_t * self, char **line) {
-  char c;
+  char *start;
+  char *end;
+  char *cr;
   apr_size_t i;
+  apr_size_t len;
   apr_status_t status = APR_SUCCESS;
-  int leave_loop = 0;
 
   *line = NULL;
 
   i = 0;
-  c = 0;
-  while (leave_loop == 0 && (status = apr_file_eof(self->fp)) != APR_EOF) {    
+  while ((status = apr_file_eof(self->fp)) != APR_EOF) {    
     if (self->i >= self->len) {
       if ((status = bufreader_fill(self)) != APR_SUCCESS) {
         break;
       }
+      continue;
     }
 
-    if (self->i < self->len) {
-      c = self->buf[self->i];
-      if (c == '\r' || c == '\n') {
-        leave_loop=1;
-        if (c == '\r' && self->i+1 < self->len && self->buf[self->i+1] == '\n') {
-          self->i++;
-        }
-        c='\0';
+    /* a line ends on \r, \n or \r\n */
+    start = &self->buf[self->i];
+    len = self->len - self->i;
+    if ((end = memchr(start, '\n', len))) {
+      len = end - start;
+    }
+    if ((cr = memchr(start, '\r', len))) {
+      end = cr;
+      len = cr - start;
+    }
+    self->i += len;
+
+    if (end) {
+      ++self->i;
+      if (*end == '\r' && self->i < self->len && self->buf[self->i] == '\n') {
+        ++self->i;
       }
-      apr_brigade_putc(self->line, NULL, NULL, c);
-      self->i++;
-      i++;
+      *end = 0;
+      if (!i) {
+        /* whole line in buffer */
+        *line = start;
+        break;
+      }
+    }
+    bufreader_scratch_add(self, i, start, len);
+    i += len;
+    if (end) {
+      break;
     }
   }
 
-  apr_brigade_pflatten(self->line, line, &i, self->pool);
-  apr_brigade_cleanup(self->line);
-
-  (*line)[i] = 0;
+  if (!*line) {
+    bufreader_scratch_add(self, i, NULL, 0);
+    self->scratch[i] = 0;
+    *line = self->scratch;
+  }
   while (**line == ' ' || **line == '\t') {
     ++*line;
   }
@@ -1086,7 +1086,7 @@ static ssize_t h2_data_read_callback(nghttp2_session *session,
       APR_RING_UNSPLICE(event, event, link);
 
       if (event->type == EVENT_FLUSH) {
-        apr_sleep(event->sleep * 1000);
+        engine_sleep(event->sleep * 1000);
       } else if (event->type == EVENT_DEFER) {
         return NGHTTP2_ERR_DEFERRED;
       }
@@ -1179,6 +1179,26 @@ static apr_status_t copy_data(worker_t *worker, h2_stream_t *stream, int pos) {
         }
         continue;
       }
+      else if (strstr(line.info, ";file")) {
+        /* file of _SENDFILE, stream data is kept in memory */
+        line.len = apr_atoi64(&line.info[7]);
+        if (action == COPY) {
+          apr_file_t *fp;
+          if ((status = apr_file_open(&fp, line.buf, APR_READ, 
+                                      APR_OS_DEFAULT, stream->p)) 
+              != APR_SUCCESS) {
+            return status;
+          }
+          status = apr_file_read_full(fp, &stream->data[data_len], line.len,
+                                      NULL);
+          apr_file_close(fp);
+          if (status != APR_SUCCESS) {
+            return status;
+          }
+        }
+        data_len += line.len;
+        continue;
+      }
 
       if (action == CALC && strstr(line.info, "resolve")) {
         int unresolved;
@@ -0,0 +1,211 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Implementation of the HTTP Test Tool latency histogram.
+ *
+ * A log-linear histogram in the manner of HdrHistogram: values below
+ * 2*HDR_SUB get a bucket each, above every power of two is split into
+ * HDR_SUB buckets of equal width. So a bucket is at most 1/HDR_SUB of its
+ * values wide, which keeps percentiles in microseconds exact to 1.6%
+ * from 1 us up to hours in 8 kB. Histograms of workers, processes or
+ * runs are merged by adding the buckets.
+ */
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <apr.h>
+#include <apr_file_io.h>
+
+#include "defines.h"
+#include "hdr.h"
+
+
+/************************************************************************
+ * Definitions
+ ***********************************************************************/
+/* log2 of HDR_SUB */
+#define HDR_SUB_BITS 6
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+
+/**
+ * Get bucket of a value
+ * @param value IN value
+ * @return bucket index
+ */
+static int hdr_bucket(apr_int64_t value) {
+  int shift = 0;
+
+  if (value < 2 * HDR_SUB) {
+    return value < 0 ? 0 : (int)value;
+  }
+  while ((value >> shift) >= 2 * HDR_SUB) {
+    ++shift;
+  }
+  if (HDR_SUB * shift + (value >> shift) >= HDR_BUCKETS) {
+    return HDR_BUCKETS - 1;
+  }
+  return HDR_SUB * shift + (int)(value >> shift);
+}
+
+/**
+ * Get highest value of a bucket
+ * @param bucket IN bucket index
+ * @return highest value counted in this bucket
+ */
+static apr_int64_t hdr_bucket_max(int bucket) {
+  int shift;
+
+  if (bucket < 2 * HDR_SUB) {
+    return bucket;
+  }
+  shift = bucket / HDR_SUB - 1;
+  return ((apr_int64_t)(bucket - HDR_SUB * shift + 1) << shift) - 1;
+}
+
+/**
+ * Get lowest value of a bucket
+ * @param bucket IN bucket index
+ * @return lowest value counted in this bucket
+ */
+static apr_int64_t hdr_bucket_min(int bucket) {
+  return bucket ? hdr_bucket_max(bucket - 1) + 1 : 0;
+}
+
+/**
+ * Empty a histogram
+ * @param hdr IN histogram
+ */
+void hdr_reset(hdr_t *hdr) {
+  memset(hdr, 0, sizeof(*hdr));
+}
+
+/**
+ * Count a value
+ * @param hdr IN histogram
+ * @param value IN value, usually a time in us
+ */
+void hdr_record(hdr_t *hdr, apr_int64_t value) {
+  if (!hdr->count || value < hdr->min) {
+    hdr->min = value;
+  }
+  if (!hdr->count || value > hdr->max) {
+    hdr->max = value;
+  }
+  ++hdr->count;
+  hdr->total += value;
+  ++hdr->counts[hdr_bucket(value)];
+}
+
+/**
+ * Add the values of an other histogram
+ * @param hdr IN histogram
+ * @param other IN histogram to add
+ */
+void hdr_add(hdr_t *hdr, const hdr_t *other) {
+  int i;
+
+  if (!other->count) {
+    return;
+  }
+  if (!hdr->count || other->min < hdr->min) {
+    hdr->min = other->min;
+  }
+  if (!hdr->count || other->max > hdr->max) {
+    hdr->max = other->max;
+  }
+  hdr->count += other->count;
+  hdr->total += other->total;
+  for (i = 0; i < HDR_BUCKETS; i++) {
+    hdr->counts[i] += other->counts[i];
+  }
+}
+
+/**
+ * Get a percentile
+ * @param hdr IN histogram
+ * @param percent IN percentile, e.g. 99.9
+ * @return highest value of the bucket holding the percentile, never more
+ *         than the max value, 0 if empty
+ */
+apr_int64_t hdr_percentile(const hdr_t *hdr, double percent) {
+  apr_uint64_t count = 0;
+  apr_uint64_t rank;
+  int i;
+
+  if (!hdr->count) {
+    return 0;
+  }
+  rank = (apr_uint64_t)(percent / 100 * hdr->count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  for (i = 0; i < HDR_BUCKETS; i++) {
+    count += hdr->counts[i];
+    if (count >= rank) {
+      apr_int64_t value = hdr_bucket_max(i);
+      return value < hdr->max ? value : hdr->max;
+    }
+  }
+  return hdr->max;
+}
+
+/**
+ * Write the not empty buckets, one "<name> <lowest> <highest> <count>" 
+ * line each, histograms are merged offline by adding the counts of the 
+ * same name and lowest value
+ * @param hdr IN histogram
+ * @param name IN name of the histogram
+ * @param file IN file to write to
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t hdr_write(const hdr_t *hdr, const char *name, apr_file_t *file) {
+  int i;
+
+  if (apr_file_printf(file, "# %s count %"APR_UINT64_T_FMT" min %"
+                      APR_INT64_T_FMT" max %"APR_INT64_T_FMT"\n", name, 
+                      hdr->count, hdr->min, hdr->max) < 0) {
+    return APR_EGENERAL;
+  }
+  for (i = 0; i < HDR_BUCKETS; i++) {
+    if (hdr->counts[i] &&
+        apr_file_printf(file, "%s %"APR_INT64_T_FMT" %"APR_INT64_T_FMT" %u\n", 
+                        name, hdr_bucket_min(i), hdr_bucket_max(i), 
+                        hdr->counts[i]) < 0) {
+      return APR_EGENERAL;
+    }
+  }
+  return APR_SUCCESS;
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Interface of the HTTP Test Tool latency histogram.
+ */
+
+#ifndef HTTEST_HDR_H
+#define HTTEST_HDR_H
+
+#include <apr_file_io.h>
+
+/* values per power of two, relative error at most 1/HDR_SUB */
+#define HDR_SUB 64
+/* exact up to 2*HDR_SUB, highest bucket holds 2^36 us and more */
+#define HDR_BUCKETS (31 * HDR_SUB)
+
+/* plain data, can be copied and placed in shared memory */
+typedef struct hdr_s {
+  apr_uint64_t count;
+  apr_uint64_t total;
+  apr_int64_t min;
+  apr_int64_t max;
+  apr_uint32_t counts[HDR_BUCKETS];
+} hdr_t;
+
+void hdr_reset(hdr_t *hdr);
+void hdr_record(hdr_t *hdr, apr_int64_t value);
+void hdr_add(hdr_t *hdr, const hdr_t *other);
+apr_int64_t hdr_percentile(const hdr_t *hdr, double percent);
+apr_status_t hdr_write(const hdr_t *hdr, const char *name, apr_file_t *file);
+
+#endif
@@ -285,6 +285,8 @@ static apr_status_t wait_request(worker_t * worker, request_t *r) {
          line[0] != 0) {
     /** get request line */
     if (i == 0) {
+      /* request line parts are kept, sockreader lines are not */
+      line = apr_pstrdup(r->pool, line);
       worker_log(worker, LOG_INFO, "Requested url: %s", line);
       r->method = apr_strtok(line, " ", &r->url);
       if (strcasecmp(r->method, "CONNECT") != 0) {
@@ -390,7 +392,7 @@ static apr_status_t wait_response(worker_t * worker, response_t *r) {
          line[0] != 0) {
     /** get request line */
     if (i == 0) {
-      r->status_line = line;
+      r->status_line = apr_pstrdup(r->pool, line);
     }
     else {
       /* headers */
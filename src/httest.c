@@ -61,6 +61,10 @@
 #include <unistd.h> /* for getpid() */
 #endif
 
+#if !defined(WIN32)
+#include <sys/resource.h> /* for getrusage() */
+#endif
+
 #include <setjmp.h>
 
 #include "file.h"
@@ -77,6 +81,9 @@
 #include "eval.h"
 #include "tcp_module.h"
 #include "body.h"
+#include "dispatch.h"
+#include "engine.h"
+#include "tpool.h"
 
 
 /************************************************************************
@@ -138,6 +145,8 @@ static apr_status_t global_TIMEOUT(command_t *self, global_t *global,
 				  char *data, apr_pool_t *ptmp); 
 static apr_status_t global_AUTO_CLOSE(command_t *self, global_t *global, 
 				      char *data, apr_pool_t *ptmp); 
+static apr_status_t global_STACK_SIZE(command_t *self, global_t *global, 
+				      char *data, apr_pool_t *ptmp); 
 static apr_status_t global_MODULE(command_t *self, global_t *global, 
 				  char *data, apr_pool_t *ptmp); 
 static apr_status_t global_REQUIRE_VERSION(command_t *self, global_t *global, 
@@ -202,6 +211,10 @@ command_t global_commands[] = {
   {"AUTO_CLOSE", (command_f )global_AUTO_CLOSE, "on|off", 
   "Handle Connection: close header and close automaticaly the given connection",
   COMMAND_FLAGS_NONE},
+  {"STACK_SIZE", (command_f )global_STACK_SIZE, "<size in kB>", 
+  "Stack size of CLIENT/SERVER threads started from now on, at least 16 kB,\n"
+  "overrules --stack-size",
+  COMMAND_FLAGS_NONE},
   {"BLOCK", (command_f )global_BLOCK, "<name>", 
   "Store a block of commands to call it from a CLIENT/SERVER/BLOCK",
   COMMAND_FLAGS_NONE},
@@ -297,6 +310,12 @@ command_t local_commands[] = {
   {"_TIMEOUT", (command_f )command_TIMEOUT, "<miliseconds>", 
    "Set socket timeout of current socket",
   COMMAND_FLAGS_NONE},
+  {"_THROTTLE", (command_f )command_THROTTLE, "CONN|WORKER|GLOBAL <bytes/s> [<burst>]", 
+   "Limit bandwidth of sent data per connection, per worker or over all\n"
+   "workers, data is sent in chunks of at most <burst> bytes, default is a\n"
+   "tenth of <bytes/s>, 0 <bytes/s> removes the limit. The GLOBAL limit\n"
+   "changes for all workers at once",
+  COMMAND_FLAGS_NONE},
   {"_SET", (command_f )command_SET, "<variable>=<value>|"
                                     "<variable><<delimiter>\\n(<value-lines>\\n)*<delimiter>", 
   "Store a value in a local variable. Multiline support.",
@@ -324,7 +343,8 @@ command_t local_commands[] = {
   "Filter only for receive mechanisme",
   COMMAND_FLAGS_NONE},
   {"_SENDFILE", (command_f )command_SENDFILE, "<file>", 
-  "Send file over http",
+  "Send file over http, the file is read on flush,\n"
+  "with sendfile on plain TCP if the body is not logged (-s or -e)",
   COMMAND_FLAGS_NONE},
   {"_DEBUG", (command_f )command_DEBUG, "<string>", 
   "Prints to stdout for debugging reasons",
@@ -384,6 +404,12 @@ command_t local_commands[] = {
   {"_IGNORE_BODY", (command_f )command_IGNORE_BODY, "on|off", 
   "Read but ignore body of request/response.",
   COMMAND_FLAGS_NONE},
+  {"_STREAM_WINDOW", (command_f )command_STREAM_WINDOW, "<bytes>|off", 
+  "Read bodies in windows of <bytes> and _MATCH/_GREP/_EXPECT each window\n"
+  "instead of holding the whole body, a match may span two windows.\n"
+  "_WAIT <var>, _EXEC |, _EXEC <, _PRINT_HEX and recorded bodies still read\n"
+  "the whole body",
+  COMMAND_FLAGS_NONE},
   {"_TUNNEL", (command_f )command_TUNNEL, "<host> [<SSL>:]<port>[:<tag>] [<cert-file> <key-file> [<ca-cert-file>]]", 
   "Open tunnel to defined host:port, with SSL support.\n"
   "If connection exist no connect will be performed\n"
@@ -429,11 +455,17 @@ command_t local_commands[] = {
   COMMAND_FLAGS_BODY},
   {"_BPS", (command_f )command_BPS, "<n> <duration>", 
   "Send not more than defined bytes per second, while defined duration [s]\n"
+  "a _THROTTLE WORKER limit still applies\n"
   "close body with _END",
   COMMAND_FLAGS_BODY},
-  {"_RPS", (command_f )command_RPS, "<n> <duration>", 
+  {"_RPS", (command_f )command_RPS, "<n> <duration> [constant|poisson]", 
   "Send not more than defined requests per second, while defined duration [s]\n"
   "Request is count on every _WAIT call\n"
+  "With constant or poisson the body is started n times per second on a fixed\n"
+  "schedule, independent of the response times. All clients running the same\n"
+  "_RPS line share the schedule, an overdue start goes to the next free one.\n"
+  "Latency is measured from the scheduled start, starts not possible within\n"
+  "duration are counted as missed\n"
   "close body with _END",
   COMMAND_FLAGS_BODY},
   {"_SOCKET", (command_f )command_SOCKET, "", 
@@ -486,6 +518,12 @@ command_t local_commands[] = {
 
 global_t *process_global = NULL;
 int success = 1;
+/* carriers of the event engine, 0 for number of cores, -1 for threads */
+static int engine_carriers = -1;
+/* stack size of a worker thread or of a client on the event engine */
+static apr_size_t thread_stacksize = DEFAULT_THREAD_STACKSIZE;
+/* processes to run the clients in, see --processes */
+static int processes = 1;
      
 /************************************************************************
  * Private 
@@ -597,33 +635,6 @@ static int get_tot_groups(global_t *global) {
   return ret;
 }
 
-/**
- * Lookup a block name in current module
- * @param worker IN worker object
- * @param line IN line with a possible block name
- * @param ptmp IN temp pool
- * @return block hash
- */
-static int worker_is_block(worker_t * worker, char *line, apr_pool_t *ptmp) {
-  apr_size_t len = 0;
-  char *block_name;
-
-  if (strncmp(line, "__", 2) == 0 || strncmp(line, "_-", 2) == 0) {
-    /* very special commands, not possible to overwrite this one */
-    return 0;
-  }
-
-  while (line[len] != ' ' && line[len] != '\0') ++len;
-  block_name = apr_pstrndup(ptmp, line, len);
-
-  /* if name space do handle otherwise */
-  if (strchr(block_name, ':')) {
-    return 0;
-  }
-
-  return apr_hash_get(worker->blocks, block_name, APR_HASH_KEY_STRING) != NULL;
-}
-
 /**
  * Replacer upcall for global context
  * @param udata IN void pointer to store
@@ -709,49 +720,178 @@ static void worker_set_global_error(worker_t *worker) {
   unlock(worker->mutex);
 }
 
+/**
+ * Resolve a script line to an op, this is done once per line at compile time
+ * or on every call for lines not part of a program
+ *
+ * @param worker IN worker object
+ * @param line IN script line
+ * @param op OUT resolved op
+ * @param pool IN pool for expanded link lines
+ */
+static void worker_resolve_op(worker_t *worker, char *line, op_t *op, 
+                              apr_pool_t *pool) {
+  command_t *command;
+
+  op->line = line;
+  op->args = line;
+  op->command = NULL;
+  op->vars = NULL;
+  op->file_and_line = NULL;
+  op->name_len = 0;
+  op->body = NULL;
+
+  /* remember a possible block name, blocks are looked up on execution as
+   * the visible module can change with _USE */
+  if (strncmp(line, "__", 2) != 0 && strncmp(line, "_-", 2) != 0) {
+    /* very special commands, not possible to overwrite this one */
+    while (line[op->name_len] != ' ' && line[op->name_len] != '\0') {
+      ++op->name_len;
+    }
+    /* if name space do handle otherwise */
+    if (memchr(line, ':', op->name_len)) {
+      op->name_len = 0;
+    }
+  }
+
+  command = dispatch_get_command(worker_get_dispatch(worker), line);
+  if (command->flags & COMMAND_FLAGS_LINK) {
+    op->type = OP_TYPE_LINK;
+    op->args = apr_pstrcat(pool, command->syntax, " ", 
+                           &line[strlen(command->name)], NULL);
+  }
+  else if (command->func) {
+    op->type = OP_TYPE_COMMAND;
+    op->command = command;
+    op->args = &line[strlen(command->name)];
+  }
+  else {
+    op->type = OP_TYPE_CALL;
+  }
+}
+
+/**
+ * Execute a resolved op
+ *
+ * @param worker IN worker object
+ * @param parent IN caller
+ * @param op IN op to execute
+ *
+ * @return an apr status
+ */
+static apr_status_t worker_op_call(worker_t *worker, worker_t *parent, 
+                                   op_t *op, apr_pool_t *ptmp) {
+  apr_status_t status;
+  op_t *caller_op = worker->op;
+
+  if (op->name_len && 
+      worker_get_block(worker, worker->blocks, op->line, op->name_len)) {
+    worker->op = NULL;
+    status = command_CALL(NULL, worker, op->line, ptmp);
+    worker->op = caller_op;
+    return worker_check_error(parent, status);
+  }
+
+  worker->op = op;
+  switch (op->type) {
+  case OP_TYPE_COMMAND:
+    status = op->command->func(op->command, worker, op->args, ptmp);
+    status = worker_check_error(parent, status);
+    break;
+  case OP_TYPE_LINK:
+    status = command_CALL(NULL, worker, op->args, ptmp);
+    status = worker_check_error(parent, status);
+    break;
+  default:
+    status = command_CALL(NULL, worker, op->args, ptmp);
+    if (!APR_STATUS_IS_ENOENT(status)) {
+      status = worker_check_error(parent, status);
+    }
+    else {
+      worker_log(worker, LOG_ERR, "%s syntax error", worker->name);
+      worker_set_global_error(worker);
+      status = APR_EINVAL;
+    }
+    break;
+  }
+  worker->op = caller_op;
+
+  return status;
+}
+
+/**
+ * Interpret a single text line, used for lines which are not part of a
+ * compiled program
+ *
+ * @param worker IN worker object
+ * @param parent IN caller
+ * @param line IN line to interpret
+ *
+ * @return an apr status
+ */
 static apr_status_t worker_local_call(worker_t *worker, worker_t *parent, 
                                       char *line) {
-    apr_pool_t *ptmp;
-    apr_status_t status = APR_SUCCESS;
-
-    HT_POOL_CREATE(&ptmp);
-    {
-      if (worker_is_block(worker, line, ptmp)) {
-        status = command_CALL(NULL, worker, line, ptmp);
-        status = worker_check_error(parent, status);
-      }
-      else {
-        int j = 0;
-        command_t *command = lookup_command(local_commands, line);
-        if (command->flags & COMMAND_FLAGS_LINK) {
-          j += strlen(command->name);
-          status = command_CALL(NULL, worker, apr_pstrcat(worker->pbody, 
-                                command->syntax,
-                                " ", &line[j], NULL), 
-                                ptmp);
-          status = worker_check_error(parent, status);
-        }
-        else if (command->func) {
-          j += strlen(command->name);
-          status = command->func(command, worker, &line[j], ptmp);
-          status = worker_check_error(parent, status);
-        }
-        else {
-          status = command_CALL(NULL, worker, line, ptmp);
-          if (!APR_STATUS_IS_ENOENT(status)) {
-            status = worker_check_error(parent, status);
-          }
-          else {
-            worker_log(worker, LOG_ERR, "%s syntax error", worker->name);
-            worker_set_global_error(worker);
-            status = APR_EINVAL;
-          }
-        }
-      }
+  apr_pool_t *ptmp;
+  apr_status_t status;
+  op_t op;
+
+  HT_POOL_CREATE(&ptmp);
+  worker_resolve_op(worker, line, &op, ptmp);
+  status = worker_op_call(worker, parent, &op, ptmp);
+  apr_pool_destroy(ptmp);
+
+  return status;
+}
+
+/**
+ * Get the compiled program for the current lines of worker, compile it if
+ * lines did change. The program lives in the pool of the
+ * lines table, so it dies together with the lines. Arguments holding
+ * variables get their variable slots split here, the commands still
+ * tokenize their arguments on execution. Body commands get their body
+ * compiled here, see worker_body.
+ *
+ * @param worker IN worker object
+ *
+ * @return program
+ */
+static program_t *worker_get_program(worker_t *worker) {
+  int i;
+  apr_pool_t *pool;
+  program_t *program = worker->program;
+  const apr_array_header_t *arr = apr_table_elts(worker->lines);
+  apr_table_entry_t *e = (apr_table_entry_t *) arr->elts;
+
+  if (program && program->lines == worker->lines && 
+      program->nelts == arr->nelts) {
+    return program;
+  }
+
+  pool = arr->pool;
+  program = apr_pcalloc(pool, sizeof(*program));
+  program->lines = worker->lines;
+  program->nelts = arr->nelts;
+  program->ops = apr_pcalloc(pool, (arr->nelts + 1) * sizeof(op_t));
+  for (i = 0; i < arr->nelts; i++) {
+    op_t *op = &program->ops[i];
+    worker_resolve_op(worker, e[i].val, op, pool);
+    op->file_and_line = e[i].key;
+    if (op->type == OP_TYPE_COMMAND && strchr(op->args, '$')) {
+      /* split variables once, see worker_replace_vars */
+      op->vars = replacer_compile(pool, op->args);
+    }
+  }
+  /* bodies of _IF, _LOOP, ... once, nested bodies are part of them */
+  for (i = 0; i < arr->nelts; i++) {
+    op_t *op = &program->ops[i];
+    if (op->type == OP_TYPE_COMMAND && 
+        op->command->flags & COMMAND_FLAGS_BODY) {
+      op->body = worker_body_compile(worker, program, i, pool);
     }
-    apr_pool_destroy(ptmp);
+  }
+  worker->program = program;
 
-    return status;
+  return program;
 }
 
 /**
@@ -766,23 +906,24 @@ static apr_status_t worker_local_call(worker_t *worker, worker_t *parent,
 static apr_status_t worker_interpret(worker_t * worker, worker_t *parent, 
                                      apr_pool_t *dummy) {
   apr_status_t status;
+  apr_pool_t *ptmp;
+  program_t *program;
   int to;
 
-  apr_table_entry_t *e =
-    (apr_table_entry_t *) apr_table_elts(worker->lines)->elts;
-
-  to = worker->cmd_to ? worker->cmd_to : apr_table_elts(worker->lines)->nelts;
+  program = worker_get_program(worker);
+  to = worker->cmd_to ? worker->cmd_to : program->nelts;
 
+  HT_POOL_CREATE(&ptmp);
   for (worker->cmd = worker->cmd_from; worker->cmd < to; worker->cmd++) {
-    char *line;
-
-    line = e[worker->cmd].val;
-    status = worker_local_call(worker, parent, line);
+    status = worker_op_call(worker, parent, &program->ops[worker->cmd], ptmp);
+    apr_pool_clear(ptmp);
 
     if (status != APR_SUCCESS) {
+      apr_pool_destroy(ptmp);
       return status;
     }
   }
+  apr_pool_destroy(ptmp);
   return APR_SUCCESS;
 }
 
@@ -814,7 +955,7 @@ void worker_finally(worker_t *worker, apr_status_t status) {
   worker_var_set(worker, "__THREAD", worker->name);
 
   if (get_threads(worker->global) == 0) { 
-    command_t *command = lookup_command(local_commands, "_CALL");
+    command_t *command = dispatch_get_command(worker_get_dispatch(worker), "_CALL");
     if (command->func) {
       mode = logger_get_mode(worker->logger);
       logger_set_mode(worker->logger, LOG_NONE);
@@ -827,7 +968,7 @@ void worker_finally(worker_t *worker, apr_status_t status) {
   }
 
   if (status != APR_SUCCESS) {
-    command_t *command = lookup_command(local_commands, "_CALL");
+    command_t *command = dispatch_get_command(worker_get_dispatch(worker), "_CALL");
     if (command->func) {
       worker->blocks = apr_hash_get(worker->modules, "DEFAULT", APR_HASH_KEY_STRING);
       if (apr_hash_get(worker->blocks, "ON_ERROR", APR_HASH_KEY_STRING)) {
@@ -842,7 +983,10 @@ void worker_finally(worker_t *worker, apr_status_t status) {
   }
 exodus:
   worker_conn_close_all(worker);
-  apr_thread_exit(worker->mythread, APR_SUCCESS);
+  /* event engine users and pool tasks simply return */
+  if (worker->mythread) {
+    apr_thread_exit(worker->mythread, APR_SUCCESS);
+  }
 }
 
 /**
@@ -868,7 +1012,12 @@ static void * APR_THREAD_FUNC worker_thread_client(apr_thread_t * thread, void *
   
   worker_log(worker, LOG_INFO, "%s start ...", worker->name);
 
-  if ((status = worker->interpret(worker, worker, NULL)) != APR_SUCCESS) {
+  /* a module may run the client on its own, e.g. repeated by a profile */
+  status = htt_run_client_run(worker);
+  if (status == APR_ENOTIMPL) {
+    status = worker->interpret(worker, worker, NULL);
+  }
+  if (status != APR_SUCCESS) {
     goto error;
   }
 
@@ -1001,68 +1150,59 @@ static void * APR_THREAD_FUNC worker_thread_server(apr_thread_t * thread, void *
  * @return an apr status
  */
 static apr_status_t worker_run_server_threads(worker_t *worker, int threads) {
-  apr_status_t status;
-  apr_threadattr_t *tattr;
-  apr_thread_t *threadl;
+  apr_status_t status = APR_SUCCESS;
+  tpool_task_t *task;
   apr_table_t *servers;
   apr_table_entry_t *e;
   worker_t *clone;
   int i = 0;
 
-  if ((status = apr_threadattr_create(&tattr, worker->pbody)) != APR_SUCCESS) {
-    return status;
-  }
-
-  if ((status = apr_threadattr_stacksize_set(tattr, DEFAULT_THREAD_STACKSIZE))
-      != APR_SUCCESS) {
-    return status;
-  }
-
-  if ((status = apr_threadattr_detach_set(tattr, 0)) != APR_SUCCESS) {
-    return status;
-  }
-
   servers = apr_table_make(worker->pbody, 10);
 
   while(threads == -1 || i < threads) {
     worker_clone(&clone, worker);
     if ((status = htt_run_worker_clone(worker, clone)) != APR_SUCCESS) {
-      return status;
+      break;
     }
     clone->listener = worker->listener;
     worker_log(worker, LOG_DEBUG, "--- accept");
     if (!worker->listener) {
       worker_log(worker, LOG_ERR, "Server down");
       status = APR_EGENERAL;
-      return status;
+      break;
     }
     if ((status = tcp_accept(clone)) != APR_SUCCESS) {
-      return status;
+      break;
     }
     if ((status = htt_run_accept(clone, "")) != APR_SUCCESS) {
-      return status;
+      break;
     }
     worker_log(worker, LOG_DEBUG, "--- create thread");
     clone->socket->socket_state = SOCKET_CONNECTED;
     clone->which = i;
-    if ((status =
-         apr_thread_create(&threadl, tattr, worker_thread_server,
-               clone, worker->pbody)) != APR_SUCCESS) {
-      return status;
+    if ((status = tpool_push(worker->global->tpool, worker_thread_server,
+                             clone, &task)) != APR_SUCCESS) {
+      break;
     }
 
-    apr_table_addn(servers, worker->name, (char *)threadl);
+    if (threads == -1) {
+      /* accepts forever, nobody would ever join */
+      tpool_detach(task);
+    }
+    else {
+      apr_table_addn(servers, worker->name, (char *)task);
+    }
 
     ++i;
   }
 
+  /* also on error, the started servers still use our listener */
   e = (apr_table_entry_t *) apr_table_elts(servers)->elts;
   for (i = 0; i < apr_table_elts(servers)->nelts; ++i) {
-    threadl = (apr_thread_t *) e[i].val;
-    apr_thread_join(&status, threadl);
+    tpool_join((tpool_task_t *) e[i].val);
   }
 
-  return APR_SUCCESS;
+  return status;
 }
 
 /**
@@ -1200,6 +1340,11 @@ static apr_status_t global_new(global_t **global, store_t *vars,
   (*global)->vars = vars;
 
   (*global)->threads = apr_table_make(p, 10);
+  (*global)->tasks = apr_table_make(p, 10);
+  (*global)->dispatch_pools = apr_array_make(p, 2, sizeof(apr_pool_t *));
+  (*global)->rps_scheds = apr_hash_make(p);
+  (*global)->procs = apr_array_make(p, 5, sizeof(apr_proc_t));
+  (*global)->process = -1;
   (*global)->clients = apr_table_make(p, 5);
   (*global)->servers = apr_table_make(p, 5);
   (*global)->daemons = apr_table_make(p, 5);
@@ -1242,7 +1387,7 @@ static apr_status_t global_new(global_t **global, store_t *vars,
   }
 
   if ((status = apr_threadattr_stacksize_set((*global)->tattr, 
-                                             DEFAULT_THREAD_STACKSIZE))
+                                             thread_stacksize))
       != APR_SUCCESS) {
     apr_file_printf(err, "\n"
                "Global creation: could not set stacksize");
@@ -1256,6 +1401,13 @@ static apr_status_t global_new(global_t **global, store_t *vars,
     return status;
   }
 
+  if ((status = tpool_create(&(*global)->tpool, p, thread_stacksize))
+      != APR_SUCCESS) {
+    apr_file_printf(err, "\n"
+               "Global creation: could not create thread pool");
+    return status;
+  }
+
   if ((status = apr_thread_mutex_create(&(*global)->sync_mutex, 
 	                                APR_THREAD_MUTEX_DEFAULT,
                                         p)) != APR_SUCCESS) {
@@ -1272,6 +1424,12 @@ static apr_status_t global_new(global_t **global, store_t *vars,
     return status;
   }
 
+  if ((status = htt_regex_cache_init(p)) != APR_SUCCESS) {
+    apr_file_printf(err, "\n"
+               "Global creation: could not create regex cache");
+    return status;
+  }
+
   (*global)->state = GLOBAL_STATE_NONE;
   (*global)->socktmo = 300000000;
 
@@ -1362,7 +1520,14 @@ static apr_status_t global_END(command_t *self, global_t *global, char *data,
     apr_hash_set(global->blocks, global->cur_worker->name, APR_HASH_KEY_STRING, 
 	         global->cur_worker);
     global->state = GLOBAL_STATE_NONE;
-    return htt_run_block_end(global);
+    if ((status = htt_run_block_end(global)) != APR_SUCCESS) {
+      return status;
+    }
+    /* compile once at load, calls share lines and program of the block */
+    if (global->cur_worker->interpret == worker_interpret) {
+      worker_get_program(global->cur_worker);
+    }
+    return APR_SUCCESS;
     break; 
   case GLOBAL_STATE_DAEMON:
     if (global->file_state == GLOBAL_FILE_STATE_MODULE) {
@@ -1397,6 +1562,10 @@ static apr_status_t global_END(command_t *self, global_t *global, char *data,
 
   /* store the workers to start them later */
   global->cur_worker->filename = global->filename;
+  /* compile once, the clones share lines and program */
+  if (global->cur_worker->interpret == worker_interpret) {
+    worker_get_program(global->cur_worker);
+  }
   while (concurrent) {
     clone = NULL;
     --concurrent;
@@ -1959,6 +2128,298 @@ static apr_status_t global_AUTO_CLOSE(command_t *self, global_t *global, char *d
   return APR_SUCCESS;
 }
 
+/**
+ * Global STACK_SIZE command
+ *
+ * @param self IN command
+ * @param global IN global object
+ * @param data IN stack size in kB (starting spaces are possible) 
+ *
+ * @return APR_SUCCESS or APR_EGENERAL on wrong size
+ */
+static apr_status_t global_STACK_SIZE(command_t *self, global_t *global, 
+                                      char *data, apr_pool_t *ptmp) {
+  apr_status_t status;
+  apr_size_t stacksize;
+  int i = 0;
+  
+  while (data[i] == ' ') {
+    ++i;
+  }
+
+  if (apr_atoi64(&data[i]) < 16) {
+    logger_log(global->logger, LOG_ERR, NULL, 
+               "Stack size \"%s\" too small, need at least 16 kB", &data[i]);
+    return APR_EGENERAL;
+  }
+  stacksize = apr_atoi64(&data[i]) * 1024;
+
+  if ((status = apr_threadattr_stacksize_set(global->tattr, stacksize))
+      != APR_SUCCESS) {
+    return status;
+  }
+  thread_stacksize = stacksize;
+  tpool_set_stacksize(global->tpool, stacksize);
+  if (global->engine) {
+    engine_set_stacksize(global->engine, stacksize);
+  }
+
+  return APR_SUCCESS;
+}
+
+/**
+ * Prepare a forked process to run its shard of the clients
+ *
+ * @param global IN global object
+ * @param process IN index of this process
+ *
+ * @return APR_SUCCESS or apr error
+ */
+static apr_status_t global_child_init(global_t *global, int process) {
+  apr_status_t status;
+  apr_table_t *clients;
+  apr_table_entry_t *e;
+  int i;
+
+  global->process = process;
+  /* daemons and servers stay in the parent */
+  apr_table_clear(global->daemons);
+  apr_table_clear(global->servers);
+  clients = apr_table_make(global->pool, 10);
+  e = (apr_table_entry_t *) apr_table_elts(global->clients)->elts;
+  for (i = 0; i < apr_table_elts(global->clients)->nelts; ++i) {
+    if (i % processes == process) {
+      apr_table_addn(clients, e[i].key, e[i].val);
+    }
+  }
+  global->clients = clients;
+
+  /* threads of the parent do not exist in the child */
+  apr_table_clear(global->threads);
+  apr_table_clear(global->tasks);
+  apr_array_clear(global->procs);
+  if ((status = tpool_create(&global->tpool, global->pool, thread_stacksize))
+      != APR_SUCCESS) {
+    return status;
+  }
+  /* only client processes carry users, see main */
+  if (engine_carriers >= 0 &&
+      (status = engine_create(&global->engine, global->pool, engine_carriers,
+                              thread_stacksize)) != APR_SUCCESS) {
+    return status;
+  }
+  /* forget what the parent measured so far */
+  return htt_run_process_init(global, process);
+}
+
+/**
+ * Fork processes which run the clients, the parent keeps servers and daemons.
+ * Called before any thread of this START exists, the children wait in
+ * global_sync_processes until the servers of the parent listen.
+ *
+ * @param global IN global object
+ *
+ * @return APR_SUCCESS in parent and child or apr error
+ */
+static apr_status_t global_fork_clients(global_t *global) {
+#if APR_HAS_FORK
+  apr_status_t status;
+  apr_file_t *ready_in;
+  apr_file_t *ready_out;
+  apr_proc_t *proc;
+  int i;
+
+  if ((status = htt_run_process_fork(global, processes)) != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_file_pipe_create(&ready_in, &ready_out, global->pool))
+      != APR_SUCCESS) {
+    logger_log(global->logger, LOG_ERR, NULL, "Could not create pipe");
+    return status;
+  }
+
+  /* else buffered output is written by every process */
+  fflush(NULL);
+  for (i = 0; i < processes; i++) {
+    proc = apr_array_push(global->procs);
+    status = apr_proc_fork(proc, global->pool);
+    if (status == APR_INCHILD) {
+      apr_file_close(ready_out);
+      global->procs_ready = ready_in;
+      return global_child_init(global, i);
+    }
+    else if (status != APR_INPARENT) {
+      apr_array_pop(global->procs);
+      apr_file_close(ready_in);
+      apr_file_close(ready_out);
+      logger_log(global->logger, LOG_ERR, NULL, "Could not fork process");
+      return status;
+    }
+  }
+  apr_file_close(ready_in);
+  global->procs_ready = ready_out;
+  apr_table_clear(global->clients);
+  return APR_SUCCESS;
+#else
+  logger_log(global->logger, LOG_ERR, NULL, "Processes not supported");
+  return APR_ENOTIMPL;
+#endif
+}
+
+/**
+ * Release the client processes of this START as soon as the servers listen,
+ * the parent writes one byte per process, every child reads one.
+ *
+ * @param global IN global object
+ *
+ * @return APR_SUCCESS or apr error
+ */
+static apr_status_t global_sync_processes(global_t *global) {
+  apr_status_t status = APR_SUCCESS;
+  apr_size_t len;
+  char c = 0;
+  int i;
+
+  if (!global->procs_ready) {
+    return APR_SUCCESS;
+  }
+  if (global->process >= 0) {
+    /* end of file if the parent failed to start its servers */
+    len = 1;
+    if ((status = apr_file_read(global->procs_ready, &c, &len)) 
+        != APR_SUCCESS) {
+      logger_log(global->logger, LOG_ERR, NULL, 
+                 "Parent process did not start its servers");
+    }
+  }
+  else {
+    for (i = 0; i < global->procs->nelts && status == APR_SUCCESS; i++) {
+      len = 1;
+      status = apr_file_write(global->procs_ready, &c, &len);
+    }
+  }
+  apr_file_close(global->procs_ready);
+  global->procs_ready = NULL;
+  return status;
+}
+
+/**
+ * Wait for all client processes of the last START
+ *
+ * @param global IN global object
+ *
+ * @return APR_SUCCESS or the first error, APR_EGENERAL if a process failed
+ */
+static apr_status_t global_join_processes(global_t *global) {
+  apr_status_t status;
+  apr_status_t first = APR_SUCCESS;
+  apr_proc_t *procs = (apr_proc_t *)global->procs->elts;
+  apr_exit_why_e why;
+  int exitcode;
+  int i;
+
+  for (i = 0; i < global->procs->nelts; ++i) {
+    apr_proc_wait(&procs[i], &exitcode, &why, APR_WAIT);
+    if (!APR_PROC_CHECK_EXIT(why) || exitcode != 0) {
+      logger_log(global->logger, LOG_ERR, NULL, "Process %d failed: %d", 
+                 procs[i].pid, exitcode);
+      if (first == APR_SUCCESS) {
+        first = APR_EGENERAL;
+      }
+    }
+    else if ((status = htt_run_process_joined(global, i)) != APR_SUCCESS &&
+             first == APR_SUCCESS) {
+      first = status;
+    }
+  }
+  apr_array_clear(global->procs);
+  return first;
+}
+
+/**
+ * Join all started workers on threads, pool threads and the event engine
+ *
+ * @param global IN global object
+ *
+ * @return APR_SUCCESS or apr error
+ */
+static apr_status_t global_join_workers(global_t *global) {
+  apr_status_t status;
+  apr_table_entry_t *e;
+  int i;
+  apr_thread_t *thread;
+
+  /* join all started threads */
+  e = (apr_table_entry_t *) apr_table_elts(global->threads)->elts;
+  for (i = 0; i < apr_table_elts(global->threads)->nelts; ++i) {
+    apr_status_t retstat;
+    thread = (apr_thread_t *) e[i].val;
+    status = htt_run_thread_join(global, thread);
+    if (status == APR_ENOTHREAD || status == APR_ENOTIMPL) {
+      if ((retstat = apr_thread_join(&status, thread))) {
+        logger_log(global->logger, LOG_ERR, NULL, "Could not join thread: %d", 
+                   retstat);
+        return retstat;
+      }
+    }
+    else if (status != APR_SUCCESS) {
+      logger_log(global->logger, LOG_ERR, NULL, "Could not join thread: %d", 
+                 status);
+      return status;
+    }
+  }
+  apr_table_clear(global->threads);
+  /* join all workers on pool threads */
+  e = (apr_table_entry_t *) apr_table_elts(global->tasks)->elts;
+  for (i = 0; i < apr_table_elts(global->tasks)->nelts; ++i) {
+    tpool_join((tpool_task_t *) e[i].val);
+  }
+  apr_table_clear(global->tasks);
+  if (global->engine) {
+    engine_join(global->engine);
+  }
+  return APR_SUCCESS;
+}
+
+/**
+ * Replace the dispatch index of global by one over the blocks defined so
+ * far. Workers still running keep their index, it is released on JOIN.
+ * Indices seen by daemons live until exit.
+ *
+ * @param global IN global object
+ */
+static void global_dispatch_renew(global_t *global) {
+  apr_pool_t *pool;
+
+  if (global->dispatch_pool) {
+    APR_ARRAY_PUSH(global->dispatch_pools, apr_pool_t *) = 
+      global->dispatch_pool;
+  }
+  if (apr_table_elts(global->daemons)->nelts) {
+    pool = global->pool;
+    global->dispatch_pool = NULL;
+  }
+  else {
+    apr_pool_create(&pool, global->pool);
+    global->dispatch_pool = pool;
+  }
+  global->dispatch = dispatch_new(pool, local_commands, global->modules);
+}
+
+/**
+ * Release the replaced dispatch indices, no worker but daemons is running
+ *
+ * @param global IN global object
+ */
+static void global_dispatch_release(global_t *global) {
+  int i;
+
+  for (i = 0; i < global->dispatch_pools->nelts; i++) {
+    apr_pool_destroy(APR_ARRAY_IDX(global->dispatch_pools, i, apr_pool_t *));
+  }
+  apr_array_clear(global->dispatch_pools);
+}
+
 /**
  * Global START command starts all so far defined threads 
  *
@@ -1975,12 +2436,23 @@ static apr_status_t global_START(command_t *self, global_t *global, char *data,
   int i;
   worker_t *worker;
   apr_thread_t *thread;
+  tpool_task_t *task;
 
+  /* index blocks defined so far, workers started here keep this index */
+  global_dispatch_renew(global);
+
+  /* fork while no thread of this START exists, children only run clients */
+  if (processes > 1 && apr_table_elts(global->clients)->nelts > 0 &&
+      (status = global_fork_clients(global)) != APR_SUCCESS) {
+    return status;
+  }
 
   /* create all daemons first */
   e = (apr_table_entry_t *) apr_table_elts(global->daemons)->elts;
   for (i = 0; i < apr_table_elts(global->daemons)->nelts; ++i) {
     worker = (void *)e[i].val;
+    worker->dispatch = global->dispatch;
+    worker->modules = dispatch_get_modules(global->dispatch);
     if ((status =
 	 apr_thread_create(&thread, global->tattr, worker_thread_daemon,
 			   worker, global->pool)) != APR_SUCCESS) {
@@ -1994,36 +2466,60 @@ static apr_status_t global_START(command_t *self, global_t *global, char *data,
   for (i = 0; i < apr_table_elts(global->servers)->nelts; ++i) {
     lock(global->sync_mutex);
     worker = (void *)e[i].val;
+    worker->dispatch = global->dispatch;
+    worker->modules = dispatch_get_modules(global->dispatch);
+    thread = NULL;
     status = htt_run_server_create(worker, worker_thread_listener, &thread);
     if (status == APR_ENOTHREAD || status == APR_ENOTIMPL) {
-      if ((status =
-           apr_thread_create(&thread, global->tattr, worker_thread_listener,
-                             worker, global->pool)) != APR_SUCCESS) {
+      if ((status = tpool_push(global->tpool, worker_thread_listener, worker,
+                               &task)) != APR_SUCCESS) {
         logger_log(global->logger, LOG_ERR, NULL, "Could not create server thread");
         return status;
       }
+      apr_table_addn(global->tasks, worker->name, (char *) task);
     }
     else if (status != APR_SUCCESS) {
       return status;
     }
-    apr_table_addn(global->threads, worker->name, (char *) thread);
+    if (thread) {
+      apr_table_addn(global->threads, worker->name, (char *) thread);
+    }
   }
   apr_table_clear(global->servers);
 
   /* create clients */
   lock(global->sync_mutex);
   unlock(global->sync_mutex);
+  if ((status = global_sync_processes(global)) != APR_SUCCESS) {
+    return status;
+  }
+  /* also in the parent of client processes, it may report on them */
+  if ((apr_table_elts(global->clients)->nelts > 0 || 
+       global->procs->nelts > 0) &&
+      (status = htt_run_clients_start(global)) != APR_SUCCESS) {
+    return status;
+  }
   e = (apr_table_entry_t *) apr_table_elts(global->clients)->elts;
   for (i = 0; i < apr_table_elts(global->clients)->nelts; ++i) {
     worker = (void *)e[i].val;
+    worker->dispatch = global->dispatch;
+    worker->modules = dispatch_get_modules(global->dispatch);
+    thread = NULL;
     status = htt_run_client_create(worker, worker_thread_client, &thread);
-    if (status == APR_ENOTHREAD || status == APR_ENOTIMPL) {
-      if ((status =
-           apr_thread_create(&thread, global->tattr, worker_thread_client,
-                             worker, global->pool)) != APR_SUCCESS) {
+    if ((status == APR_ENOTHREAD || status == APR_ENOTIMPL) && global->engine) {
+      if ((status = engine_spawn(global->engine, worker_thread_client, worker))
+          != APR_SUCCESS) {
+        logger_log(global->logger, LOG_ERR, NULL, "Could not spawn client");
+        return status;
+      }
+    }
+    else if (status == APR_ENOTHREAD || status == APR_ENOTIMPL) {
+      if ((status = tpool_push(global->tpool, worker_thread_client, worker,
+                               &task)) != APR_SUCCESS) {
         logger_log(global->logger, LOG_ERR, NULL, "Could not create client thread");
         return status;
       }
+      apr_table_addn(global->tasks, worker->name, (char *) task);
     }
     else if (status != APR_SUCCESS) {
       return status;
@@ -2044,6 +2540,14 @@ static apr_status_t global_START(command_t *self, global_t *global, char *data,
       return status;
     }
   }
+
+  if (global->process >= 0) {
+    /* a client process ends with its clients, the parent reports */
+    if ((status = global_join_workers(global)) == APR_SUCCESS) {
+      status = htt_run_process_exit(global, global->process);
+    }
+    exit(status == APR_SUCCESS && success ? 0 : 1);
+  }
  
   return APR_SUCCESS;
 }
@@ -2060,30 +2564,15 @@ static apr_status_t global_START(command_t *self, global_t *global, char *data,
 static apr_status_t global_JOIN(command_t *self, global_t *global, char *data, 
                                 apr_pool_t *ptmp) {
   apr_status_t status;
-  apr_table_entry_t *e;
-  int i;
-  apr_thread_t *thread;
 
-  /* join all started threads */
-  e = (apr_table_entry_t *) apr_table_elts(global->threads)->elts;
-  for (i = 0; i < apr_table_elts(global->threads)->nelts; ++i) {
-    apr_status_t retstat;
-    thread = (apr_thread_t *) e[i].val;
-    status = htt_run_thread_join(global, thread);
-    if (status == APR_ENOTHREAD || status == APR_ENOTIMPL) {
-      if ((retstat = apr_thread_join(&status, thread))) {
-        logger_log(global->logger, LOG_ERR, NULL, "Could not join thread: %d", 
-                   retstat);
-        return retstat;
-      }
-    }
-    else if (status != APR_SUCCESS) {
-      logger_log(global->logger, LOG_ERR, NULL, "Could not join thread: %d", 
-                 status);
-      return status;
-    }
+  /* first the clients, servers may wait for them forever */
+  if ((status = global_join_processes(global)) != APR_SUCCESS) {
+    return status;
   }
-  apr_table_clear(global->threads);
+  if ((status = global_join_workers(global)) != APR_SUCCESS) {
+    return status;
+  }
+  global_dispatch_release(global);
   global->groups = 0;
 
 
@@ -2168,6 +2657,8 @@ static apr_status_t interpret_recursiv(apr_file_t *fp, global_t *global) {
   while (bufreader_read_line(bufreader, &line) == APR_SUCCESS) {
     ++line_nr;
     global->line_nr = line_nr;
+    /* script lines are kept, bufreader lines live only till next read */
+    line = apr_pstrdup(global->pool, line);
     i = 0;
     if ((status = htt_run_read_line(global, &line)) != APR_SUCCESS) { 
       logger_log(global->logger, LOG_ERR, NULL, "Failed on read line %s(%d)", 
@@ -2257,6 +2748,8 @@ static apr_status_t interpret(apr_file_t * fp, store_t * vars, apr_file_t *out,
   for(i = 0; modules[i].module_init; i++) {
     modules[i].module_init(global);
   }
+  global->dispatch = dispatch_new(global->pool, local_commands, 
+                                  global->modules);
 
   /* must be that late for builtin modules */
   /* for modules in includes it must be even later */
@@ -2272,6 +2765,15 @@ static apr_status_t interpret(apr_file_t * fp, store_t * vars, apr_file_t *out,
     return APR_SUCCESS;
   }
 
+  /* with --processes the engine is created in the client processes */
+  if (engine_carriers >= 0 && processes == 1 &&
+      (status = engine_create(&global->engine, global->pool, engine_carriers,
+                              thread_stacksize)) != APR_SUCCESS) {
+    apr_file_printf(err, "\nCould not create event engine: %s (%d)",
+                    my_status_str(p, status), status);
+    return status;
+  }
+
   process_global = global;
   
   apr_file_name_get(&global->filename, fp);
@@ -2302,9 +2804,75 @@ apr_getopt_option_t options[] = {
   { "define", 'D', 1, "Define variables" },
   { "log-thread-number", 'l', 0, "Show the thread number for every printed line" },
   { "color", 'b', 0, "Colored output" },
+  { "stats", 'v', 0, "Print worker startup time and memory per virtual user" },
+  { "engine", 'E', 1, "Run clients as threads (default) or on an event engine, thread|event[:<threads>]" },
+  { "stack-size", 'K', 1, "Stack size in kB of a client or server thread, default 256" },
+  { "processes", 'P', 1, "Run the clients in <n> processes, servers and daemons stay in this one" },
   { NULL, 0, 0, NULL }
 };
 
+/**
+ * Get peak resident set size of this process
+ *
+ * @return peak resident set size in kB, 0 if not supported
+ */
+static long get_max_rss(void) {
+#if !defined(WIN32)
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+  }
+#endif
+  return 0;
+}
+
+/**
+ * Print worker startup time and memory per virtual user
+ *
+ * @param out IN output file
+ * @param global IN global object of the last run
+ * @param rss IN resident set size grown during the run in kB
+ */
+static void print_stats(apr_file_t *out, global_t *global, long rss) {
+  int users;
+
+  if (!global) {
+    return;
+  }
+  users = global->tot_threads ? global->tot_threads : 1;
+  apr_file_printf(out, "\nvirtual users: %d, clones: %d, "
+                  "clone time: %.1f us per clone\n", global->tot_threads,
+                  global->clones, global->clones ? 
+                  (double)global->clone_time / global->clones : 0.0);
+  apr_file_printf(out, "max rss grown: %ld kB, %.1f kB per virtual user\n",
+                  rss, (double)rss / users);
+  if (global->engine) {
+    engine_stat_t stat;
+
+    engine_get_stat(global->engine, &stat);
+    apr_file_printf(out, "engine carriers: %d, peak users: %d, "
+                    "stack: %"APR_SIZE_T_FMT" kB reserved, "
+                    "%.1f kB resident per user\n", stat.carriers,
+                    stat.peak_users, stat.stacksize / 1024, stat.finished ?
+                    (double)stat.stack_resident / stat.finished / 1024 : 0.0);
+  }
+  if (global->tpool) {
+    tpool_stat_t stat;
+
+    tpool_get_stat(global->tpool, &stat);
+    apr_file_printf(out, "pool threads: %d spawned for %d workers, "
+                    "peak busy: %d, spawn time: %.1f us per thread\n",
+                    stat.spawned, stat.tasks, stat.peak_busy, stat.spawned ?
+                    (double)stat.spawn_time / stat.spawned : 0.0);
+  }
+  apr_file_flush(out);
+}
+
 /** 
  * display usage information
  *
@@ -2575,6 +3143,10 @@ exit:
  * own exit func
  */
 static void my_exit() {
+  if (global && global->process >= 0) {
+    /* client process, the parent cleans up and reports */
+    return;
+  }
   if (global && global->cleanup_pool) {
     apr_pool_destroy(global->cleanup_pool);
   }
@@ -2618,10 +3190,12 @@ int main(int argc, const char *const argv[]) {
 #define MAIN_FLAGS_USE_STDIN 0x0002
 #define MAIN_FLAGS_NO_OUTPUT 0x0004
 #define MAIN_FLAGS_PRINT_DURATION 0x0008
+#define MAIN_FLAGS_PRINT_STATS 0x0010
   int flags;
   int logger_flags = 0;
   apr_time_t time = 0;
   char time_str[256];
+  long rss = 0;
   apr_file_t *out;
   apr_file_t *err;
 
@@ -2721,6 +3295,42 @@ int main(int argc, const char *const argv[]) {
     case 'b':
       logger_flags |= APPENDER_STD_COLOR; 
       break;
+    case 'v':
+      flags |= MAIN_FLAGS_PRINT_STATS; 
+      break;
+    case 'E':
+      if (strcmp(optarg, "thread") == 0) {
+        engine_carriers = -1;
+      }
+      else if (strncmp(optarg, "event", 5) == 0 && 
+               (optarg[5] == 0 || optarg[5] == ':')) {
+        engine_carriers = optarg[5] ? apr_atoi64(&optarg[6]) : 0;
+      }
+      else {
+        apr_file_printf(err, "Unknown engine \"%s\", need thread or "
+                        "event[:<threads>]\n", optarg);
+        apr_file_flush(err);
+        exit(1);
+      }
+      break;
+    case 'K':
+      if (apr_atoi64(optarg) < 16) {
+        apr_file_printf(err, "Stack size \"%s\" too small, need at least "
+                        "16 kB\n", optarg);
+        apr_file_flush(err);
+        exit(1);
+      }
+      thread_stacksize = apr_atoi64(optarg) * 1024;
+      break;
+    case 'P':
+      processes = apr_atoi64(optarg);
+      if (processes < 1) {
+        apr_file_printf(err, "Number of processes \"%s\" must be > 0\n", 
+                        optarg);
+        apr_file_flush(err);
+        exit(1);
+      }
+      break;
     }
   }
 
@@ -2806,6 +3416,9 @@ int main(int argc, const char *const argv[]) {
     if (flags & MAIN_FLAGS_PRINT_DURATION) {
       time = apr_time_now();
     }
+    if (flags & MAIN_FLAGS_PRINT_STATS) {
+      rss = get_max_rss();
+    }
     /* interpret current file */
     if ((status = interpret(fp, vars, out, err, log_mode, pool, NULL, 
                             logger_flags)) 
@@ -2827,6 +3440,10 @@ int main(int argc, const char *const argv[]) {
       apr_file_flush(out);
     }
 
+    if (flags & MAIN_FLAGS_PRINT_STATS) {
+      print_stats(out, process_global, get_max_rss() - rss);
+    }
+
     /* close current file */
     apr_file_close(fp);
 
@@ -2844,12 +3461,18 @@ APR_HOOK_STRUCT(
   APR_HOOK_LINK(block_end)
   APR_HOOK_LINK(server_port_args)
   APR_HOOK_LINK(worker_clone)
+  APR_HOOK_LINK(clients_start)
   APR_HOOK_LINK(client_create)
+  APR_HOOK_LINK(client_run)
   APR_HOOK_LINK(server_create)
   APR_HOOK_LINK(thread_start)
   APR_HOOK_LINK(worker_finally)
   APR_HOOK_LINK(thread_join)
   APR_HOOK_LINK(worker_joined)
+  APR_HOOK_LINK(process_fork)
+  APR_HOOK_LINK(process_init)
+  APR_HOOK_LINK(process_exit)
+  APR_HOOK_LINK(process_joined)
 )
 
 APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, server_port_args, 
@@ -2872,10 +3495,18 @@ APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, block_end,
                                       (global_t *global), 
                                       (global), APR_SUCCESS)
 
+APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, clients_start, 
+                                      (global_t *global), 
+                                      (global), APR_SUCCESS)
+
 APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, client_create, 
                                       (worker_t *worker, apr_thread_start_t func, apr_thread_t **new_thread), 
                                       (worker, func, new_thread), APR_ENOTIMPL)
 
+APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, client_run, 
+                                      (worker_t *worker), 
+                                      (worker), APR_ENOTIMPL)
+
 APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, server_create, 
                                       (worker_t *worker, apr_thread_start_t func, apr_thread_t **new_thread), 
                                       (worker, func, new_thread), APR_ENOTIMPL)
@@ -2895,3 +3526,19 @@ APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, thread_join,
 APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, worker_joined, 
                                       (global_t *global), 
                                       (global), APR_SUCCESS)
+
+APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, process_fork, 
+                                      (global_t *global, int processes), 
+                                      (global, processes), APR_SUCCESS)
+
+APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, process_init, 
+                                      (global_t *global, int process), 
+                                      (global, process), APR_SUCCESS)
+
+APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, process_exit, 
+                                      (global_t *global, int process), 
+                                      (global, process), APR_SUCCESS)
+
+APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, process_joined, 
+                                      (global_t *global, int process), 
+                                      (global, process), APR_SUCCESS)
@@ -52,6 +52,8 @@
 #include "file.h"
 #include "socket.h"
 #include "worker.h"
+#include "engine.h"
+#include "tpool.h"
 #include "module.h"
 
 #ifdef _WINDOWS
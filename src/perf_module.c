@@ -25,11 +25,16 @@
 /************************************************************************
  * Includes
  ***********************************************************************/
+#include <stdlib.h>
 #include <apr_version.h>
+#include <apr_atomic.h>
+#include <apr_shm.h>
 #include "defines.h"
 
 #include "module.h"
 #include "tcp_module.h"
+#include "hdr.h"
+#include "ring.h"
 
 /************************************************************************
  * Definitions 
@@ -45,6 +50,8 @@ typedef struct perf_time_s {
 typedef struct perf_count_s {
   int reqs;
   int conns;
+  /* open loop _RPS arrivals never started */
+  int missed;
   int less[10];
   int status[600];
 } perf_count_t;
@@ -59,11 +66,169 @@ typedef struct perf_s {
   apr_time_t sent_time_total;
 } perf_t;
 
+/* latency distributions in us */
+typedef struct perf_hdr_s {
+  hdr_t conn;
+  hdr_t sent;
+  hdr_t recv;
+  hdr_t total;
+  /* phases of conn and recv */
+  hdr_t dns;
+  hdr_t tcp;
+  hdr_t tls;
+  hdr_t ttfb;
+  hdr_t transfer;
+} perf_hdr_t;
+
+#define PERF_LABEL_NAME 64
+/* labels per thread and process, further labels count as "other" */
+#define PERF_LABELS_MAX 256
+/* room for labels or transactions of a process, including "other" */
+#define PERF_LABELS_SHARED (PERF_LABELS_MAX + 1)
+
+/* stat of a request label or a transaction */
+typedef struct perf_label_s {
+  char name[PERF_LABEL_NAME];
+  int transaction;
+  int reqs;
+  int errors;
+  int status[600];
+  hdr_t hdr;
+} perf_label_t;
+
+/* recorded by one thread only, the mutex guards adding labels */
+typedef struct perf_thread_s {
+  perf_hdr_t hdr;
+  apr_hash_t *labels;
+  apr_hash_t *transactions;
+  /* PERF:STAT LOG records for the writer and label ids known to thread */
+  ring_t *log;
+  apr_hash_t *log_ids;
+} perf_thread_t;
+
+/**
+ * PERF:STAT LOG BINARY record in host byte order. A file is a sequence of
+ * runs, each starting with a START record per process, a LABEL record is
+ * followed by PERF_LABEL_NAME bytes with the name of label id, a REQUEST
+ * record refers to label ids of its own process, 0 is no label.
+ */
+typedef struct perf_record_s {
+  /* us since epoch */
+  apr_uint64_t time;
+  /* label id, PERF_RECORD_VERSION for START */
+  apr_uint32_t label;
+  apr_uint16_t type;
+#define PERF_RECORD_START   0
+#define PERF_RECORD_LABEL   1
+#define PERF_RECORD_REQUEST 2
+  /* --processes index + 1, 0 if not forked */
+  apr_uint16_t process;
+  apr_uint16_t status;
+  apr_uint16_t failed;
+  /* us */
+  apr_uint32_t dns;
+  apr_uint32_t tcp;
+  apr_uint32_t tls;
+  apr_uint32_t sent;
+  apr_uint32_t ttfb;
+  apr_uint32_t transfer;
+  apr_uint32_t recv;
+  apr_uint32_t sent_bytes;
+  apr_uint32_t recv_bytes;
+} perf_record_t;
+
+#define PERF_RECORD_VERSION 1
+/* request line kept for the text log */
+#define PERF_LOG_LINE 200
+#define PERF_LOG_RING 512
+#define PERF_LOG_BUF 65536
+/* waits of 100 us for the writer before a record is dropped */
+#define PERF_LOG_WAITS 100
+
+typedef struct perf_log_slot_s {
+  perf_record_t record;
+  char line[PERF_LOG_LINE];
+} perf_log_slot_t;
+
+/* LABEL record with the name of its label id */
+typedef struct perf_log_label_s {
+  perf_record_t record;
+  char name[PERF_LABEL_NAME];
+} perf_log_label_t;
+
+typedef struct perf_log_s {
+  int binary;
+  apr_uint16_t process;
+  apr_thread_t *thread;
+  volatile apr_uint32_t stop;
+  /* label ids of this process, names[id - 1] */
+  apr_hash_t *ids;
+  apr_array_header_t *names;
+  /* labels already written */
+  int written;
+  /* whole records not yet written */
+  char *buf;
+  apr_size_t len;
+  /* rings of all threads, taken under hdr_mutex for each drain */
+  apr_array_header_t *rings;
+} perf_log_t;
+
+#define PERF_CACHE_LINE 64
+/* latency buckets, 4 per power of two up to 2^32 us */
+#define PERF_LIVE_BUCKETS 128
+#define PERF_LIVE_SLOTS 256
+#define PERF_LIVE_CHUNKS 1024
+
+typedef struct perf_counter_s {
+  volatile apr_uint32_t reqs;
+  volatile apr_uint32_t errors;
+  /* modulo 2^32, the reporter only needs differences */
+  volatile apr_uint32_t sent_bytes;
+  volatile apr_uint32_t recv_bytes;
+  volatile apr_uint32_t latency[PERF_LIVE_BUCKETS];
+} perf_counter_t;
+
+/* counters of one worker on own cache lines, only this worker writes */
+typedef struct perf_slot_s {
+  perf_counter_t c;
+  char pad[PERF_CACHE_LINE - sizeof(perf_counter_t) % PERF_CACHE_LINE];
+} perf_slot_t;
+
+/* what a client process hands over to the parent, followed by its labels */
+typedef struct perf_shared_s {
+  perf_t stat;
+  perf_hdr_t hdr;
+  /* PERF_LABELS_SHARED labels followed by as many transactions */
+  int labels;
+  int transactions;
+  /* published while running for the live reporter of the parent */
+  perf_counter_t live;
+} perf_shared_t;
+
 typedef struct perf_wconf_s {
   apr_time_t WAIT_time;
+  /* first line of the next request handed to the socket, 0 if none */
+  apr_time_t flush_time;
   int cur_status;
   const char *request_line;
   perf_t stat;
+  /* PERF:LABEL and open PERF:TRANSACTION, empty if none */
+  char label[PERF_LABEL_NAME];
+  char transaction[PERF_LABEL_NAME];
+  apr_time_t transaction_start;
+  int transaction_errors;
+  /* phase times and bytes of the current request */
+  apr_time_t dns_time;
+  apr_time_t tcp_time;
+  apr_time_t tls_time;
+  apr_time_t ttfb_time;
+  apr_time_t transfer_time;
+  apr_size_t sent_mark;
+  apr_size_t recv_mark;
+  /* time stamps of the phase hook */
+  apr_time_t phase[PHASE_BODY_END + 1];
+  /* live counters or NULL */
+  perf_counter_t *live;
 } perf_wconf_t;
 
 typedef struct perf_host_s {
@@ -99,15 +264,91 @@ typedef struct perf_gconf_threads_s {
 } perf_gconf_threads_t;
 
 
+typedef struct perf_stage_s {
+  int type;
+#define PERF_STAGE_RAMP 0
+#define PERF_STAGE_HOLD 1
+#define PERF_STAGE_STEP 2
+  /* active users at begin and end of stage */
+  int from;
+  int to;
+  /* users added per interval for STEP */
+  int step;
+  apr_time_t interval;
+  apr_time_t duration;
+  /* recorded while running */
+  apr_time_t begin;
+  apr_time_t end;
+  apr_uint32_t reqs;
+} perf_stage_t;
+
+typedef struct perf_profile_s {
+  /* NULL if no profile */
+  apr_array_header_t *stages;
+  apr_thread_t *thread;
+  apr_thread_mutex_t *mutex;
+  /* paused users wait here, event users without blocking their carrier */
+  engine_cond_t *cond;
+  /* users allowed to run an iteration */
+  int active;
+  int done;
+  /* users started and still running */
+  int started;
+  int running;
+  /* finished requests */
+  volatile apr_uint32_t reqs;
+} perf_profile_t;
+
+typedef struct perf_live_s {
+  apr_time_t interval;
+  apr_thread_t *thread;
+  /* hands out slots, never taken by the reporter */
+  apr_thread_mutex_t *mutex;
+  apr_pool_t *pool;
+  perf_slot_t *chunks[PERF_LIVE_CHUNKS];
+  /* shared by all workers beyond the last chunk */
+  perf_slot_t overflow;
+  /* slots handed out so far */
+  volatile apr_uint32_t slots;
+  volatile apr_uint32_t stop;
+  /* client processes publish their sums here instead of reporting */
+  perf_counter_t *publish;
+} perf_live_t;
+
 typedef struct perf_gconf_s {
   int on;
 #define PERF_GCONF_OFF  0
 #define PERF_GCONF_ON   1
 #define PERF_GCONF_LOG  2 
+#define PERF_GCONF_LIVE 4 
   int flags;
+  /* automatic request labels, see PERF:STAT LABEL */
+  int label_by;
+#define PERF_LABEL_OFF   0
+#define PERF_LABEL_ON    1
+#define PERF_LABEL_URL   2
+#define PERF_LABEL_BLOCK 3
   perf_t stat;
+  perf_hdr_t hdr;
+  apr_hash_t *labels;
+  apr_hash_t *transactions;
+  /* histograms and labels of every thread, merged into hdr at JOIN */
+  apr_threadkey_t *hdr_key;
+  apr_thread_mutex_t *hdr_mutex;
+  apr_pool_t *hdr_pool;
+  apr_array_header_t *threads;
   apr_file_t *log_file;
+  perf_log_t log;
+  /* raw histograms are written to, see PERF:STAT HDR */
+  apr_file_t *hdr_file;
   perf_gconf_threads_t clients;
+  perf_profile_t profile;
+  perf_live_t live;
+  /* stat of every client process in shared memory, see --processes */
+  apr_shm_t *shm;
+  char *shared;
+  apr_size_t shared_size;
+  int processes;
 } perf_gconf_t;
 
 /************************************************************************
@@ -152,6 +393,805 @@ static perf_wconf_t *perf_get_worker_config(worker_t *worker) {
   return config;
 }
 
+/**
+ * Get stat of the calling thread, histograms per thread instead of per 
+ * worker keep memory low with many users on the event engine, users of a
+ * carrier never record at the same time
+ * @param gconf IN global config
+ * @return thread stat
+ */
+static perf_thread_t *perf_get_thread(perf_gconf_t *gconf) {
+  perf_thread_t *thread = NULL;
+
+  apr_threadkey_private_get((void **)&thread, gconf->hdr_key);
+  if (!thread) {
+    apr_thread_mutex_lock(gconf->hdr_mutex);
+    thread = apr_pcalloc(gconf->hdr_pool, sizeof(*thread));
+    thread->labels = apr_hash_make(gconf->hdr_pool);
+    thread->transactions = apr_hash_make(gconf->hdr_pool);
+    thread->log_ids = apr_hash_make(gconf->hdr_pool);
+    APR_ARRAY_PUSH(gconf->threads, perf_thread_t *) = thread;
+    apr_thread_mutex_unlock(gconf->hdr_mutex);
+    apr_threadkey_private_set(thread, gconf->hdr_key);
+  }
+  return thread;
+}
+
+/**
+ * Get latency histograms of the calling thread
+ * @param gconf IN global config
+ * @return histograms
+ */
+static perf_hdr_t *perf_get_thread_hdr(perf_gconf_t *gconf) {
+  return &perf_get_thread(gconf)->hdr;
+}
+
+/**
+ * Get a label from a hash, add it if new. Lookups need no lock as only the
+ * owning thread adds to its hash, adding is done under the mutex because 
+ * all hashes live in one pool
+ * @param gconf IN global config
+ * @param labels IN hash of labels
+ * @param name IN label name
+ * @param transaction IN 1 if a transaction
+ * @return label
+ */
+static perf_label_t *perf_get_label(perf_gconf_t *gconf, apr_hash_t *labels,
+                                    const char *name, int transaction) {
+  perf_label_t *label = apr_hash_get(labels, name, APR_HASH_KEY_STRING);
+
+  if (!label) {
+    apr_thread_mutex_lock(gconf->hdr_mutex);
+    if (apr_hash_count(labels) >= PERF_LABELS_MAX && 
+        (label = apr_hash_get(labels, "other", APR_HASH_KEY_STRING))) {
+      apr_thread_mutex_unlock(gconf->hdr_mutex);
+      return label;
+    }
+    if (apr_hash_count(labels) >= PERF_LABELS_MAX) {
+      name = "other";
+    }
+    label = apr_pcalloc(gconf->hdr_pool, sizeof(*label));
+    apr_cpystrn(label->name, name, sizeof(label->name));
+    label->transaction = transaction;
+    apr_hash_set(labels, label->name, APR_HASH_KEY_STRING, label);
+    apr_thread_mutex_unlock(gconf->hdr_mutex);
+  }
+  return label;
+}
+
+/**
+ * Add stat of a label
+ * @param total IN label to add to
+ * @param label IN label to add
+ */
+static void perf_label_add(perf_label_t *total, perf_label_t *label) {
+  int i;
+
+  total->reqs += label->reqs;
+  total->errors += label->errors;
+  for (i = 0; i < 600; i++) {
+    total->status[i] += label->status[i];
+  }
+  hdr_add(&total->hdr, &label->hdr);
+}
+
+/**
+ * Add a label to the totals, call with hdr_mutex held. Like the labels of a
+ * thread the totals hold at most PERF_LABELS_MAX names and "other"
+ * @param gconf IN global config
+ * @param label IN label to add
+ */
+static void perf_label_collect(perf_gconf_t *gconf, perf_label_t *label) {
+  apr_hash_t *labels = label->transaction ? gconf->transactions 
+                                          : gconf->labels;
+  const char *name = label->name;
+  perf_label_t *total = apr_hash_get(labels, name, APR_HASH_KEY_STRING);
+
+  if (!total && apr_hash_count(labels) >= PERF_LABELS_MAX) {
+    name = "other";
+    total = apr_hash_get(labels, name, APR_HASH_KEY_STRING);
+  }
+  if (!total) {
+    total = apr_pcalloc(gconf->hdr_pool, sizeof(*total));
+    apr_cpystrn(total->name, name, sizeof(total->name));
+    total->transaction = label->transaction;
+    apr_hash_set(labels, total->name, APR_HASH_KEY_STRING, total);
+  }
+  perf_label_add(total, label);
+}
+
+/**
+ * Fit a name into PERF_LABEL_NAME bytes, a longer name is cut and ends with
+ * a hash of the whole name, so cut names do not collide
+ * @param buf IN buffer of PERF_LABEL_NAME bytes
+ * @param name IN name, need not be null terminated
+ * @param len IN length of name
+ * @return buf
+ */
+static const char *perf_label_fit(char *buf, const char *name, 
+                                  apr_size_t len) {
+  if (len < PERF_LABEL_NAME) {
+    memcpy(buf, name, len);
+    buf[len] = 0;
+  }
+  else {
+    apr_ssize_t klen = len;
+    unsigned int hash = apr_hashfunc_default(name, &klen);
+
+    memcpy(buf, name, PERF_LABEL_NAME - 10);
+    apr_snprintf(buf + PERF_LABEL_NAME - 10, 10, "~%08x", hash);
+  }
+  return buf;
+}
+
+/**
+ * Get the name of the current request label
+ * @param worker IN callee
+ * @param gconf IN global config
+ * @param wconf IN worker config
+ * @param buf IN buffer of PERF_LABEL_NAME bytes
+ * @return label name or NULL if not labeled
+ */
+static const char *perf_request_label(worker_t *worker, perf_gconf_t *gconf,
+                                      perf_wconf_t *wconf, char *buf) {
+  if (wconf->label[0]) {
+    return wconf->label;
+  }
+  if (gconf->label_by == PERF_LABEL_URL && wconf->request_line) {
+    /* path of the request line without query */
+    const char *path = strchr(wconf->request_line, ' ');
+    apr_size_t len;
+
+    path = path ? path + 1 : wconf->request_line;
+    len = strcspn(path, " ?");
+    if (len) {
+      return perf_label_fit(buf, path, len);
+    }
+  }
+  else if (gconf->label_by == PERF_LABEL_BLOCK) {
+    const char *name = worker->block && worker->block->name 
+                     ? worker->block->name : worker->name;
+    return perf_label_fit(buf, name, strlen(name));
+  }
+  return NULL;
+}
+
+/**
+ * Add latency histograms
+ * @param total IN histograms to add to
+ * @param hdr IN histograms to add
+ */
+static void perf_hdr_add(perf_hdr_t *total, perf_hdr_t *hdr) {
+  hdr_add(&total->conn, &hdr->conn);
+  hdr_add(&total->sent, &hdr->sent);
+  hdr_add(&total->recv, &hdr->recv);
+  hdr_add(&total->total, &hdr->total);
+  hdr_add(&total->dns, &hdr->dns);
+  hdr_add(&total->tcp, &hdr->tcp);
+  hdr_add(&total->tls, &hdr->tls);
+  hdr_add(&total->ttfb, &hdr->ttfb);
+  hdr_add(&total->transfer, &hdr->transfer);
+}
+
+/**
+ * Move histograms of all threads to the total, call if no client runs
+ * @param gconf IN global config
+ */
+static void perf_hdr_collect(perf_gconf_t *gconf) {
+  int i;
+
+  apr_thread_mutex_lock(gconf->hdr_mutex);
+  for (i = 0; i < gconf->threads->nelts; i++) {
+    perf_thread_t *thread = APR_ARRAY_IDX(gconf->threads, i, perf_thread_t *);
+    apr_hash_t *hashs[2];
+    int j;
+
+    perf_hdr_add(&gconf->hdr, &thread->hdr);
+    memset(&thread->hdr, 0, sizeof(thread->hdr));
+    hashs[0] = thread->labels;
+    hashs[1] = thread->transactions;
+    for (j = 0; j < 2; j++) {
+      apr_hash_index_t *hi;
+      for (hi = apr_hash_first(NULL, hashs[j]); hi; hi = apr_hash_next(hi)) {
+        perf_label_t *label;
+        apr_hash_this(hi, NULL, NULL, (void **)&label);
+        perf_label_collect(gconf, label);
+        label->reqs = label->errors = 0;
+        memset(label->status, 0, sizeof(label->status));
+        hdr_reset(&label->hdr);
+      }
+    }
+  }
+  apr_thread_mutex_unlock(gconf->hdr_mutex);
+}
+
+/**
+ * Compare label names for qsort
+ * @param a IN pointer to label pointer
+ * @param b IN pointer to label pointer
+ * @return strcmp of names
+ */
+static int perf_label_cmp(const void *a, const void *b) {
+  return strcmp((*(perf_label_t **)a)->name, (*(perf_label_t **)b)->name);
+}
+
+/**
+ * Get labels sorted by name
+ * @param pool IN pool to alloc array
+ * @param labels IN hash of labels
+ * @return array of perf_label_t pointers
+ */
+static apr_array_header_t *perf_label_sort(apr_pool_t *pool, 
+                                           apr_hash_t *labels) {
+  apr_array_header_t *sorted = apr_array_make(pool, apr_hash_count(labels) + 1,
+                                              sizeof(perf_label_t *));
+  apr_hash_index_t *hi;
+
+  for (hi = apr_hash_first(NULL, labels); hi; hi = apr_hash_next(hi)) {
+    void *val;
+    apr_hash_this(hi, NULL, NULL, &val);
+    APR_ARRAY_PUSH(sorted, perf_label_t *) = val;
+  }
+  qsort(sorted->elts, sorted->nelts, sizeof(perf_label_t *), perf_label_cmp);
+  return sorted;
+}
+
+/**
+ * Print percentiles of a histogram
+ * @param name IN name of histogram
+ * @param hdr IN histogram
+ */
+static void perf_hdr_print(const char *name, hdr_t *hdr) {
+  fprintf(stdout, "%s p50: %"APR_INT64_T_FMT" p90: %"APR_INT64_T_FMT
+          " p99: %"APR_INT64_T_FMT" p99.9: %"APR_INT64_T_FMT
+          " max: %"APR_INT64_T_FMT"\n", name, hdr_percentile(hdr, 50), 
+          hdr_percentile(hdr, 90), hdr_percentile(hdr, 99), 
+          hdr_percentile(hdr, 99.9), hdr->max);
+}
+
+/**
+ * Print and export stat of labels
+ * @param gconf IN global config
+ * @param labels IN hash of labels
+ * @param prefix IN "label" or "transaction"
+ */
+static void perf_label_print(perf_gconf_t *gconf, apr_hash_t *labels, 
+                             const char *prefix) {
+  apr_pool_t *pool;
+  apr_array_header_t *sorted;
+  int i;
+  int j;
+
+  HT_POOL_CREATE(&pool);
+  sorted = perf_label_sort(pool, labels);
+  for (i = 0; i < sorted->nelts; i++) {
+    perf_label_t *label = APR_ARRAY_IDX(sorted, i, perf_label_t *);
+    char *name = apr_pstrcat(pool, prefix, ":", label->name, NULL);
+
+    fprintf(stdout, "%s reqs: %d errors: %d", name, label->reqs, 
+            label->errors);
+    for (j = 0; j < 600; j++) {
+      if (label->status[j]) {
+        fprintf(stdout, " %d: %d", j, label->status[j]);
+      }
+    }
+    fprintf(stdout, "\n");
+    perf_hdr_print(name, &label->hdr);
+    if (gconf->hdr_file) {
+      hdr_write(&label->hdr, name, gconf->hdr_file);
+    }
+  }
+  apr_pool_destroy(pool);
+}
+
+/**
+ * Get live counters of a client
+ * @param worker IN worker
+ * @param gconf IN global config
+ * @param wconf IN worker config
+ * @return live counters or NULL if PERF:STAT LIVE is off
+ */
+static perf_counter_t *perf_get_live(worker_t *worker, perf_gconf_t *gconf,
+                                     perf_wconf_t *wconf) {
+  perf_live_t *live = &gconf->live;
+  apr_uint32_t i;
+
+  if (!(gconf->on & PERF_GCONF_LIVE) || !(worker->flags & FLAGS_CLIENT)) {
+    return NULL;
+  }
+  if (wconf->live) {
+    return wconf->live;
+  }
+
+  apr_thread_mutex_lock(live->mutex);
+  i = live->slots;
+  if (i < PERF_LIVE_SLOTS * PERF_LIVE_CHUNKS) {
+    perf_slot_t **chunk = &live->chunks[i / PERF_LIVE_SLOTS];
+    if (!*chunk) {
+      apr_size_t size = PERF_LIVE_SLOTS * sizeof(perf_slot_t);
+      char *mem = apr_palloc(live->pool, size + PERF_CACHE_LINE);
+      *chunk = (perf_slot_t *)APR_ALIGN((apr_uintptr_t)mem, PERF_CACHE_LINE);
+      memset(*chunk, 0, size);
+    }
+    wconf->live = &(*chunk)[i % PERF_LIVE_SLOTS].c;
+    /* reporter reads slots below this only */
+    apr_atomic_set32(&live->slots, i + 1);
+  }
+  else {
+    wconf->live = &live->overflow.c;
+  }
+  apr_thread_mutex_unlock(live->mutex);
+  return wconf->live;
+}
+
+/**
+ * Get latency bucket, 4 buckets per power of two
+ * @param t IN latency in us
+ * @return bucket index
+ */
+static int perf_live_bucket(apr_time_t t) {
+  int msb = 2;
+
+  if (t < 4) {
+    return t < 0 ? 0 : (int)t;
+  }
+  while (msb < 32 && t >> (msb + 1)) {
+    ++msb;
+  }
+  if (t >> (msb + 1)) {
+    return PERF_LIVE_BUCKETS - 1;
+  }
+  return 4 * (msb - 1) + ((t >> (msb - 2)) & 3);
+}
+
+/**
+ * Get upper bound of a latency bucket
+ * @param bucket IN bucket index
+ * @return highest latency in us of this bucket
+ */
+static apr_time_t perf_live_bucket_max(int bucket) {
+  int msb = bucket / 4 + 1;
+  int sub = bucket % 4;
+
+  if (bucket < 4) {
+    return bucket;
+  }
+  return ((apr_time_t)(4 + sub + 1) << (msb - 2)) - 1;
+}
+
+/**
+ * Add live counters
+ * @param sum IN sum to add to
+ * @param c IN counters to add
+ */
+static void perf_live_add(perf_counter_t *sum, perf_counter_t *c) {
+  int j;
+
+  sum->reqs += apr_atomic_read32(&c->reqs);
+  sum->errors += apr_atomic_read32(&c->errors);
+  sum->sent_bytes += apr_atomic_read32(&c->sent_bytes);
+  sum->recv_bytes += apr_atomic_read32(&c->recv_bytes);
+  for (j = 0; j < PERF_LIVE_BUCKETS; j++) {
+    sum->latency[j] += apr_atomic_read32(&c->latency[j]);
+  }
+}
+
+/**
+ * Add live counters of all slots, in the parent of client processes also
+ * the counters they published
+ * @param gconf IN global config
+ * @param sum OUT sum of all counters
+ */
+static void perf_live_sum(perf_gconf_t *gconf, perf_counter_t *sum) {
+  perf_live_t *live = &gconf->live;
+  apr_uint32_t slots = apr_atomic_read32(&live->slots);
+  apr_uint32_t i;
+  int j;
+
+  memset(sum, 0, sizeof(*sum));
+  for (i = 0; i <= slots; i++) {
+    perf_live_add(sum, i < slots 
+                       ? &live->chunks[i / PERF_LIVE_SLOTS][i % PERF_LIVE_SLOTS].c
+                       : &live->overflow.c);
+  }
+  if (gconf->shared && !live->publish) {
+    for (j = 0; j < gconf->processes; j++) {
+      perf_shared_t *shared = (perf_shared_t *)
+                              (gconf->shared + j * gconf->shared_size);
+      perf_live_add(sum, &shared->live);
+    }
+  }
+}
+
+/**
+ * Publish live counters of a client process to its parent
+ * @param gconf IN global config
+ */
+static void perf_live_publish(perf_gconf_t *gconf) {
+  perf_counter_t *publish = gconf->live.publish;
+  perf_counter_t cur;
+  int j;
+
+  perf_live_sum(gconf, &cur);
+  apr_atomic_set32(&publish->reqs, cur.reqs);
+  apr_atomic_set32(&publish->errors, cur.errors);
+  apr_atomic_set32(&publish->sent_bytes, cur.sent_bytes);
+  apr_atomic_set32(&publish->recv_bytes, cur.recv_bytes);
+  for (j = 0; j < PERF_LIVE_BUCKETS; j++) {
+    apr_atomic_set32(&publish->latency[j], cur.latency[j]);
+  }
+}
+
+/**
+ * Get latency percentile of an interval
+ * @param cur IN counters at end of interval
+ * @param last IN counters at begin of interval
+ * @param percent IN percentile
+ * @return latency in us
+ */
+static apr_time_t perf_live_percentile(perf_counter_t *cur, 
+                                       perf_counter_t *last, int percent) {
+  apr_uint64_t total = 0;
+  apr_uint64_t count = 0;
+  int i;
+
+  for (i = 0; i < PERF_LIVE_BUCKETS; i++) {
+    total += cur->latency[i] - last->latency[i];
+  }
+  if (!total) {
+    return 0;
+  }
+  for (i = 0; i < PERF_LIVE_BUCKETS; i++) {
+    count += cur->latency[i] - last->latency[i];
+    if (count * 100 >= total * percent) {
+      break;
+    }
+  }
+  return perf_live_bucket_max(i < PERF_LIVE_BUCKETS ? i : PERF_LIVE_BUCKETS - 1);
+}
+
+/**
+ * Live reporter, prints rate, throughput, errors and latency every interval.
+ * In a client process it only publishes the counters, the parent reports.
+ * @param thread IN thread
+ * @param data IN global config
+ * @return NULL
+ */
+static void * APR_THREAD_FUNC perf_live_thread(apr_thread_t *thread, 
+                                               void *data) {
+  perf_gconf_t *gconf = data;
+  perf_live_t *live = &gconf->live;
+  perf_counter_t cur;
+  perf_counter_t last;
+  apr_time_t start = apr_time_now();
+  apr_time_t prev = start;
+
+  perf_live_sum(gconf, &last);
+  while (!apr_atomic_read32(&live->stop)) {
+    apr_time_t now = apr_time_now();
+    double seconds;
+
+    if (live->publish) {
+      perf_live_publish(gconf);
+      apr_sleep(apr_time_from_msec(100));
+      continue;
+    }
+    if (now - prev < live->interval) {
+      apr_time_t left = live->interval - (now - prev);
+      apr_sleep(left < apr_time_from_msec(100) ? left 
+                                               : apr_time_from_msec(100));
+      continue;
+    }
+    perf_live_sum(gconf, &cur);
+    seconds = (double)(now - prev) / APR_USEC_PER_SEC;
+    fprintf(stdout, "live %.1fs rps: %.1f sent kB/s: %.1f recv kB/s: %.1f "
+            "errors: %u p50: %"APR_TIME_T_FMT" p90: %"APR_TIME_T_FMT
+            " p99: %"APR_TIME_T_FMT" us\n", 
+            (double)(now - start) / APR_USEC_PER_SEC,
+            (apr_uint32_t)(cur.reqs - last.reqs) / seconds,
+            (apr_uint32_t)(cur.sent_bytes - last.sent_bytes) / seconds / 1024,
+            (apr_uint32_t)(cur.recv_bytes - last.recv_bytes) / seconds / 1024,
+            (apr_uint32_t)(cur.errors - last.errors),
+            perf_live_percentile(&cur, &last, 50),
+            perf_live_percentile(&cur, &last, 90),
+            perf_live_percentile(&cur, &last, 99));
+    fflush(stdout);
+    last = cur;
+    prev = now;
+  }
+  if (live->publish) {
+    perf_live_publish(gconf);
+  }
+  apr_thread_exit(thread, APR_SUCCESS);
+  return NULL;
+}
+
+/**
+ * Stop live reporter
+ * @param gconf IN global config
+ */
+static void perf_live_stop(perf_gconf_t *gconf) {
+  if (gconf->live.thread) {
+    apr_status_t retstat;
+    apr_atomic_set32(&gconf->live.stop, 1);
+    apr_thread_join(&retstat, gconf->live.thread);
+    gconf->live.thread = NULL;
+    apr_atomic_set32(&gconf->live.stop, 0);
+  }
+}
+
+/**
+ * Get label id for the binary log, a new id gets the next number
+ * @param gconf IN global config
+ * @param thread IN stat of calling thread
+ * @param name IN label name
+ * @return label id
+ */
+static apr_uint32_t perf_log_label_id(perf_gconf_t *gconf, 
+                                      perf_thread_t *thread, 
+                                      const char *name) {
+  void *id = apr_hash_get(thread->log_ids, name, APR_HASH_KEY_STRING);
+
+  if (!id) {
+    perf_log_t *log = &gconf->log;
+    apr_thread_mutex_lock(gconf->hdr_mutex);
+    if (!(id = apr_hash_get(log->ids, name, APR_HASH_KEY_STRING))) {
+      char *copy = apr_pstrdup(gconf->hdr_pool, name);
+      APR_ARRAY_PUSH(log->names, char *) = copy;
+      id = (void *)(apr_uintptr_t)log->names->nelts;
+      apr_hash_set(log->ids, copy, APR_HASH_KEY_STRING, id);
+    }
+    apr_hash_set(thread->log_ids, 
+                 APR_ARRAY_IDX(log->names, (apr_uintptr_t)id - 1, char *), 
+                 APR_HASH_KEY_STRING, id);
+    apr_thread_mutex_unlock(gconf->hdr_mutex);
+  }
+  return (apr_uint32_t)(apr_uintptr_t)id;
+}
+
+/**
+ * Hand a finished request to the log writer, if the ring of this thread is
+ * full wait up to 10 ms for the writer, then the record is dropped and 
+ * counted, see perf_log_stop. Only the calling user waits, other users of
+ * this thread go on.
+ * @param worker IN callee
+ * @param gconf IN global config
+ * @param wconf IN worker config
+ * @param status IN status of _WAIT
+ */
+static void perf_log_request(worker_t *worker, perf_gconf_t *gconf,
+                             perf_wconf_t *wconf, apr_status_t status) {
+  perf_thread_t *thread = perf_get_thread(gconf);
+  perf_log_slot_t *slot;
+  perf_record_t *record;
+  int i;
+
+  if (!thread->log) {
+    apr_thread_mutex_lock(gconf->hdr_mutex);
+    thread->log = ring_new(gconf->hdr_pool, PERF_LOG_RING, 
+                           sizeof(perf_log_slot_t));
+    apr_thread_mutex_unlock(gconf->hdr_mutex);
+  }
+  for (i = 0; i < PERF_LOG_WAITS && ring_full(thread->log); i++) {
+    engine_sleep(100);
+  }
+  if (!(slot = ring_reserve(thread->log))) {
+    return;
+  }
+  record = &slot->record;
+  memset(record, 0, sizeof(*record));
+  record->time = apr_time_now();
+  record->type = PERF_RECORD_REQUEST;
+  record->process = worker->global->process + 1;
+  record->status = wconf->cur_status;
+  record->failed = status != APR_SUCCESS;
+  record->dns = wconf->dns_time;
+  record->tcp = wconf->tcp_time;
+  record->tls = wconf->tls_time;
+  record->sent = wconf->stat.sent_time.cur;
+  record->ttfb = wconf->ttfb_time;
+  record->transfer = wconf->transfer_time;
+  record->recv = wconf->stat.recv_time.cur;
+  record->sent_bytes = wconf->stat.sent_bytes - wconf->sent_mark;
+  record->recv_bytes = wconf->stat.recv_bytes - wconf->recv_mark;
+  if (gconf->log.binary) {
+    char buf[PERF_LABEL_NAME];
+    const char *name = perf_request_label(worker, gconf, wconf, buf);
+    if (name) {
+      record->label = perf_log_label_id(gconf, thread, name);
+    }
+  }
+  else {
+    apr_cpystrn(slot->line, wconf->request_line ? wconf->request_line : "",
+                sizeof(slot->line));
+  }
+  ring_commit(thread->log);
+}
+
+/**
+ * Write buffered records
+ * @param gconf IN global config
+ */
+static void perf_log_flush(perf_gconf_t *gconf) {
+  perf_log_t *log = &gconf->log;
+
+  if (log->len) {
+    /* one write of whole records, client processes share the file */
+    apr_file_write_full(gconf->log_file, log->buf, log->len, NULL);
+    log->len = 0;
+  }
+}
+
+/**
+ * Buffer data for the log file
+ * @param gconf IN global config
+ * @param data IN data
+ * @param len IN length of data, at most PERF_LOG_BUF
+ */
+static void perf_log_put(perf_gconf_t *gconf, const void *data, 
+                         apr_size_t len) {
+  perf_log_t *log = &gconf->log;
+
+  if (log->len + len > PERF_LOG_BUF) {
+    perf_log_flush(gconf);
+  }
+  memcpy(log->buf + log->len, data, len);
+  log->len += len;
+}
+
+/**
+ * Write a record as text line or binary with the labels it needs
+ * @param gconf IN global config
+ * @param slot IN record
+ */
+static void perf_log_format(perf_gconf_t *gconf, perf_log_slot_t *slot) {
+  perf_log_t *log = &gconf->log;
+  perf_record_t *record = &slot->record;
+
+  if (log->binary) {
+    /* ids are given out in order, the names exist before the records */
+    while (log->written < (int)record->label) {
+      perf_log_label_t def;
+
+      memset(&def, 0, sizeof(def));
+      def.record.time = record->time;
+      def.record.type = PERF_RECORD_LABEL;
+      def.record.process = log->process;
+      def.record.label = ++log->written;
+      /* names may grow meanwhile */
+      apr_thread_mutex_lock(gconf->hdr_mutex);
+      apr_cpystrn(def.name, 
+                  APR_ARRAY_IDX(log->names, def.record.label - 1, char *), 
+                  sizeof(def.name));
+      apr_thread_mutex_unlock(gconf->hdr_mutex);
+      /* in one piece, a flush must not split it */
+      perf_log_put(gconf, &def, sizeof(def.record) + sizeof(def.name));
+    }
+    perf_log_put(gconf, record, sizeof(*record));
+  }
+  else {
+    char date_str[APR_RFC822_DATE_LEN];
+    char line[PERF_LOG_LINE + 100];
+    apr_size_t len;
+
+    apr_rfc822_date(date_str, record->time);
+    len = apr_snprintf(line, sizeof(line), 
+                       "[%s] \"%s\" %d %s %u %u\n", date_str, slot->line, 
+                       record->status, record->failed ? "FAILED" : "OK", 
+                       record->sent, record->recv);
+    perf_log_put(gconf, line, len);
+  }
+}
+
+/**
+ * Move records of all threads to the log file
+ * @param gconf IN global config
+ * @return number of records
+ */
+static int perf_log_drain(perf_gconf_t *gconf) {
+  apr_array_header_t *rings = gconf->log.rings;
+  int count = 0;
+  int i;
+
+  /* formatting needs no lock, rings added meanwhile come next time */
+  apr_thread_mutex_lock(gconf->hdr_mutex);
+  apr_array_clear(rings);
+  for (i = 0; i < gconf->threads->nelts; i++) {
+    perf_thread_t *thread = APR_ARRAY_IDX(gconf->threads, i, perf_thread_t *);
+    if (thread->log) {
+      APR_ARRAY_PUSH(rings, ring_t *) = thread->log;
+    }
+  }
+  apr_thread_mutex_unlock(gconf->hdr_mutex);
+  for (i = 0; i < rings->nelts; i++) {
+    ring_t *ring = APR_ARRAY_IDX(rings, i, ring_t *);
+    perf_log_slot_t *slot;
+
+    while ((slot = ring_peek(ring))) {
+      perf_log_format(gconf, slot);
+      ring_release(ring);
+      ++count;
+    }
+  }
+  perf_log_flush(gconf);
+  return count;
+}
+
+/**
+ * Log writer, the only one writing the log file while clients run
+ * @param thread IN thread
+ * @param data IN global config
+ * @return NULL
+ */
+static void * APR_THREAD_FUNC perf_log_thread(apr_thread_t *thread, 
+                                              void *data) {
+  perf_gconf_t *gconf = data;
+  perf_log_t *log = &gconf->log;
+
+  if (log->binary) {
+    perf_record_t start;
+
+    memset(&start, 0, sizeof(start));
+    start.time = apr_time_now();
+    start.type = PERF_RECORD_START;
+    start.process = log->process;
+    start.label = PERF_RECORD_VERSION;
+    perf_log_put(gconf, &start, sizeof(start));
+  }
+  while (!apr_atomic_read32(&log->stop)) {
+    if (!perf_log_drain(gconf)) {
+      apr_sleep(apr_time_from_msec(10));
+    }
+  }
+  perf_log_drain(gconf);
+  apr_thread_exit(thread, APR_SUCCESS);
+  return NULL;
+}
+
+/**
+ * Stop log writer after it wrote all records
+ * @param gconf IN global config
+ */
+static void perf_log_stop(perf_gconf_t *gconf) {
+  if (gconf->log.thread) {
+    apr_status_t retstat;
+    apr_uint32_t dropped = 0;
+    int i;
+
+    apr_atomic_set32(&gconf->log.stop, 1);
+    apr_thread_join(&retstat, gconf->log.thread);
+    gconf->log.thread = NULL;
+    apr_atomic_set32(&gconf->log.stop, 0);
+    for (i = 0; i < gconf->threads->nelts; i++) {
+      perf_thread_t *thread = APR_ARRAY_IDX(gconf->threads, i, perf_thread_t *);
+      if (thread->log) {
+        dropped += ring_get_dropped(thread->log);
+      }
+    }
+    if (dropped) {
+      fprintf(stdout, "PERF:STAT LOG dropped %u records\n", dropped);
+    }
+  }
+}
+
+/**
+ * Is called before a line is handed to the socket, stamps the start of a
+ * request before the batch with its first line is sent
+ * @param worker IN callee
+ * @param line IN line to send
+ * @return APR_SUCCESS
+ */
+static apr_status_t perf_line_flush(worker_t *worker, line_t *line) {
+  perf_wconf_t *wconf = perf_get_worker_config(worker);
+  perf_gconf_t *gconf = perf_get_global_config(worker->global);
+
+  if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT &&
+      wconf->WAIT_time == 0 && wconf->flush_time == 0) {
+    wconf->flush_time = apr_time_now();
+  }
+  return APR_SUCCESS;
+}
+
 /**
  * Is called after line is sent
  * @param worker IN callee
@@ -162,16 +1202,36 @@ static apr_status_t perf_line_sent(worker_t *worker, line_t *line) {
   global_t *global = worker->global;
   perf_wconf_t *wconf = perf_get_worker_config(worker);
   perf_gconf_t *gconf = perf_get_global_config(global);
+  perf_counter_t *live;
+  apr_size_t len;
 
   if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
     if (wconf->WAIT_time == 0) {
       ++wconf->stat.count.reqs;
-      wconf->WAIT_time = apr_time_now();
+      /* open loop _RPS, measure from the scheduled start, else from the
+       * first line flushed, lines go out in batches */
+      if (worker->sched_start) {
+        wconf->WAIT_time = worker->sched_start;
+      }
+      else {
+        wconf->WAIT_time = wconf->flush_time ? wconf->flush_time 
+                                             : apr_time_now();
+      }
+      worker->sched_start = 0;
+      wconf->flush_time = 0;
       wconf->request_line = line->buf;
+      wconf->cur_status = 0;
+      wconf->phase[PHASE_FIRST_BYTE] = 0;
+      wconf->sent_mark = wconf->stat.sent_bytes;
+      wconf->recv_mark = wconf->stat.recv_bytes;
+    }
+    len = line->len;
+    if (strncasecmp(line->info, "NOCRLF", 6) != 0) {
+      len += 2;
     }
-    wconf->stat.sent_bytes += line->len;
-    if (strncmp(line->info, "NOCRLF", 6) != 0) {
-      wconf->stat.sent_bytes += 2;
+    wconf->stat.sent_bytes += len;
+    if ((live = perf_get_live(worker, gconf, wconf))) {
+      apr_atomic_add32(&live->sent_bytes, len);
     }
   }
   return APR_SUCCESS;
@@ -200,6 +1260,7 @@ static apr_status_t perf_WAIT_begin(worker_t *worker) {
     if (duration < wconf->stat.sent_time.min || wconf->stat.sent_time.min == 0) {
       wconf->stat.sent_time.min = duration;
     }
+    hdr_record(&perf_get_thread_hdr(gconf)->sent, duration);
   }
   return APR_SUCCESS;
 }
@@ -217,7 +1278,11 @@ static apr_status_t perf_read_status_line(worker_t *worker, char *line) {
 
   if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
     char *cur;
+    perf_counter_t *live;
     wconf->stat.recv_bytes += strlen(line) + 2;
+    if ((live = perf_get_live(worker, gconf, wconf))) {
+      apr_atomic_add32(&live->recv_bytes, strlen(line) + 2);
+    }
     if ((cur = strstr(line, " "))) {
       int status;
       ++cur;
@@ -242,7 +1307,11 @@ static apr_status_t perf_read_header(worker_t *worker, char *line) {
   perf_gconf_t *gconf = perf_get_global_config(global);
 
   if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
+    perf_counter_t *live;
     wconf->stat.recv_bytes += strlen(line) + 2;
+    if ((live = perf_get_live(worker, gconf, wconf))) {
+      apr_atomic_add32(&live->recv_bytes, strlen(line) + 2);
+    }
   }   
   return APR_SUCCESS;
 }
@@ -259,7 +1328,13 @@ static apr_status_t perf_read_buf(worker_t *worker, char *buf, apr_size_t len) {
   perf_gconf_t *gconf = perf_get_global_config(global);
 
   if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
-    wconf->stat.recv_bytes += len + 2;
+    perf_counter_t *live;
+    /* streamed bodies come in several bufs, the empty line is counted at
+     * PHASE_BODY_END */
+    wconf->stat.recv_bytes += len;
+    if ((live = perf_get_live(worker, gconf, wconf))) {
+      apr_atomic_add32(&live->recv_bytes, len);
+    }
   }   
   return APR_SUCCESS;
 }
@@ -275,9 +1350,14 @@ static apr_status_t perf_WAIT_end(worker_t *worker, apr_status_t status) {
   perf_wconf_t *wconf = perf_get_worker_config(worker);
   perf_gconf_t *gconf = perf_get_global_config(global);
 
+  if (gconf->profile.stages && worker->flags & FLAGS_CLIENT) {
+    apr_atomic_inc32(&gconf->profile.reqs);
+  }
   if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
     int i;
     apr_time_t compare;
+    perf_counter_t *live;
+    perf_hdr_t *hdr;
     apr_time_t now = apr_time_now();
     apr_time_t duration = now - wconf->WAIT_time;
     wconf->WAIT_time = 0;
@@ -289,6 +1369,9 @@ static apr_status_t perf_WAIT_end(worker_t *worker, apr_status_t status) {
     if (duration < wconf->stat.recv_time.min || wconf->stat.recv_time.min == 0) {
       wconf->stat.recv_time.min = duration;
     }
+    hdr = perf_get_thread_hdr(gconf);
+    hdr_record(&hdr->recv, duration);
+    hdr_record(&hdr->total, wconf->stat.sent_time.cur + duration);
     for (i = 0, compare = 1; i < 10; i++, compare *= 2) {
       apr_time_t t = apr_time_sec(wconf->stat.sent_time.cur + wconf->stat.recv_time.cur);
       if (t < compare) {
@@ -296,111 +1379,349 @@ static apr_status_t perf_WAIT_end(worker_t *worker, apr_status_t status) {
         break;
       }
     }
+    if ((live = perf_get_live(worker, gconf, wconf))) {
+      apr_time_t latency = wconf->stat.sent_time.cur + wconf->stat.recv_time.cur;
+      apr_atomic_inc32(&live->reqs);
+      if (status != APR_SUCCESS || wconf->cur_status >= 400) {
+        apr_atomic_inc32(&live->errors);
+      }
+      apr_atomic_inc32(&live->latency[perf_live_bucket(latency)]);
+    }
+    if (gconf->label_by != PERF_LABEL_OFF) {
+      char buf[PERF_LABEL_NAME];
+      const char *name = perf_request_label(worker, gconf, wconf, buf);
+      int error = status != APR_SUCCESS || wconf->cur_status >= 400;
+
+      if (name) {
+        perf_label_t *label = perf_get_label(gconf, 
+                                             perf_get_thread(gconf)->labels,
+                                             name, 0);
+        ++label->reqs;
+        label->errors += error;
+        if (wconf->cur_status > 0 && wconf->cur_status < 600) {
+          ++label->status[wconf->cur_status];
+        }
+        hdr_record(&label->hdr, wconf->stat.sent_time.cur + duration);
+      }
+      wconf->transaction_errors += error;
+    }
+  }
+  if (gconf->on & PERF_GCONF_LOG && worker->flags & FLAGS_CLIENT) {
+    perf_log_request(worker, gconf, wconf, status);
+  }
+  wconf->dns_time = 0;
+  wconf->tcp_time = 0;
+  wconf->tls_time = 0;
+  wconf->ttfb_time = 0;
+  wconf->transfer_time = 0;
+  wconf->phase[PHASE_FIRST_BYTE] = 0;
+  wconf->flush_time = 0;
+  return status;
+}
+
+/**
+ * Start connect timer
+ * @param worker IN callee
+ * @param line IN received status line
+ * @return APR_SUCCESS
+ */
+static apr_status_t perf_pre_connect(worker_t *worker) {
+  global_t *global = worker->global;
+  perf_wconf_t *wconf = perf_get_worker_config(worker);
+  perf_gconf_t *gconf = perf_get_global_config(global);
+
+  if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
+    wconf->stat.conn_time.cur = apr_time_now();
+    ++wconf->stat.count.conns;
+  }
+  return APR_SUCCESS;
+}
+
+/**
+ * Stop connect timer and measure connection time
+ * @param worker IN callee
+ * @param line IN received status line
+ * @return APR_SUCCESS
+ */
+static apr_status_t perf_post_connect(worker_t *worker) {
+  global_t *global = worker->global;
+  perf_wconf_t *wconf = perf_get_worker_config(worker);
+  perf_gconf_t *gconf = perf_get_global_config(global);
+
+  if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
+    apr_time_t duration = apr_time_now() - wconf->stat.conn_time.cur;
+    wconf->stat.conn_time.cur = duration;
+    wconf->stat.conn_time.total += duration;
+    if (duration > wconf->stat.conn_time.max) {
+      wconf->stat.conn_time.max = duration;
+    }
+    if (duration < wconf->stat.conn_time.min || wconf->stat.conn_time.min == 0) {
+      wconf->stat.conn_time.min = duration;
+    }
+    hdr_record(&perf_get_thread_hdr(gconf)->conn, duration);
+
+  }
+  return APR_SUCCESS;
+}
+
+/**
+ * Time the phases of a request, an end phase records the time since its
+ * begin phase, first byte the time since the request was sent and body end
+ * the time since the first byte
+ * @param worker IN callee
+ * @param phase IN PHASE_XXX
+ * @return APR_SUCCESS
+ */
+static apr_status_t perf_phase(worker_t *worker, int phase) {
+  global_t *global = worker->global;
+  perf_wconf_t *wconf = perf_get_worker_config(worker);
+  perf_gconf_t *gconf = perf_get_global_config(global);
+
+  if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
+    perf_hdr_t *hdr;
+    perf_counter_t *live;
+    apr_time_t now = apr_time_now();
+
+    wconf->phase[phase] = now;
+    if (phase == PHASE_DNS_BEGIN || phase == PHASE_CONNECT_BEGIN || 
+        phase == PHASE_TLS_BEGIN) {
+      return APR_SUCCESS;
+    }
+    hdr = perf_get_thread_hdr(gconf);
+    switch (phase) {
+    case PHASE_DNS_END:
+      wconf->dns_time = now - wconf->phase[PHASE_DNS_BEGIN];
+      hdr_record(&hdr->dns, wconf->dns_time);
+      break;
+    case PHASE_CONNECT_END:
+      wconf->tcp_time = now - wconf->phase[PHASE_CONNECT_BEGIN];
+      hdr_record(&hdr->tcp, wconf->tcp_time);
+      break;
+    case PHASE_TLS_END:
+      wconf->tls_time = now - wconf->phase[PHASE_TLS_BEGIN];
+      hdr_record(&hdr->tls, wconf->tls_time);
+      break;
+    case PHASE_FIRST_BYTE:
+      if (wconf->WAIT_time) {
+        wconf->ttfb_time = now - wconf->WAIT_time;
+        hdr_record(&hdr->ttfb, wconf->ttfb_time);
+      }
+      break;
+    case PHASE_BODY_END:
+      /* only if the first byte of this response was seen */
+      if (wconf->phase[PHASE_FIRST_BYTE]) {
+        wconf->transfer_time = now - wconf->phase[PHASE_FIRST_BYTE];
+        hdr_record(&hdr->transfer, wconf->transfer_time);
+        wconf->phase[PHASE_FIRST_BYTE] = 0;
+      }
+      /* empty line between headers and body */
+      wconf->stat.recv_bytes += 2;
+      if ((live = perf_get_live(worker, gconf, wconf))) {
+        apr_atomic_add32(&live->recv_bytes, 2);
+      }
+      break;
+    }
+  }
+  return APR_SUCCESS;
+}
+
+/**
+ * Add stat of a worker or a process to a total
+ * @param total IN total stat
+ * @param stat IN stat to add
+ */
+static void perf_stat_add(perf_t *total, perf_t *stat) {
+  int i;
+  if (stat->sent_time.max > total->sent_time.max) {
+    total->sent_time.max = stat->sent_time.max;
+  }
+  if (stat->recv_time.max > total->recv_time.max) {
+    total->recv_time.max = stat->recv_time.max;
+  }
+  if (stat->conn_time.max > total->conn_time.max) {
+    total->conn_time.max = stat->conn_time.max;
+  }
+  if (stat->sent_time.min < total->sent_time.min || total->sent_time.min == 0) {
+    total->sent_time.min = stat->sent_time.min;
+  }
+  if (stat->recv_time.min < total->recv_time.min || total->recv_time.min == 0) {
+    total->recv_time.min = stat->recv_time.min;
+  }
+  if (stat->conn_time.min < total->conn_time.min || total->conn_time.min == 0) {
+    total->conn_time.min = stat->conn_time.min;
+  }
+  total->sent_bytes += stat->sent_bytes;
+  total->recv_bytes += stat->recv_bytes;
+  total->sent_time_total += stat->sent_time_total;
+  total->recv_time.total += stat->recv_time.total;
+  total->conn_time.total += stat->conn_time.total;
+  total->count.reqs += stat->count.reqs;
+  total->count.conns += stat->count.conns;
+  total->count.missed += stat->count.missed;
+  for (i = 0; i < 10; i++) {
+    total->count.less[i] += stat->count.less[i];
+  }
+  for (i = 0; i < 600; i++) {
+    total->count.status[i] += stat->count.status[i];
+  }
+}
+
+/**
+ * Collect all data and store it in global
+ * @param worker IN callee
+ * @param line IN received status line
+ * @return APR_SUCCESS
+ */
+static apr_status_t perf_worker_finally(worker_t *worker) {
+  perf_wconf_t *wconf = perf_get_worker_config(worker);
+  perf_gconf_t *gconf = perf_get_global_config(worker->global);
+  if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
+    apr_thread_mutex_lock(worker->mutex);
+    perf_stat_add(&gconf->stat, &wconf->stat);
+    gconf->stat.count.missed += worker->sched_missed;
+    apr_thread_mutex_unlock(worker->mutex);
+  }
+  return APR_SUCCESS;
+}
+
+/**
+ * Create shared memory for the stat of the client processes
+ * @param global IN global
+ * @param processes IN number of client processes
+ * @return APR_SUCCESS or apr error
+ */
+static apr_status_t perf_process_fork(global_t *global, int processes) {
+  apr_status_t status;
+  perf_gconf_t *gconf = perf_get_global_config(global);
+
+  gconf->shared = NULL;
+  gconf->processes = processes;
+  if (gconf->on & PERF_GCONF_ON) {
+    apr_size_t size;
+    gconf->shared_size = sizeof(perf_shared_t);
+    if (gconf->label_by != PERF_LABEL_OFF) {
+      gconf->shared_size += 2 * PERF_LABELS_SHARED * sizeof(perf_label_t);
+    }
+    size = processes * gconf->shared_size;
+    if ((status = apr_shm_create(&gconf->shm, size, NULL, global->pool))
+        != APR_SUCCESS) {
+      return status;
+    }
+    gconf->shared = apr_shm_baseaddr_get(gconf->shm);
+    memset(gconf->shared, 0, size);
   }
-  if (gconf->on & PERF_GCONF_LOG && worker->flags & FLAGS_CLIENT) {
-    apr_pool_t *pool;
-    char *date_str;
-
-    HT_POOL_CREATE(&pool);
-    date_str = apr_palloc(pool, APR_RFC822_DATE_LEN);
-    apr_rfc822_date(date_str, apr_time_now());
-    apr_file_printf(gconf->log_file, "[%s] \"%s\" %d %s %"APR_TIME_T_FMT" %"APR_TIME_T_FMT"\n", 
-                    date_str,  wconf->request_line, wconf->cur_status, 
-                    status == APR_SUCCESS ? "OK" : "FAILED",
-                    wconf->stat.sent_time.cur, wconf->stat.recv_time.cur);
-    apr_pool_destroy(pool);
-  }
-  return status;
+  return APR_SUCCESS;
 }
 
 /**
- * Start connect timer
- * @param worker IN callee
- * @param line IN received status line
+ * Drop the stat a client process inherited from its parent
+ * @param global IN global
+ * @param process IN index of this process
  * @return APR_SUCCESS
  */
-static apr_status_t perf_pre_connect(worker_t *worker) {
-  global_t *global = worker->global;
-  perf_wconf_t *wconf = perf_get_worker_config(worker);
+static apr_status_t perf_process_init(global_t *global, int process) {
   perf_gconf_t *gconf = perf_get_global_config(global);
+  int i;
 
-  if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
-    wconf->stat.conn_time.cur = apr_time_now();
-    ++wconf->stat.count.conns;
+  memset(&gconf->stat, 0, sizeof(gconf->stat));
+  memset(&gconf->hdr, 0, sizeof(gconf->hdr));
+  apr_hash_clear(gconf->labels);
+  apr_hash_clear(gconf->transactions);
+  for (i = 0; i < gconf->threads->nelts; i++) {
+    perf_thread_t *thread = APR_ARRAY_IDX(gconf->threads, i, perf_thread_t *);
+    memset(&thread->hdr, 0, sizeof(thread->hdr));
+    apr_hash_clear(thread->labels);
+    apr_hash_clear(thread->transactions);
+    while (thread->log && ring_peek(thread->log)) {
+      ring_release(thread->log);
+    }
+  }
+  if (gconf->shared) {
+    perf_shared_t *shared = (perf_shared_t *)
+                            (gconf->shared + process * gconf->shared_size);
+    gconf->live.publish = &shared->live;
   }
   return APR_SUCCESS;
 }
 
 /**
- * Stop connect timer and measure connection time
- * @param worker IN callee
- * @param line IN received status line
+ * Copy labels to shared memory, collected labels never exceed
+ * PERF_LABELS_SHARED, see perf_label_collect
+ * @param shared IN room for PERF_LABELS_SHARED labels
+ * @param labels IN hash of labels
+ * @return number of copied labels
+ */
+static int perf_label_copy(perf_label_t *shared, apr_hash_t *labels) {
+  apr_hash_index_t *hi;
+  int n = 0;
+
+  for (hi = apr_hash_first(NULL, labels); hi && n < PERF_LABELS_SHARED; 
+       hi = apr_hash_next(hi)) {
+    void *val;
+    apr_hash_this(hi, NULL, NULL, &val);
+    shared[n++] = *(perf_label_t *)val;
+  }
+  return n;
+}
+
+/**
+ * Publish stat of a client process
+ * @param global IN global
+ * @param process IN index of this process
  * @return APR_SUCCESS
  */
-static apr_status_t perf_post_connect(worker_t *worker) {
-  global_t *global = worker->global;
-  perf_wconf_t *wconf = perf_get_worker_config(worker);
+static apr_status_t perf_process_exit(global_t *global, int process) {
   perf_gconf_t *gconf = perf_get_global_config(global);
-
-  if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
-    apr_time_t duration = apr_time_now() - wconf->stat.conn_time.cur;
-    wconf->stat.conn_time.cur = duration;
-    wconf->stat.conn_time.total += duration;
-    if (duration > wconf->stat.conn_time.max) {
-      wconf->stat.conn_time.max = duration;
-    }
-    if (duration < wconf->stat.conn_time.min || wconf->stat.conn_time.min == 0) {
-      wconf->stat.conn_time.min = duration;
+  perf_live_stop(gconf);
+  perf_log_stop(gconf);
+  if (gconf->profile.thread) {
+    apr_status_t retstat;
+    apr_thread_join(&retstat, gconf->profile.thread);
+    gconf->profile.thread = NULL;
+  }
+  perf_hdr_collect(gconf);
+  if (gconf->shared) {
+    perf_shared_t *shared = (perf_shared_t *)
+                            (gconf->shared + process * gconf->shared_size);
+    shared->stat = gconf->stat;
+    shared->hdr = gconf->hdr;
+    if (gconf->label_by != PERF_LABEL_OFF) {
+      perf_label_t *labels = (perf_label_t *)(shared + 1);
+
+      shared->labels = perf_label_copy(labels, gconf->labels);
+      shared->transactions = perf_label_copy(labels + PERF_LABELS_SHARED,
+                                             gconf->transactions);
     }
-
   }
   return APR_SUCCESS;
 }
 
 /**
- * Collect all data and store it in global
- * @param worker IN callee
- * @param line IN received status line
+ * Add stat of a finished client process
+ * @param global IN global
+ * @param process IN index of the finished process
  * @return APR_SUCCESS
  */
-static apr_status_t perf_worker_finally(worker_t *worker) {
-  perf_wconf_t *wconf = perf_get_worker_config(worker);
-  perf_gconf_t *gconf = perf_get_global_config(worker->global);
-  if (gconf->on & PERF_GCONF_ON && worker->flags & FLAGS_CLIENT) {
+static apr_status_t perf_process_joined(global_t *global, int process) {
+  perf_gconf_t *gconf = perf_get_global_config(global);
+  if (gconf->shared) {
+    perf_shared_t *shared = (perf_shared_t *)
+                            (gconf->shared + process * gconf->shared_size);
+    perf_label_t *labels = (perf_label_t *)(shared + 1);
     int i;
-    apr_thread_mutex_lock(worker->mutex);
-    if (wconf->stat.sent_time.max > gconf->stat.sent_time.max) {
-      gconf->stat.sent_time.max = wconf->stat.sent_time.max;
-    }
-    if (wconf->stat.recv_time.max > gconf->stat.recv_time.max) {
-      gconf->stat.recv_time.max = wconf->stat.recv_time.max;
-    }
-    if (wconf->stat.conn_time.max > gconf->stat.conn_time.max) {
-      gconf->stat.conn_time.max = wconf->stat.conn_time.max;
-    }
-    if (wconf->stat.sent_time.min < gconf->stat.sent_time.min || gconf->stat.sent_time.min == 0) {
-      gconf->stat.sent_time.min = wconf->stat.sent_time.min;
-    }
-    if (wconf->stat.recv_time.min < gconf->stat.recv_time.min || gconf->stat.recv_time.min == 0) {
-      gconf->stat.recv_time.min = wconf->stat.recv_time.min;
-    }
-    if (wconf->stat.conn_time.min < gconf->stat.conn_time.min || gconf->stat.conn_time.min == 0) {
-      gconf->stat.conn_time.min = wconf->stat.conn_time.min;
-    }
-    gconf->stat.sent_bytes += wconf->stat.sent_bytes;
-    gconf->stat.recv_bytes += wconf->stat.recv_bytes;
-    gconf->stat.sent_time_total += wconf->stat.sent_time_total;
-    gconf->stat.recv_time.total += wconf->stat.recv_time.total;
-    gconf->stat.conn_time.total += wconf->stat.conn_time.total;
-    gconf->stat.count.reqs += wconf->stat.count.reqs;
-    gconf->stat.count.conns += wconf->stat.count.conns;
-    for (i = 0; i < 10; i++) {
-      gconf->stat.count.less[i] += wconf->stat.count.less[i];
+
+    apr_thread_mutex_lock(global->mutex);
+    perf_stat_add(&gconf->stat, &shared->stat);
+    perf_hdr_add(&gconf->hdr, &shared->hdr);
+    apr_thread_mutex_unlock(global->mutex);
+    apr_thread_mutex_lock(gconf->hdr_mutex);
+    for (i = 0; i < shared->labels; i++) {
+      perf_label_collect(gconf, &labels[i]);
     }
-    for (i = 0; i < 600; i++) {
-      gconf->stat.count.status[i] += wconf->stat.count.status[i];
+    for (i = 0; i < shared->transactions; i++) {
+      perf_label_collect(gconf, &labels[PERF_LABELS_SHARED + i]);
     }
-    apr_thread_mutex_unlock(worker->mutex);
+    apr_thread_mutex_unlock(gconf->hdr_mutex);
   }
   return APR_SUCCESS;
 }
@@ -413,15 +1734,30 @@ static apr_status_t perf_worker_finally(worker_t *worker) {
  */
 static apr_status_t perf_worker_joined(global_t *global) {
   perf_gconf_t *gconf = perf_get_global_config(global);
+  perf_live_stop(gconf);
+  perf_log_stop(gconf);
+  if (gconf->profile.thread) {
+    apr_status_t retstat;
+    /* scheduler ends as soon as all clients are gone */
+    apr_thread_join(&retstat, gconf->profile.thread);
+    gconf->profile.thread = NULL;
+  }
+  perf_hdr_collect(gconf);
   if (gconf->on & PERF_GCONF_ON) {
     int i; 
     apr_time_t time;
     float seconds;
+    apr_uint64_t regex_hits;
+    apr_uint64_t regex_misses;
+    int regex_entries;
     gconf->stat.sent_time.avr = gconf->stat.sent_time_total/gconf->stat.count.reqs;
     gconf->stat.recv_time.avr = gconf->stat.recv_time.total/gconf->stat.count.reqs;
     gconf->stat.conn_time.avr = gconf->stat.conn_time.total/gconf->stat.count.conns;
     fprintf(stdout, "\ntotal reqs: %d\n", gconf->stat.count.reqs);
     fprintf(stdout, "total conns: %d\n", gconf->stat.count.conns);
+    if (gconf->stat.count.missed) {
+      fprintf(stdout, "missed starts: %d\n", gconf->stat.count.missed);
+    }
     fprintf(stdout, "send bytes: %"APR_SIZE_T_FMT"\n", gconf->stat.sent_bytes);
     fprintf(stdout, "received bytes: %"APR_SIZE_T_FMT"\n", gconf->stat.recv_bytes);
     seconds = (float)(apr_time_now() - start_time)/ APR_USEC_PER_SEC;
@@ -447,6 +1783,82 @@ static apr_status_t perf_worker_joined(global_t *global) {
             gconf->stat.sent_time.min, gconf->stat.sent_time.max, gconf->stat.sent_time.avr);
     fprintf(stdout, "recv min: %"APR_TIME_T_FMT" max: %"APR_TIME_T_FMT " avr: %"APR_TIME_T_FMT "\n", 
             gconf->stat.recv_time.min, gconf->stat.recv_time.max, gconf->stat.recv_time.avr);
+    fprintf(stdout, "\n");
+    perf_hdr_print("conn", &gconf->hdr.conn);
+    perf_hdr_print("sent", &gconf->hdr.sent);
+    perf_hdr_print("recv", &gconf->hdr.recv);
+    perf_hdr_print("total", &gconf->hdr.total);
+    perf_hdr_print("dns", &gconf->hdr.dns);
+    perf_hdr_print("tcp", &gconf->hdr.tcp);
+    perf_hdr_print("tls", &gconf->hdr.tls);
+    perf_hdr_print("ttfb", &gconf->hdr.ttfb);
+    perf_hdr_print("transfer", &gconf->hdr.transfer);
+    if (gconf->hdr_file) {
+      hdr_write(&gconf->hdr.conn, "conn", gconf->hdr_file);
+      hdr_write(&gconf->hdr.sent, "sent", gconf->hdr_file);
+      hdr_write(&gconf->hdr.recv, "recv", gconf->hdr_file);
+      hdr_write(&gconf->hdr.total, "total", gconf->hdr_file);
+      hdr_write(&gconf->hdr.dns, "dns", gconf->hdr_file);
+      hdr_write(&gconf->hdr.tcp, "tcp", gconf->hdr_file);
+      hdr_write(&gconf->hdr.tls, "tls", gconf->hdr_file);
+      hdr_write(&gconf->hdr.ttfb, "ttfb", gconf->hdr_file);
+      hdr_write(&gconf->hdr.transfer, "transfer", gconf->hdr_file);
+    }
+    if (gconf->label_by != PERF_LABEL_OFF) {
+      fprintf(stdout, "\n");
+      perf_label_print(gconf, gconf->labels, "label");
+      perf_label_print(gconf, gconf->transactions, "transaction");
+    }
+    if (gconf->hdr_file) {
+      apr_file_flush(gconf->hdr_file);
+    }
+    htt_regex_cache_stat(&regex_hits, &regex_misses, &regex_entries);
+    fprintf(stdout, "\nregex cache hits: %"APR_UINT64_T_FMT" misses: %"APR_UINT64_T_FMT" entries: %d\n", 
+            regex_hits, regex_misses, regex_entries);
+    if (global->engine) {
+      engine_stat_t stat;
+
+      engine_get_stat(global->engine, &stat);
+      fprintf(stdout, "engine carriers: %d peak users: %d "
+              "stack reserved: %"APR_SIZE_T_FMT" kB "
+              "resident avr: %"APR_SIZE_T_FMT" kB max: %"APR_SIZE_T_FMT" kB\n",
+              stat.carriers, stat.peak_users, stat.stacksize / 1024,
+              stat.finished ? stat.stack_resident / stat.finished / 1024 : 0,
+              stat.stack_resident_max / 1024);
+    }
+    if (global->tpool) {
+      tpool_stat_t stat;
+
+      tpool_get_stat(global->tpool, &stat);
+      fprintf(stdout, "pool threads spawned: %d peak busy: %d tasks: %d "
+              "spawn time: %"APR_TIME_T_FMT" us\n", stat.spawned, 
+              stat.peak_busy, stat.tasks, stat.spawn_time);
+    }
+    if (gconf->profile.stages) {
+      perf_stage_t *stages = (perf_stage_t *)gconf->profile.stages->elts;
+      const char *names[] = { "RAMP", "HOLD", "STEP" };
+      int max_users = 0;
+      fprintf(stdout, "\n");
+      for (i = 0; i < gconf->profile.stages->nelts; i++) {
+        if (stages[i].to > max_users) {
+          max_users = stages[i].to;
+        }
+      }
+      for (i = 0; i < gconf->profile.stages->nelts && stages[i].begin; i++) {
+        apr_time_t duration = stages[i].end - stages[i].begin;
+        fprintf(stdout, "stage %d %s users: %d->%d start: %.1fs "
+                "duration: %.1fs reqs: %u rps: %.1f\n", i + 1, 
+                names[stages[i].type], stages[i].from, stages[i].to,
+                (double)(stages[i].begin - stages[0].begin) / APR_USEC_PER_SEC,
+                (double)duration / APR_USEC_PER_SEC, stages[i].reqs,
+                duration > 0 ? 
+                (double)stages[i].reqs * APR_USEC_PER_SEC / duration : 0.0);
+      }
+      if (gconf->profile.started < max_users) {
+        fprintf(stdout, "profile needs more users than the %d clients\n", 
+                gconf->profile.started);
+      }
+    }
     fflush(stdout);
   }
   if (gconf->on & PERF_GCONF_LOG) {
@@ -720,6 +2132,192 @@ static apr_status_t perf_distribute_host(worker_t *worker,
   return APR_SUCCESS;
 }
 
+/**
+ * Active users of a stage at a given time
+ * @param stage IN stage
+ * @param elapsed IN time since begin of stage
+ * @return active users
+ */
+static int perf_stage_users(perf_stage_t *stage, apr_time_t elapsed) {
+  int users;
+
+  switch (stage->type) {
+  case PERF_STAGE_RAMP:
+    return stage->from + 
+           (int)((apr_int64_t)(stage->to - stage->from) * elapsed / 
+                 stage->duration);
+  case PERF_STAGE_STEP:
+    users = stage->from + stage->step * (int)(elapsed / stage->interval + 1);
+    if ((stage->step > 0 && users > stage->to) ||
+        (stage->step < 0 && users < stage->to)) {
+      users = stage->to;
+    }
+    return users;
+  default:
+    return stage->from;
+  }
+}
+
+/**
+ * Set number of active users and wake up paused users
+ * @param profile IN profile
+ * @param active IN active users
+ * @param done IN retire all users
+ * @return users still running
+ */
+static int perf_profile_set(perf_profile_t *profile, int active, int done) {
+  int running;
+
+  apr_thread_mutex_lock(profile->mutex);
+  if (active != profile->active || done) {
+    profile->active = active;
+    profile->done = done;
+    engine_cond_broadcast(profile->cond);
+  }
+  running = profile->started ? profile->running : -1;
+  apr_thread_mutex_unlock(profile->mutex);
+  return running;
+}
+
+/**
+ * Profile scheduler, walks through the stages and sets the active users
+ * @param thread IN thread
+ * @param data IN global config
+ * @return NULL
+ */
+static void * APR_THREAD_FUNC perf_profile_thread(apr_thread_t *thread, 
+                                                  void *data) {
+  perf_gconf_t *gconf = data;
+  perf_profile_t *profile = &gconf->profile;
+  perf_stage_t *stages = (perf_stage_t *)profile->stages->elts;
+  int i;
+
+  for (i = 0; i < profile->stages->nelts; i++) {
+    perf_stage_t *stage = &stages[i];
+    apr_uint32_t reqs = apr_atomic_read32(&profile->reqs);
+    apr_time_t elapsed = 0;
+
+    stage->begin = apr_time_now();
+    while (elapsed < stage->duration) {
+      apr_time_t left = stage->duration - elapsed;
+      if (perf_profile_set(profile, perf_stage_users(stage, elapsed), 0) 
+          == 0) {
+        /* all users gone */
+        stage->end = apr_time_now();
+        stage->reqs = apr_atomic_read32(&profile->reqs) - reqs;
+        goto end;
+      }
+      apr_sleep(left < apr_time_from_msec(100) ? left 
+                                               : apr_time_from_msec(100));
+      elapsed = apr_time_now() - stage->begin;
+    }
+    stage->end = apr_time_now();
+    stage->reqs = apr_atomic_read32(&profile->reqs) - reqs;
+    perf_profile_set(profile, stage->to, 0);
+  }
+
+end:
+  perf_profile_set(profile, 0, 1);
+  apr_thread_exit(thread, APR_SUCCESS);
+  return NULL;
+}
+
+/**
+ * Wait until user is active
+ * @param profile IN profile
+ * @param index IN index of user
+ * @return APR_SUCCESS if active, APR_EOF if retired
+ */
+static apr_status_t perf_profile_admit(perf_profile_t *profile, int index) {
+  apr_status_t status;
+
+  apr_thread_mutex_lock(profile->mutex);
+  while (!profile->done && index >= profile->active) {
+    engine_cond_wait(profile->cond, profile->mutex);
+  }
+  status = profile->done ? APR_EOF : APR_SUCCESS;
+  apr_thread_mutex_unlock(profile->mutex);
+  return status;
+}
+
+/**
+ * Run client repeatedly while the profile keeps it active
+ * @param worker IN client
+ * @return APR_ENOTIMPL if no profile, else status of client
+ */
+static apr_status_t perf_client_run(worker_t *worker) {
+  perf_gconf_t *gconf = perf_get_global_config(worker->global);
+  perf_profile_t *profile = &gconf->profile;
+  apr_status_t status = APR_SUCCESS;
+  int index;
+
+  if (!profile->stages) {
+    return APR_ENOTIMPL;
+  }
+
+  apr_thread_mutex_lock(profile->mutex);
+  index = profile->started++;
+  ++profile->running;
+  apr_thread_mutex_unlock(profile->mutex);
+
+  while (perf_profile_admit(profile, index) == APR_SUCCESS) {
+    if ((status = worker->interpret(worker, worker, NULL)) != APR_SUCCESS) {
+      break;
+    }
+  }
+
+  apr_thread_mutex_lock(profile->mutex);
+  --profile->running;
+  apr_thread_mutex_unlock(profile->mutex);
+  return status;
+}
+
+/**
+ * Start profile scheduler, live reporter and log writer once before the
+ * clients of a START are created, in the parent of client processes only
+ * the live reporter
+ * @param global IN global
+ * @return APR_SUCCESS or apr error
+ */
+static apr_status_t perf_clients_start(global_t *global) {
+  perf_gconf_t *gconf = perf_get_global_config(global);
+  apr_status_t status;
+  /* the parent of client processes only reports their live counters */
+  int parent = global->procs->nelts > 0;
+
+  if (!parent && gconf->profile.stages && !gconf->profile.thread) {
+    if ((status = apr_thread_create(&gconf->profile.thread, global->tattr, 
+                                    perf_profile_thread, gconf, global->pool))
+        != APR_SUCCESS) {
+      logger_log(global->logger, LOG_ERR, NULL, 
+                 "Could not create profile scheduler");
+      return status;
+    }
+  }
+
+  if (gconf->on & PERF_GCONF_LIVE && !gconf->live.thread) {
+    if ((status = apr_thread_create(&gconf->live.thread, global->tattr, 
+                                    perf_live_thread, gconf, global->pool))
+        != APR_SUCCESS) {
+      logger_log(global->logger, LOG_ERR, NULL, 
+                 "Could not create live reporter");
+      return status;
+    }
+  }
+
+  if (!parent && gconf->on & PERF_GCONF_LOG && !gconf->log.thread) {
+    gconf->log.process = global->process + 1;
+    if ((status = apr_thread_create(&gconf->log.thread, global->tattr, 
+                                    perf_log_thread, gconf, global->pool))
+        != APR_SUCCESS) {
+      logger_log(global->logger, LOG_ERR, NULL, "Could not create log writer");
+      return status;
+    }
+  }
+
+  return APR_SUCCESS;
+}
+
 /**
  * Distribute client worker.
  * @param worker IN callee
@@ -731,7 +2329,7 @@ static apr_status_t perf_client_create(worker_t *worker, apr_thread_start_t func
   global_t *global = worker->global;
   perf_gconf_t *gconf = perf_get_global_config(global);
   apr_status_t status = APR_ENOTHREAD;
-  
+
   if (gconf->flags & PERF_GCONF_FLAGS_DIST) {
     if (!gconf->clients.cur_host_i) {
       worker_log(worker, LOG_INFO, "Distribute CLIENT to my self");
@@ -895,8 +2493,16 @@ static apr_status_t block_PERF_STAT(worker_t * worker, worker_t *parent,
   else if (strcmp(param, "LOG") == 0) {
     apr_status_t status;
     const char *filename;
+    const char *format = store_get(worker->params, "3");
     gconf->on |= PERF_GCONF_LOG;
     filename = store_get(worker->params, "2");
+    if (format && strcmp(format, "BINARY") == 0) {
+      gconf->log.binary = 1;
+    }
+    else if (format) {
+      worker_log(worker, LOG_ERR, "Unknown log format \"%s\"", format);
+      return APR_EINVAL;
+    }
     if (filename) {
       if ((status = apr_file_open(&gconf->log_file, filename, 
                                   APR_READ|APR_WRITE|APR_CREATE|APR_APPEND|APR_XTHREAD, 
@@ -910,7 +2516,134 @@ static apr_status_t block_PERF_STAT(worker_t * worker, worker_t *parent,
       return APR_EINVAL;
     }
   }
+  else if (strcmp(param, "HDR") == 0) {
+    const char *filename = store_get(worker->params, "2");
+    if (!filename) {
+      worker_log(worker, LOG_ERR, "No file specified for PERF:STAT HDR command");
+      return APR_EINVAL;
+    }
+    if ((status = apr_file_open(&gconf->hdr_file, filename, 
+                                APR_WRITE|APR_CREATE|APR_APPEND|APR_XTHREAD, 
+                                APR_OS_DEFAULT, global->pool)) != APR_SUCCESS) {
+      worker_log(worker, LOG_ERR, "Could not open histogram file \"%s\"", 
+                 filename);
+      return status;
+    }
+    gconf->on |= PERF_GCONF_ON;
+  }
+  else if (strcmp(param, "LIVE") == 0) {
+    const char *interval = store_get(worker->params, "2");
+    gconf->live.interval = apr_time_from_msec(interval ? apr_atoi64(interval) 
+                                                       : 1000);
+    if (gconf->live.interval <= 0) {
+      worker_log(worker, LOG_ERR, "PERF:STAT LIVE interval must be > 0");
+      return APR_EINVAL;
+    }
+    if (!gconf->live.mutex) {
+      if ((status = apr_pool_create(&gconf->live.pool, global->pool)) 
+          != APR_SUCCESS) {
+        return status;
+      }
+      if ((status = apr_thread_mutex_create(&gconf->live.mutex, 
+                                            APR_THREAD_MUTEX_DEFAULT,
+                                            global->pool)) != APR_SUCCESS) {
+        return status;
+      }
+    }
+    gconf->on |= PERF_GCONF_ON | PERF_GCONF_LIVE;
+  }
+  else if (strcmp(param, "LABEL") == 0) {
+    const char *by = store_get(worker->params, "2");
+    if (!by) {
+      gconf->label_by = PERF_LABEL_ON;
+    }
+    else if (strcmp(by, "URL") == 0) {
+      gconf->label_by = PERF_LABEL_URL;
+    }
+    else if (strcmp(by, "BLOCK") == 0) {
+      gconf->label_by = PERF_LABEL_BLOCK;
+    }
+    else {
+      worker_log(worker, LOG_ERR, "PERF:STAT LABEL needs URL or BLOCK, not \"%s\"",
+                 by);
+      return APR_EINVAL;
+    }
+    gconf->on |= PERF_GCONF_ON;
+  }
+
+  return APR_SUCCESS;
+}
+
+/**
+ * PERF:LABEL command
+ * @param worker IN thread data object
+ * @param data IN
+ * @return APR_SUCCESS
+ */
+static apr_status_t block_PERF_LABEL(worker_t * worker, worker_t *parent,
+                                     apr_pool_t *ptmp) {
+  perf_wconf_t *wconf = perf_get_worker_config(worker);
+  const char *name = store_get(worker->params, "1");
+
+  if (name && strlen(name) >= PERF_LABEL_NAME) {
+    worker_log(worker, LOG_ERR, "Label \"%s\" is longer than %d characters",
+               name, PERF_LABEL_NAME - 1);
+    return APR_EINVAL;
+  }
+  /* copy, a label per iteration must not grow the worker pool */
+  apr_cpystrn(wconf->label, name ? name : "", sizeof(wconf->label));
+  return APR_SUCCESS;
+}
+
+/**
+ * PERF:TRANSACTION command
+ * @param worker IN thread data object
+ * @param data IN
+ * @return APR_SUCCESS or APR_EINVAL
+ */
+static apr_status_t block_PERF_TRANSACTION(worker_t * worker, worker_t *parent,
+                                           apr_pool_t *ptmp) {
+  global_t *global = worker->global;
+  perf_gconf_t *gconf = perf_get_global_config(global);
+  perf_wconf_t *wconf = perf_get_worker_config(worker);
+  const char *param = store_get(worker->params, "1");
+  const char *name = store_get(worker->params, "2");
 
+  if (param && strcmp(param, "BEGIN") == 0 && name) {
+    if (wconf->transaction[0]) {
+      worker_log(worker, LOG_ERR, "Transaction \"%s\" is still open", 
+                 wconf->transaction);
+      return APR_EINVAL;
+    }
+    if (strlen(name) >= PERF_LABEL_NAME) {
+      worker_log(worker, LOG_ERR, 
+                 "Transaction \"%s\" is longer than %d characters", name,
+                 PERF_LABEL_NAME - 1);
+      return APR_EINVAL;
+    }
+    apr_cpystrn(wconf->transaction, name, sizeof(wconf->transaction));
+    wconf->transaction_start = apr_time_now();
+    wconf->transaction_errors = 0;
+  }
+  else if (param && strcmp(param, "END") == 0) {
+    if (!wconf->transaction[0]) {
+      worker_log(worker, LOG_ERR, "No open transaction");
+      return APR_EINVAL;
+    }
+    if (gconf->label_by != PERF_LABEL_OFF && worker->flags & FLAGS_CLIENT) {
+      perf_label_t *label = perf_get_label(gconf, 
+                                           perf_get_thread(gconf)->transactions,
+                                           wconf->transaction, 1);
+      ++label->reqs;
+      label->errors += wconf->transaction_errors ? 1 : 0;
+      hdr_record(&label->hdr, apr_time_now() - wconf->transaction_start);
+    }
+    wconf->transaction[0] = 0;
+  }
+  else {
+    worker_log(worker, LOG_ERR, "Need BEGIN <name> or END");
+    return APR_EINVAL;
+  }
   return APR_SUCCESS;
 }
 
@@ -952,21 +2685,161 @@ static apr_status_t block_PERF_RAMPUP(worker_t * worker, worker_t *parent,
   return status;
 }
 
+/**
+ * PERF:PROFILE command
+ * @param worker IN thread data object
+ * @param data IN
+ * @return APR_SUCCESS or APR_EINVAL
+ */
+static apr_status_t block_PERF_PROFILE(worker_t * worker, worker_t *parent,
+                                       apr_pool_t *ptmp) {
+  apr_status_t status;
+  global_t *global = worker->global;
+  perf_gconf_t *gconf = perf_get_global_config(global);
+  perf_profile_t *profile = &gconf->profile;
+  perf_stage_t *stage;
+  const char *type;
+  const char *arg1;
+  const char *arg2;
+  const char *arg3;
+  int users = 0;
+
+  if ((status = module_check_global(worker)) != APR_SUCCESS) {
+    return status;
+  }
+  type = store_get(worker->params, "1");
+  arg1 = store_get(worker->params, "2");
+  arg2 = store_get(worker->params, "3");
+  arg3 = store_get(worker->params, "4");
+  if (!type || !arg1) {
+    worker_log(worker, LOG_ERR, "Need a stage RAMP, HOLD or STEP");
+    return APR_EINVAL;
+  }
+
+  if (!profile->stages) {
+    profile->stages = apr_array_make(global->pool, 4, sizeof(perf_stage_t));
+    if ((status = apr_thread_mutex_create(&profile->mutex, 
+                                          APR_THREAD_MUTEX_DEFAULT,
+                                          global->pool)) != APR_SUCCESS) {
+      return status;
+    }
+    if ((status = engine_cond_create(&profile->cond, global->pool))
+        != APR_SUCCESS) {
+      return status;
+    }
+  }
+  else {
+    users = APR_ARRAY_IDX(profile->stages, profile->stages->nelts - 1, 
+                          perf_stage_t).to;
+  }
+
+  stage = apr_array_push(profile->stages);
+  memset(stage, 0, sizeof(*stage));
+  stage->from = users;
+  if (strcmp(type, "RAMP") == 0 && arg2) {
+    stage->type = PERF_STAGE_RAMP;
+    stage->to = apr_atoi64(arg1);
+    stage->duration = apr_time_from_sec(apr_atoi64(arg2));
+  }
+  else if (strcmp(type, "HOLD") == 0) {
+    stage->type = PERF_STAGE_HOLD;
+    stage->to = users;
+    stage->duration = apr_time_from_sec(apr_atoi64(arg1));
+  }
+  else if (strcmp(type, "STEP") == 0 && arg2 && arg3) {
+    stage->type = PERF_STAGE_STEP;
+    stage->step = apr_atoi64(arg1);
+    stage->interval = apr_time_from_sec(apr_atoi64(arg2));
+    stage->duration = apr_time_from_sec(apr_atoi64(arg3));
+    if (stage->interval <= 0) {
+      worker_log(worker, LOG_ERR, "STEP interval must be at least 1s");
+      return APR_EINVAL;
+    }
+    stage->to = users + stage->step * 
+                (int)((stage->duration - 1) / stage->interval + 1);
+  }
+  else {
+    worker_log(worker, LOG_ERR, "Unknown or incomplete stage \"%s\"", type);
+    return APR_EINVAL;
+  }
+  if (stage->duration <= 0 || stage->to < 0) {
+    worker_log(worker, LOG_ERR, "Stage needs a duration and a positive number "
+               "of users");
+    return APR_EINVAL;
+  }
+
+  return APR_SUCCESS;
+}
+
 /************************************************************************
  * Module
  ***********************************************************************/
 apr_status_t perf_module_init(global_t *global) {
   apr_status_t status;
+  perf_gconf_t *gconf = perf_get_global_config(global);
 
   start_time = apr_time_now();
+  if ((status = apr_threadkey_private_create(&gconf->hdr_key, NULL, 
+                                             global->pool)) != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_thread_mutex_create(&gconf->hdr_mutex, 
+                                        APR_THREAD_MUTEX_DEFAULT, 
+                                        global->pool)) != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_pool_create(&gconf->hdr_pool, global->pool)) 
+      != APR_SUCCESS) {
+    return status;
+  }
+  gconf->threads = apr_array_make(gconf->hdr_pool, 16, 
+                                  sizeof(perf_thread_t *));
+  gconf->labels = apr_hash_make(gconf->hdr_pool);
+  gconf->transactions = apr_hash_make(gconf->hdr_pool);
+  gconf->log.ids = apr_hash_make(gconf->hdr_pool);
+  gconf->log.names = apr_array_make(gconf->hdr_pool, 16, sizeof(char *));
+  gconf->log.buf = apr_palloc(gconf->hdr_pool, PERF_LOG_BUF);
+  gconf->log.rings = apr_array_make(gconf->hdr_pool, 16, sizeof(ring_t *));
   if ((status = module_command_new(global, "PERF", "STAT", 
-                                   "ON|OFF|LOG <filename>",
+                                   "ON|OFF|LOG <filename> [BINARY]|HDR <filename>|"
+                                   "LIVE [<interval>]|LABEL [URL|BLOCK]",
 				   "print statistics at end of test, option LOG "
-                                   "do additional write all requests to <filename>",
+                                   "do additional write all requests to <filename>, "
+                                   "BINARY writes records with label, status, "
+                                   "phase times and bytes for tools/htstat, "
+                                   "option HDR append the latency histograms "
+                                   "to <filename> for merging with other runs, "
+                                   "option LIVE print requests per second, "
+                                   "throughput, errors and latency percentiles "
+                                   "every <interval> [ms] while running, "
+                                   "default 1000, option LABEL break down "
+                                   "statistics per PERF:LABEL and "
+                                   "PERF:TRANSACTION, unlabeled requests by "
+                                   "path without query or by calling block",
 	                           block_PERF_STAT)) != APR_SUCCESS) {
     return status;
   }
 
+  if ((status = module_command_new(global, "PERF", "LABEL", "[<name>]",
+				   "Label the following requests of this client "
+                                   "with <name> for PERF:STAT LABEL, without "
+                                   "<name> the automatic label is used again, "
+                                   "<name> has at most 63 characters",
+	                           block_PERF_LABEL)) != APR_SUCCESS) {
+    return status;
+  }
+
+  if ((status = module_command_new(global, "PERF", "TRANSACTION", 
+                                   "BEGIN <name>|END",
+				   "Measure the requests between BEGIN and END "
+                                   "as one transaction <name> for "
+                                   "PERF:STAT LABEL, a transaction fails if "
+                                   "one of its requests fails, <name> has at "
+                                   "most 63 characters",
+	                           block_PERF_TRANSACTION)) != APR_SUCCESS) {
+    return status;
+  }
+
   if ((status = module_command_new(global, "PERF", "RAMPUP", 
                                    "<clients> per <interval>",
 				   "Start <clients> per <interval> [ms], "
@@ -976,6 +2849,19 @@ apr_status_t perf_module_init(global_t *global) {
     return status;
   }
 
+  if ((status = module_command_new(global, "PERF", "PROFILE", 
+                                   "RAMP <users> <duration>|HOLD <duration>|"
+                                   "STEP <users> <interval> <duration>",
+				   "Add a stage to the load profile, times in "
+                                   "[s]. Clients are run repeatedly, the first "
+                                   "<users> of them are active, the others "
+                                   "wait. RAMP changes linear to <users>, "
+                                   "STEP adds <users> every <interval>. All "
+                                   "clients stop at the end of the profile",
+	                           block_PERF_PROFILE)) != APR_SUCCESS) {
+    return status;
+  }
+
   if ((status = module_command_new(global, "PERF", "DISTRIBUTED", 
                                    "<host>:<port>",
 				   "Distribute CLIENT to <host>:<port>, "
@@ -984,19 +2870,27 @@ apr_status_t perf_module_init(global_t *global) {
     return status;
   }
 
+  htt_hook_clients_start(perf_clients_start, NULL, NULL, 0);
   htt_hook_client_create(perf_client_create, NULL, NULL, 0);
+  htt_hook_client_run(perf_client_run, NULL, NULL, 0);
   htt_hook_server_create(perf_server_create, NULL, NULL, 0);
   htt_hook_thread_start(perf_thread_start, NULL, NULL, 0);
   htt_hook_worker_joined(perf_worker_joined, NULL, NULL, 0);
   htt_hook_worker_finally(perf_worker_finally, NULL, NULL, 0);
+  htt_hook_process_fork(perf_process_fork, NULL, NULL, 0);
+  htt_hook_process_init(perf_process_init, NULL, NULL, 0);
+  htt_hook_process_exit(perf_process_exit, NULL, NULL, 0);
+  htt_hook_process_joined(perf_process_joined, NULL, NULL, 0);
   htt_hook_pre_connect(perf_pre_connect, NULL, NULL, 0);
   htt_hook_post_connect(perf_post_connect, NULL, NULL, 0);
+  htt_hook_line_flush(perf_line_flush, NULL, NULL, 0);
   htt_hook_line_sent(perf_line_sent, NULL, NULL, 0);
   htt_hook_WAIT_begin(perf_WAIT_begin, NULL, NULL, 0);
   htt_hook_read_status_line(perf_read_status_line, NULL, NULL, 0);
   htt_hook_read_header(perf_read_header, NULL, NULL, 0);
   htt_hook_read_buf(perf_read_buf, NULL, NULL, 0);
   htt_hook_WAIT_end(perf_WAIT_end, NULL, NULL, 0);
+  htt_hook_phase(perf_phase, NULL, NULL, 0);
   return APR_SUCCESS;
 }
 
@@ -20,6 +20,10 @@
  * @Author christian liesch <liesch@gmx.ch>
  *
  * Implementation of the HTTP Test Tool htt_regex.
+ *
+ * Patterns are studied and JIT compiled if the pcre library supports it,
+ * JIT matching uses a per thread JIT stack. Configure with --with-pcre2 to
+ * use the PCRE2 library instead of pcre.
  */
 
 /************************************************************************
@@ -31,6 +35,9 @@
 
 #include <apr.h>
 #include <apr_strings.h>
+#include <apr_hash.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_proc.h>
 
 #include "defines.h"
 #include "regex.h"
@@ -40,55 +47,250 @@
  * Definitions 
  ***********************************************************************/
 
+#ifdef HAVE_PCRE2
+typedef pcre2_code htt_pcre_t;
+typedef pcre2_jit_stack htt_jit_stack_t;
+#define HTT_REGEX_EXEC_OPTIONS (PCRE2_ANCHORED|PCRE2_NOTBOL|PCRE2_NOTEOL|\
+                                PCRE2_NOTEMPTY|PCRE2_NO_UTF_CHECK)
+#define HTT_REGEX_JIT 1
+#else
+typedef pcre htt_pcre_t;
+#define HTT_REGEX_EXEC_OPTIONS (PCRE_ANCHORED|PCRE_NOTBOL|PCRE_NOTEOL|\
+                                PCRE_NOTEMPTY|PCRE_NO_UTF8_CHECK)
+#ifdef PCRE_STUDY_JIT_COMPILE
+typedef pcre_jit_stack htt_jit_stack_t;
+#define HTT_REGEX_JIT 1
+#endif
+#endif
+
 struct htt_regex_s {
   const char *pattern;
   int match;
-  void *re_pcre;
+  int cflags;
+  htt_pcre_t *re_pcre;
+#ifndef HAVE_PCRE2
+  /* study data, holds the JIT code if available */
+  pcre_extra *re_extra;
+#endif
   apr_size_t re_nsub;
   apr_size_t re_erroffset;
+  /* next cached regex with same pattern but other flags */
+  htt_regex_t *next;
 };
 
+typedef struct htt_regex_cache_s {
+  apr_pool_t *pool;
+  apr_thread_mutex_t *mutex;
+  /* pattern -> list of compiled regex */
+  apr_hash_t *regexs;
+  int entries;
+  apr_uint64_t hits;
+  apr_uint64_t misses;
+} htt_regex_cache_t;
+
+/* per thread match resources, JIT stacks must not be shared by threads */
+typedef struct htt_regex_thread_s {
+#ifdef HTT_REGEX_JIT
+  htt_jit_stack_t *jit_stack;
+#endif
+#ifdef HAVE_PCRE2
+  pcre2_match_context *mcontext;
+  pcre2_match_data *match_data;
+#endif
+} htt_regex_thread_t;
+
 #ifndef POSIX_MALLOC_THRESHOLD
 #define POSIX_MALLOC_THRESHOLD (10)
 #endif
 
+/* do not grow without limit on patterns with resolved variables */
+#ifndef HTT_REGEX_CACHE_MAX
+#define HTT_REGEX_CACHE_MAX (4096)
+#endif
+
+#ifndef HTT_REGEX_JIT_STACK_MIN
+#define HTT_REGEX_JIT_STACK_MIN (32 * 1024)
+#endif
+#ifndef HTT_REGEX_JIT_STACK_MAX
+#define HTT_REGEX_JIT_STACK_MAX (1024 * 1024)
+#endif
+
+
+/************************************************************************
+ * Globals 
+ ***********************************************************************/
+
+static htt_regex_cache_t *htt_regex_cache = NULL;
+static apr_threadkey_t *htt_regex_thread_key = NULL;
+
 
 /************************************************************************
  * Forward declaration 
  ***********************************************************************/
 
 static apr_status_t htt_regex_cleanup(void *preg); 
+static apr_status_t htt_regex_cache_cleanup(void *cache); 
 
 
 /************************************************************************
  * Implementation 
  ***********************************************************************/
 
+/**
+ * Free per thread match resources on thread exit
+ *
+ * @param data IN per thread match resources
+ */
+static void htt_regex_thread_free(void *data) {
+  htt_regex_thread_t *thread = data;
+
+  if (!thread) {
+    return;
+  }
+#ifdef HAVE_PCRE2
+  if (thread->match_data) {
+    pcre2_match_data_free(thread->match_data);
+  }
+  if (thread->mcontext) {
+    pcre2_match_context_free(thread->mcontext);
+  }
+  if (thread->jit_stack) {
+    pcre2_jit_stack_free(thread->jit_stack);
+  }
+#else
+#ifdef HTT_REGEX_JIT
+  if (thread->jit_stack) {
+    pcre_jit_stack_free(thread->jit_stack);
+  }
+#endif
+#endif
+  free(thread);
+}
+
+/**
+ * Get the match resources of the calling thread, create them on first use
+ *
+ * @return per thread match resources, NULL if not available
+ */
+static htt_regex_thread_t *htt_regex_thread_get(void) {
+  void *data = NULL;
+  htt_regex_thread_t *thread;
+
+  if (!htt_regex_thread_key) {
+    return NULL;
+  }
+  apr_threadkey_private_get(&data, htt_regex_thread_key);
+  if (data) {
+    return data;
+  }
+
+  if (!(thread = calloc(1, sizeof(*thread)))) {
+    return NULL;
+  }
+#ifdef HAVE_PCRE2
+  thread->jit_stack = pcre2_jit_stack_create(HTT_REGEX_JIT_STACK_MIN, 
+                                             HTT_REGEX_JIT_STACK_MAX, NULL);
+  thread->mcontext = pcre2_match_context_create(NULL);
+  thread->match_data = pcre2_match_data_create(POSIX_MALLOC_THRESHOLD, NULL);
+  if (!thread->mcontext || !thread->match_data) {
+    htt_regex_thread_free(thread);
+    return NULL;
+  }
+  if (thread->jit_stack) {
+    pcre2_jit_stack_assign(thread->mcontext, NULL, thread->jit_stack);
+  }
+#else
+#ifdef HTT_REGEX_JIT
+  thread->jit_stack = pcre_jit_stack_alloc(HTT_REGEX_JIT_STACK_MIN, 
+                                           HTT_REGEX_JIT_STACK_MAX);
+#endif
+#endif
+  apr_threadkey_private_set(thread, htt_regex_thread_key);
+
+  return thread;
+}
+
+#if defined(HTT_REGEX_JIT) && !defined(HAVE_PCRE2)
+/**
+ * JIT stack callback, give pcre the JIT stack of the matching thread
+ *
+ * @param data IN not used
+ *
+ * @return JIT stack or NULL for the default stack
+ */
+static pcre_jit_stack *htt_regex_jit_stack(void *data) {
+  htt_regex_thread_t *thread = htt_regex_thread_get();
+
+  return thread ? thread->jit_stack : NULL;
+}
+#endif
+
 /**
  * Compile a pattern to a regular expression
  *
  * @param p IN pool
  * @param pattern IN pattern to compile
+ * @param cflags IN pcre compile options
  * @param error IN error string
  * @param erroff IN offset into pattern wherer compilation fails
  *
  * @return regular express on success else NULL
  */
-htt_regex_t *htt_regexcomp(apr_pool_t * p, const char *pattern,
-                  const char **error, int *erroff) {
-  htt_regex_t *preg = apr_palloc(p, sizeof *preg);
+static htt_regex_t *htt_regex_compile(apr_pool_t * p, const char *pattern,
+                                      int cflags, const char **error, 
+                                      int *erroff) {
+  int nsub = 0;
+  htt_regex_t *preg = apr_pcalloc(p, sizeof *preg);
+#ifdef HAVE_PCRE2
+  int errcode;
+  PCRE2_SIZE offset;
+#else
+  const char *study_error;
+#endif
 
   preg->match = 0;
+  preg->cflags = cflags;
   preg->pattern = apr_pstrdup(p, pattern);
 
-  preg->re_pcre = pcre_compile(pattern, 0, error, erroff, NULL);
+#ifdef HAVE_PCRE2
+  preg->re_pcre = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED, 
+                                cflags, &errcode, &offset, NULL);
+  *erroff = (int)offset;
+  preg->re_erroffset = *erroff;
+
+  if (preg->re_pcre == NULL) {
+    char *buf = apr_palloc(p, 256);
+    pcre2_get_error_message(errcode, (PCRE2_UCHAR *)buf, 256);
+    *error = buf;
+    return NULL;
+  }
+
+  /* no JIT support is not an error, pcre2_match falls back, partial hard 
+   * matching of stream windows needs its own JIT code */
+  pcre2_jit_compile(preg->re_pcre, PCRE2_JIT_COMPLETE|PCRE2_JIT_PARTIAL_HARD);
+  pcre2_pattern_info(preg->re_pcre, PCRE2_INFO_CAPTURECOUNT, &nsub);
+#else
+  preg->re_pcre = pcre_compile(pattern, cflags, error, erroff, NULL);
   preg->re_erroffset = *erroff;
 
   if (preg->re_pcre == NULL) {
     return NULL;
   }
 
-  pcre_fullinfo((const pcre *)preg->re_pcre, NULL, PCRE_INFO_CAPTURECOUNT, &(preg->re_nsub));
+#ifdef HTT_REGEX_JIT
+  preg->re_extra = pcre_study(preg->re_pcre, PCRE_STUDY_JIT_COMPILE|
+                              PCRE_STUDY_JIT_PARTIAL_HARD_COMPILE, 
+                              &study_error);
+  if (preg->re_extra) {
+    pcre_assign_jit_stack(preg->re_extra, htt_regex_jit_stack, NULL);
+  }
+#else
+  preg->re_extra = pcre_study(preg->re_pcre, 0, &study_error);
+#endif
+
+  pcre_fullinfo(preg->re_pcre, preg->re_extra, PCRE_INFO_CAPTURECOUNT, &nsub);
+#endif
+  preg->re_nsub = nsub;
 
   apr_pool_cleanup_register(p, (void *) preg, htt_regex_cleanup,
                             apr_pool_cleanup_null);
@@ -96,6 +298,138 @@ htt_regex_t *htt_regexcomp(apr_pool_t * p, const char *pattern,
   return preg;
 }
 
+/**
+ * Compile a pattern to a regular expression
+ *
+ * @param p IN pool
+ * @param pattern IN pattern to compile
+ * @param error IN error string
+ * @param erroff IN offset into pattern wherer compilation fails
+ *
+ * @return regular express on success else NULL
+ */
+htt_regex_t *htt_regexcomp(apr_pool_t * p, const char *pattern,
+                  const char **error, int *erroff) {
+  return htt_regex_compile(p, pattern, 0, error, erroff);
+}
+
+/**
+ * Create the process wide cache of compiled regular expressions and the
+ * key for per thread JIT stacks, call this before any thread is started.
+ * Without a cache htt_regexcomp_cached does compile on every call.
+ *
+ * @param p IN pool the cache lives in
+ *
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t htt_regex_cache_init(apr_pool_t *p) {
+  apr_status_t status;
+  htt_regex_cache_t *cache = apr_pcalloc(p, sizeof(*cache));
+
+  if ((status = apr_pool_create(&cache->pool, p)) != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_thread_mutex_create(&cache->mutex, 
+                                        APR_THREAD_MUTEX_DEFAULT, p)) 
+      != APR_SUCCESS) {
+    return status;
+  }
+  cache->regexs = apr_hash_make(cache->pool);
+  if (!htt_regex_thread_key &&
+      (status = apr_threadkey_private_create(&htt_regex_thread_key, 
+                                             htt_regex_thread_free, p)) 
+      != APR_SUCCESS) {
+    return status;
+  }
+  apr_pool_cleanup_register(p, cache, htt_regex_cache_cleanup,
+                            apr_pool_cleanup_null);
+  htt_regex_cache = cache;
+
+  return APR_SUCCESS;
+}
+
+/**
+ * Get a regular expression from the process wide cache, compile and cache
+ * it if not found. The compiled pattern is shared, the returned regex is
+ * allocated in p and has its own hit counter.
+ *
+ * @param p IN pool
+ * @param pattern IN pattern to compile
+ * @param cflags IN pcre compile options
+ * @param error IN error string
+ * @param erroff IN offset into pattern wherer compilation fails
+ *
+ * @return regular express on success else NULL
+ */
+htt_regex_t *htt_regexcomp_cached(apr_pool_t * p, const char *pattern,
+                                  int cflags, const char **error, 
+                                  int *erroff) {
+  htt_regex_t *cached;
+  htt_regex_t *first;
+  htt_regex_t *preg;
+  htt_regex_cache_t *cache = htt_regex_cache;
+
+  if (!cache) {
+    return htt_regex_compile(p, pattern, cflags, error, erroff);
+  }
+
+  apr_thread_mutex_lock(cache->mutex);
+  first = apr_hash_get(cache->regexs, pattern, APR_HASH_KEY_STRING);
+  for (cached = first; cached && cached->cflags != cflags; 
+       cached = cached->next);
+  if (cached) {
+    ++cache->hits;
+  }
+  else {
+    ++cache->misses;
+    if (cache->entries < HTT_REGEX_CACHE_MAX &&
+        (cached = htt_regex_compile(cache->pool, pattern, cflags, error, 
+                                    erroff))) {
+      cached->next = first;
+      apr_hash_set(cache->regexs, cached->pattern, APR_HASH_KEY_STRING, 
+                   cached);
+      ++cache->entries;
+    }
+  }
+  apr_thread_mutex_unlock(cache->mutex);
+
+  if (!cached) {
+    /* cache full or pattern invalid */
+    return htt_regex_compile(p, pattern, cflags, error, erroff);
+  }
+
+  /* cache entries are never freed, so the compiled pattern can be shared */
+  preg = apr_palloc(p, sizeof(*preg));
+  *preg = *cached;
+  preg->match = 0;
+  preg->next = NULL;
+
+  return preg;
+}
+
+/**
+ * Get cache statistic
+ *
+ * @param hits OUT number of patterns found in cache
+ * @param misses OUT number of patterns compiled
+ * @param entries OUT number of cached patterns
+ */
+void htt_regex_cache_stat(apr_uint64_t *hits, apr_uint64_t *misses, 
+                          int *entries) {
+  htt_regex_cache_t *cache = htt_regex_cache;
+
+  *hits = 0;
+  *misses = 0;
+  *entries = 0;
+  if (cache) {
+    apr_thread_mutex_lock(cache->mutex);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    *entries = cache->entries;
+    apr_thread_mutex_unlock(cache->mutex);
+  }
+}
+
 /**
  * Execute a string on a compiled regular expression
  *
@@ -104,15 +438,80 @@ htt_regex_t *htt_regexcomp(apr_pool_t * p, const char *pattern,
  * @param len IN data length
  * @param nmatch IN number of matches
  * @param pmatch IN offest of matched substrings
- * @param eflags IN extended flags see pcre.h
+ * @param eflags IN extended flags see pcre.h, compile options like
+ *                  PCRE_MULTILINE are ignored
+ * @param partial OUT start of a partial match at the end of data, len if
+ *                    none, NULL for no partial matching
  *
  * @return 0 on success
  */
-int htt_regexec(htt_regex_t * preg, const char *data, apr_size_t len,
-            apr_size_t nmatch, regmatch_t pmatch[], int eflags) {
+#ifdef HAVE_PCRE2
+static int htt_regexec_ex(htt_regex_t * preg, const char *data, 
+                          apr_size_t len, apr_size_t nmatch, 
+                          regmatch_t pmatch[], int eflags, 
+                          apr_size_t *partial) {
+  int rc;
+  uint32_t options = eflags & HTT_REGEX_EXEC_OPTIONS;
+  pcre2_match_data *match_data;
+  pcre2_match_context *mcontext = NULL;
+  htt_regex_thread_t *thread = htt_regex_thread_get();
+
+  preg->re_erroffset = (apr_size_t) (-1); /* Only has meaning after compile */
+
+  if (thread && nmatch <= POSIX_MALLOC_THRESHOLD) {
+    match_data = thread->match_data;
+  }
+  else {
+    match_data = pcre2_match_data_create(nmatch ? nmatch : 1, NULL);
+    if (!match_data) {
+      return PCRE2_ERROR_NOMEMORY;
+    }
+  }
+  if (thread) {
+    mcontext = thread->mcontext;
+  }
+
+  if (partial) {
+    *partial = len;
+    options |= PCRE2_PARTIAL_HARD;
+  }
+  rc = pcre2_match(preg->re_pcre, (PCRE2_SPTR)data, len, 0, options, 
+                   match_data, mcontext);
+  if (rc == PCRE2_ERROR_PARTIAL) {
+    *partial = pcre2_get_ovector_pointer(match_data)[0];
+  }
+
+  if (rc == 0) {
+    rc = nmatch;                /* All captured slots were filled in */
+  }
+
+  if (rc >= 0) {
+    apr_size_t i;
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+    for (i = 0; i < (apr_size_t) rc && i < nmatch; i++) {
+      pmatch[i].rm_so = ovector[i * 2];
+      pmatch[i].rm_eo = ovector[i * 2 + 1];
+    }
+    for (; i < nmatch; i++)
+      pmatch[i].rm_so = pmatch[i].rm_eo = -1;
+    rc = 0;
+    ++preg->match;
+  }
+
+  if (!thread || match_data != thread->match_data) {
+    pcre2_match_data_free(match_data);
+  }
+  return rc;
+}
+#else
+static int htt_regexec_ex(htt_regex_t * preg, const char *data, 
+                          apr_size_t len, apr_size_t nmatch, 
+                          regmatch_t pmatch[], int eflags, 
+                          apr_size_t *partial) {
   int rc;
-  int options = 0;
+  int options = eflags & HTT_REGEX_EXEC_OPTIONS;
   int *ovector = NULL;
+  int ovecsize = nmatch * 3;
   int small_ovector[POSIX_MALLOC_THRESHOLD * 3];
   int allocated_ovector = 0;
 
@@ -127,9 +526,21 @@ int htt_regexec(htt_regex_t * preg, const char *data, apr_size_t len,
       allocated_ovector = 1;
     }
   }
+  if (partial) {
+    /* partial match offsets need at least one pair */
+    *partial = len;
+    options |= PCRE_PARTIAL_HARD;
+    if (!ovector) {
+      ovector = &(small_ovector[0]);
+      ovecsize = 3;
+    }
+  }
 
-  rc = pcre_exec((const pcre *) preg->re_pcre, NULL, data,
-                 len, 0, options, ovector, nmatch * 3);
+  rc = pcre_exec(preg->re_pcre, preg->re_extra, data,
+                 len, 0, options, ovector, ovecsize);
+  if (rc == PCRE_ERROR_PARTIAL) {
+    *partial = ovector[0];
+  }
 
   if (rc == 0) {
     rc = nmatch;                /* All captured slots were filled in */
@@ -137,7 +548,7 @@ int htt_regexec(htt_regex_t * preg, const char *data, apr_size_t len,
 
   if (rc >= 0) {
     apr_size_t i;
-    for (i = 0; i < (apr_size_t) rc; i++) {
+    for (i = 0; i < (apr_size_t) rc && i < nmatch; i++) {
       pmatch[i].rm_so = ovector[i * 2];
       pmatch[i].rm_eo = ovector[i * 2 + 1];
     }
@@ -156,6 +567,46 @@ int htt_regexec(htt_regex_t * preg, const char *data, apr_size_t len,
     return rc;
   }
 }
+#endif
+
+/**
+ * Execute a string on a compiled regular expression
+ *
+ * @param preg IN regular expression
+ * @param data IN data to parse
+ * @param len IN data length
+ * @param nmatch IN number of matches
+ * @param pmatch IN offest of matched substrings
+ * @param eflags IN extended flags see pcre.h, compile options like
+ *                  PCRE_MULTILINE are ignored
+ *
+ * @return 0 on success
+ */
+int htt_regexec(htt_regex_t * preg, const char *data, apr_size_t len,
+            apr_size_t nmatch, regmatch_t pmatch[], int eflags) {
+  return htt_regexec_ex(preg, data, len, nmatch, pmatch, eflags, NULL);
+}
+
+/**
+ * Execute a string which may continue in a later buffer, a match which
+ * reaches the end of data is reported as partial and not as match
+ *
+ * @param preg IN regular expression
+ * @param data IN data to parse
+ * @param len IN data length
+ * @param nmatch IN number of matches
+ * @param pmatch IN offest of matched substrings
+ * @param eflags IN extended flags see pcre.h
+ * @param partial OUT start of a partial match at the end of data, len if
+ *                    there is none
+ *
+ * @return 0 on success
+ */
+int htt_regexec_partial(htt_regex_t * preg, const char *data, apr_size_t len,
+                        apr_size_t nmatch, regmatch_t pmatch[], int eflags,
+                        apr_size_t *partial) {
+  return htt_regexec_ex(preg, data, len, nmatch, pmatch, eflags, partial);
+}
 
 /**
  * returns number of matches on this regular expression
@@ -185,7 +636,34 @@ const char *htt_regexpattern(htt_regex_t *reg) {
  * @return APR_SUCCESS
  */
 static apr_status_t htt_regex_cleanup(void *preg) {
-  pcre_free(((htt_regex_t *) preg)->re_pcre);
+  htt_regex_t *reg = preg;
+#ifdef HAVE_PCRE2
+  pcre2_code_free(reg->re_pcre);
+#else
+  if (reg->re_extra) {
+#ifdef HTT_REGEX_JIT
+    pcre_free_study(reg->re_extra);
+#else
+    pcre_free(reg->re_extra);
+#endif
+  }
+  pcre_free(reg->re_pcre);
+#endif
+  return APR_SUCCESS;
+}
+
+/**
+ * Clean up function for pool cleanup of the regex cache
+ *
+ * @cache IN regex cache
+ *
+ * @return APR_SUCCESS
+ */
+static apr_status_t htt_regex_cache_cleanup(void *cache) {
+  if (htt_regex_cache == cache) {
+    htt_regex_cache = NULL;
+    htt_regex_thread_key = NULL;
+  }
   return APR_SUCCESS;
 }
 
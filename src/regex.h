@@ -25,7 +25,23 @@
 #ifndef HTTEST_REGEX_H
 #define HTTEST_REGEX_H
 
+#ifdef HAVE_PCRE2
+#ifndef PCRE2_CODE_UNIT_WIDTH
+#define PCRE2_CODE_UNIT_WIDTH 8
+#endif
+#include <pcre2.h>
+/* pcre names used by the callers */
+#define PCRE_CASELESS PCRE2_CASELESS
+#define PCRE_MULTILINE PCRE2_MULTILINE
+#define PCRE_DOTALL PCRE2_DOTALL
+#define PCRE_EXTENDED PCRE2_EXTENDED
+#define PCRE_ANCHORED PCRE2_ANCHORED
+#define PCRE_NOTBOL PCRE2_NOTBOL
+#define PCRE_NOTEOL PCRE2_NOTEOL
+#define PCRE_NOTEMPTY PCRE2_NOTEMPTY
+#else
 #include <pcre.h>
+#endif
 
 typedef struct htt_regex_s htt_regex_t;
 typedef struct regmatch_s regmatch_t;
@@ -36,8 +52,17 @@ struct regmatch_s {
 
 htt_regex_t *htt_regexcomp(apr_pool_t * p, const char *pattern,
                   const char **error, int *erroff); 
+apr_status_t htt_regex_cache_init(apr_pool_t *p);
+htt_regex_t *htt_regexcomp_cached(apr_pool_t * p, const char *pattern,
+                                  int cflags, const char **error, 
+                                  int *erroff);
+void htt_regex_cache_stat(apr_uint64_t *hits, apr_uint64_t *misses, 
+                          int *entries);
 int htt_regexec(htt_regex_t * preg, const char *data, apr_size_t len,
             apr_size_t nmatch, regmatch_t pmatch[], int eflags); 
+int htt_regexec_partial(htt_regex_t * preg, const char *data, apr_size_t len,
+                        apr_size_t nmatch, regmatch_t pmatch[], int eflags,
+                        apr_size_t *partial);
 int htt_regexhits(htt_regex_t * preg); 
 const char *htt_regexpattern(htt_regex_t *reg);
 
@@ -39,6 +39,19 @@
  * Definitions 
  ***********************************************************************/
 
+typedef struct replacer_segment_s {
+  /* literal text or "$name", "${name}" as written in line */
+  const char *text;
+  apr_size_t len;
+  /* variable or function name, NULL for literal text */
+  char *name;
+} replacer_segment_t;
+
+struct replacer_template_s {
+  int nelts;
+  replacer_segment_t *segments;
+};
+
 /************************************************************************
  * Forward declaration 
  ***********************************************************************/
@@ -47,7 +60,7 @@
  * Implementation
  ***********************************************************************/
 
-static int my_enhanced_function_detection(char *line, int i) {
+static int my_enhanced_function_detection(const char *line, int i) {
   if (line[i] == ':') {
     int j = i;
     ++j;
@@ -78,67 +91,172 @@ static int my_enhanced_function_detection(char *line, int i) {
 }
 
 /**
- * replace vars and functions in given line 
+ * Add a segment to template
+ * @param tmpl IN template
+ * @param text IN start of segment in line
+ * @param len IN length of segment
+ * @param name IN variable name or NULL for literal text
+ */
+static void replacer_add_segment(replacer_template_t *tmpl, const char *text,
+                                 apr_size_t len, char *name) {
+  replacer_segment_t *segment;
+
+  if (len == 0 && !name) {
+    return;
+  }
+  segment = &tmpl->segments[tmpl->nelts++];
+  segment->text = text;
+  segment->len = len;
+  segment->name = name;
+}
+
+/**
+ * Split a line once into literal text and variables, "$name", "${name}",
+ * "$name(args)" and "$module:name(args)" are variables.
  * @param p IN pool
- * @param line IN line where to replace the vars with values
- * @param udata IN user data
- * @param replacer IN replacer function
- * @return new line
+ * @param line IN line, must live as long as the template
+ * @return template
  */
-char *replacer(apr_pool_t * p, char *line, void *udata, replacer_f replace) {
+replacer_template_t *replacer_compile(apr_pool_t * p, const char *line) {
   int i;
   int start;
-  int line_end;
-  char *var_name;
-  char *new_line;
-  const char *val;
-  char open_curly_brace;
-  char *next_dollar;
+  int var_start;
+  int literal;
+  int dollars = 0;
+  const char *cur;
+  replacer_template_t *tmpl = apr_pcalloc(p, sizeof(*tmpl));
 
-  new_line = line;
-
-  if (!(next_dollar = strchr(line, '$'))) {
-    return new_line;
+  for (cur = line; (cur = strchr(cur, '$')); cur++) {
+    ++dollars;
   }
+  tmpl->segments = apr_palloc(p, (2 * dollars + 1) * 
+                                 sizeof(replacer_segment_t));
 
-  i = next_dollar - line;
-  while (line[i] != 0) {
-    if (line[i] == '$') {
-      line_end = i;
+  i = 0;
+  literal = 0;
+  while ((cur = strchr(&line[i], '$'))) {
+    i = cur - line;
+    var_start = i;
+    ++i;
+    if (line[i] == '{') {
       ++i;
-      if ((open_curly_brace = line[i]) == '{') {
+      start = i;
+      while (line[i] != 0 && line[i] != '}') {
         ++i;
-	start = i;
-	while(line[i] != 0 && line[i] != '}') {
-	  ++i;
-	}
       }
-      else {
-        start = i;
-        while (line[i] != 0 && strchr(VAR_ALLOWED_CHARS, line[i])) {
-          ++i;
-        }
-	i = my_enhanced_function_detection(line, i);
+      replacer_add_segment(tmpl, &line[literal], var_start - literal, NULL);
+      replacer_add_segment(tmpl, &line[var_start], 
+                           i - var_start + (line[i] == '}'), 
+                           apr_pstrndup(p, &line[start], i - start));
+      /* a resolved "${name}" eats the closing brace */
+      literal = line[i] == '}' ? i + 1 : i;
+    }
+    else {
+      start = i;
+      while (line[i] != 0 && strchr(VAR_ALLOWED_CHARS, line[i])) {
+        ++i;
       }
-      var_name = apr_pstrndup(p, &line[start], i - start);
-      val = replace(udata, var_name);
+      i = my_enhanced_function_detection(line, i);
+      replacer_add_segment(tmpl, &line[literal], var_start - literal, NULL);
+      replacer_add_segment(tmpl, &line[var_start], i - var_start,
+                           apr_pstrndup(p, &line[start], i - start));
+      literal = i;
+    }
+  }
+  replacer_add_segment(tmpl, &line[literal], strlen(&line[literal]), NULL);
+
+  return tmpl;
+}
+
+/**
+ * Fill a template, the values are looked up in one pass to size the new
+ * line and copied in a second pass. Unresolved variables are kept as
+ * written.
+ * @param p IN pool
+ * @param tmpl IN compiled template
+ * @param udata IN user data
+ * @param replace IN replacer function
+ * @param again OUT set to 1 if a value did contain a '$'
+ * @return new line
+ */
+static char *replacer_fill(apr_pool_t * p, replacer_template_t *tmpl, 
+                           void *udata, replacer_f replace, int *again) {
+  int i;
+  apr_size_t len = 0;
+  char *new_line;
+  char *cur;
+  const char **vals = apr_palloc(p, (tmpl->nelts + 1) * sizeof(char *));
+  apr_size_t *lens = apr_palloc(p, (tmpl->nelts + 1) * sizeof(apr_size_t));
+
+  *again = 0;
+  for (i = 0; i < tmpl->nelts; i++) {
+    replacer_segment_t *segment = &tmpl->segments[i];
+    vals[i] = segment->text;
+    lens[i] = segment->len;
+    if (segment->name) {
+      const char *val = replace(udata, segment->name);
       if (val) {
-        line[line_end] = 0;
-        if (open_curly_brace == '{' && line[i] == '}') {
-          ++i;
+        vals[i] = val;
+        lens[i] = strlen(val);
+        if (memchr(val, '$', lens[i])) {
+          *again = 1;
         }
-        new_line = apr_pstrcat(p, line, val, &line[i], NULL);
-        line = new_line;
-        i = 0;
       }
     }
-    if ((next_dollar = strchr(&line[i], '$'))) {
-      i = next_dollar - line;
-    }
-    else {
+    len += lens[i];
+  }
+
+  new_line = apr_palloc(p, len + 1);
+  for (i = 0, cur = new_line; i < tmpl->nelts; i++) {
+    memcpy(cur, vals[i], lens[i]);
+    cur += lens[i];
+  }
+  *cur = 0;
+
+  return new_line;
+}
+
+/**
+ * replace vars and functions with a template compiled once, values holding
+ * variables again are resolved like in replacer
+ * @param p IN pool
+ * @param tmpl IN compiled template
+ * @param udata IN user data
+ * @param replacer IN replacer function
+ * @return new line
+ */
+char *replacer_template(apr_pool_t * p, replacer_template_t *tmpl, 
+                        void *udata, replacer_f replace) {
+  int again;
+  char *new_line = replacer_fill(p, tmpl, udata, replace, &again);
+
+  if (again) {
+    new_line = replacer(p, new_line, udata, replace);
+  }
+  return new_line;
+}
+
+/**
+ * replace vars and functions in given line 
+ * @param p IN pool
+ * @param line IN line where to replace the vars with values
+ * @param udata IN user data
+ * @param replacer IN replacer function
+ * @return new line
+ */
+char *replacer(apr_pool_t * p, char *line, void *udata, replacer_f replace) {
+  int again;
+  char *new_line = line;
+
+  /* values can hold variables again, resolve until nothing changes */
+  do {
+    if (!strchr(new_line, '$')) {
       break;
     }
-  }
+    new_line = replacer_fill(p, replacer_compile(p, new_line), udata, replace,
+                             &again);
+  } while (again);
+
   return new_line;
 }
 
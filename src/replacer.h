@@ -26,6 +26,11 @@
 #define HTTEST_REPLACER_H
 
 typedef const char *replacer_f(void *udata, const char *name);
+typedef struct replacer_template_s replacer_template_t;
+
+replacer_template_t *replacer_compile(apr_pool_t * p, const char *line);
+char *replacer_template(apr_pool_t * p, replacer_template_t *tmpl, 
+                        void *udata, replacer_f replace);
 char *replacer(apr_pool_t * p, char *line, void *udata, 
                replacer_f replace);
 
@@ -0,0 +1,149 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Implementation of the HTTP Test Tool single producer single consumer ring.
+ *
+ * One thread reserves and commits elements, another one peeks and releases
+ * them, neither takes a lock. Head and tail only grow and are published
+ * with an atomic exchange, which is a full barrier, so the consumer never
+ * sees a committed index before the element data. A full ring does not 
+ * block the producer, it counts the element as dropped.
+ */
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <apr.h>
+#include <apr_atomic.h>
+
+#include "defines.h"
+#include "ring.h"
+
+
+/************************************************************************
+ * Definitions
+ ***********************************************************************/
+struct ring_s {
+  char *elems;
+  apr_size_t elem_size;
+  /* power of two */
+  apr_uint32_t size;
+  /* written by producer only */
+  volatile apr_uint32_t head;
+  volatile apr_uint32_t dropped;
+  /* written by consumer only */
+  volatile apr_uint32_t tail;
+};
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+
+/**
+ * Create a ring
+ * @param pool IN pool to allocate from
+ * @param size IN number of elements, rounded up to a power of two
+ * @param elem_size IN size of an element
+ * @return new ring
+ */
+ring_t *ring_new(apr_pool_t *pool, apr_uint32_t size, apr_size_t elem_size) {
+  ring_t *self = apr_pcalloc(pool, sizeof(*self));
+
+  self->size = 1;
+  while (self->size < size) {
+    self->size <<= 1;
+  }
+  self->elem_size = elem_size;
+  self->elems = apr_palloc(pool, self->size * elem_size);
+  return self;
+}
+
+/**
+ * Get a free element to fill, producer only
+ * @param self IN ring
+ * @return element or NULL if full, the element is counted as dropped then
+ */
+void *ring_reserve(ring_t *self) {
+  apr_uint32_t head = self->head;
+
+  if (head - apr_atomic_read32(&self->tail) >= self->size) {
+    apr_atomic_xchg32(&self->dropped, self->dropped + 1);
+    return NULL;
+  }
+  return self->elems + (head & (self->size - 1)) * self->elem_size;
+}
+
+/**
+ * Check if the ring is full without counting a drop, producer only
+ * @param self IN ring
+ * @return 1 if full, else 0
+ */
+int ring_full(ring_t *self) {
+  return self->head - apr_atomic_read32(&self->tail) >= self->size;
+}
+
+/**
+ * Hand the reserved element over to the consumer, producer only
+ * @param self IN ring
+ */
+void ring_commit(ring_t *self) {
+  apr_atomic_xchg32(&self->head, self->head + 1);
+}
+
+/**
+ * Get oldest element, consumer only
+ * @param self IN ring
+ * @return element or NULL if empty
+ */
+void *ring_peek(ring_t *self) {
+  apr_uint32_t tail = self->tail;
+
+  if (apr_atomic_read32(&self->head) == tail) {
+    return NULL;
+  }
+  return self->elems + (tail & (self->size - 1)) * self->elem_size;
+}
+
+/**
+ * Give the peeked element back to the producer, consumer only
+ * @param self IN ring
+ */
+void ring_release(ring_t *self) {
+  apr_atomic_xchg32(&self->tail, self->tail + 1);
+}
+
+/**
+ * Get number of elements dropped because the ring was full
+ * @param self IN ring
+ * @return dropped elements
+ */
+apr_uint32_t ring_get_dropped(ring_t *self) {
+  return apr_atomic_read32(&self->dropped);
+}
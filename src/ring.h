@@ -0,0 +1,41 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Interface of the HTTP Test Tool single producer single consumer ring.
+ */
+
+#ifndef HTTEST_RING_H
+#define HTTEST_RING_H
+
+#include <apr_pools.h>
+
+typedef struct ring_s ring_t;
+
+ring_t *ring_new(apr_pool_t *pool, apr_uint32_t size, apr_size_t elem_size);
+void *ring_reserve(ring_t *self);
+int ring_full(ring_t *self);
+void ring_commit(ring_t *self);
+void *ring_peek(ring_t *self);
+void ring_release(ring_t *self);
+apr_uint32_t ring_get_dropped(ring_t *self);
+
+#endif
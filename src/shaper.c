@@ -0,0 +1,198 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Implementation of the HTTP Test Tool token bucket shaper.
+ *
+ * A bucket fills with rate tokens per second up to burst tokens, one token
+ * is one byte. A sender takes the tokens for a chunk of at most burst
+ * bytes, if there are not enough it gets the time to wait for them. Only
+ * tokens are counted, the caller does the sleeping, so a shaper never
+ * blocks a carrier of the event engine. Shared buckets are locked.
+ * Shapers can be stacked, a sender has to take from every shaper below
+ * too, see shaper_get_next.
+ */
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <apr.h>
+#include <apr_time.h>
+#include <apr_thread_mutex.h>
+
+#include "defines.h"
+#include "shaper.h"
+
+
+/************************************************************************
+ * Definitions
+ ***********************************************************************/
+struct shaper_s {
+  double rate;
+  double burst;
+  double tokens;
+  apr_time_t last;
+  /* NULL if used by one thread only */
+  apr_thread_mutex_t *mutex;
+  /* shaper below this one or NULL */
+  shaper_t *next;
+};
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+
+/**
+ * Create a token bucket, it starts full
+ * @param pool IN pool to allocate from
+ * @param rate IN bytes per second, must not be 0
+ * @param burst IN max bytes at once, 0 for a tenth of rate
+ * @param shared IN non zero if used by several threads
+ * @return new shaper
+ */
+shaper_t *shaper_new(apr_pool_t *pool, apr_size_t rate, apr_size_t burst,
+                     int shared) {
+  shaper_t *self = apr_pcalloc(pool, sizeof(*self));
+
+  if (!burst) {
+    burst = rate / 10 ? rate / 10 : 1;
+  }
+  self->rate = rate;
+  self->burst = burst;
+  self->tokens = burst;
+  self->last = apr_time_now();
+  if (shared) {
+    apr_thread_mutex_create(&self->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+  }
+  return self;
+}
+
+/**
+ * Refill tokens up to now, call locked
+ * @param self IN shaper
+ */
+static void shaper_fill(shaper_t *self) {
+  apr_time_t now = apr_time_now();
+
+  if (now > self->last) {
+    self->tokens += (now - self->last) * self->rate / APR_USEC_PER_SEC;
+    if (self->tokens > self->burst) {
+      self->tokens = self->burst;
+    }
+    self->last = now;
+  }
+}
+
+/**
+ * Stack self on top of next, data sent through self is shaped by both
+ * @param self IN shaper
+ * @param next IN shaper below or NULL
+ */
+void shaper_stack(shaper_t *self, shaper_t *next) {
+  self->next = next;
+}
+
+/**
+ * Get shaper below
+ * @param self IN shaper
+ * @return shaper below or NULL
+ */
+shaper_t *shaper_get_next(shaper_t *self) {
+  return self->next;
+}
+
+/**
+ * Change rate and burst, senders waiting get the new rate on their next
+ * take
+ * @param self IN shaper
+ * @param rate IN bytes per second, 0 for unlimited
+ * @param burst IN max bytes at once, 0 for a tenth of rate
+ */
+void shaper_set_rate(shaper_t *self, apr_size_t rate, apr_size_t burst) {
+  if (self->mutex) {
+    apr_thread_mutex_lock(self->mutex);
+  }
+  shaper_fill(self);
+  if (!burst) {
+    burst = rate / 10 ? rate / 10 : 1;
+  }
+  self->rate = rate;
+  self->burst = burst;
+  if (self->tokens > self->burst) {
+    self->tokens = self->burst;
+  }
+  if (self->mutex) {
+    apr_thread_mutex_unlock(self->mutex);
+  }
+}
+
+/**
+ * Get biggest chunk a shaper grants at once
+ * @param self IN shaper
+ * @return burst in bytes, (apr_size_t)-1 if unlimited
+ */
+apr_size_t shaper_get_burst(shaper_t *self) {
+  apr_size_t burst;
+
+  if (self->mutex) {
+    apr_thread_mutex_lock(self->mutex);
+  }
+  burst = self->rate ? (apr_size_t)self->burst : (apr_size_t)-1;
+  if (self->mutex) {
+    apr_thread_mutex_unlock(self->mutex);
+  }
+  return burst;
+}
+
+/**
+ * Take tokens for len bytes if there are enough
+ * @param self IN shaper
+ * @param len IN bytes to send, at most burst
+ * @return 0 if taken, else time to wait before trying again
+ */
+apr_interval_time_t shaper_take(shaper_t *self, apr_size_t len) {
+  apr_interval_time_t wait = 0;
+  double need;
+
+  if (self->mutex) {
+    apr_thread_mutex_lock(self->mutex);
+  }
+  need = len < self->burst ? len : self->burst;
+  shaper_fill(self);
+  if (self->rate && self->tokens < need) {
+    wait = (apr_interval_time_t)((need - self->tokens) * APR_USEC_PER_SEC / 
+                                 self->rate) + 1;
+  }
+  else if (self->rate) {
+    self->tokens -= need;
+  }
+  if (self->mutex) {
+    apr_thread_mutex_unlock(self->mutex);
+  }
+  return wait;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Interface of the HTTP Test Tool token bucket shaper.
+ */
+
+#ifndef HTTEST_SHAPER_H
+#define HTTEST_SHAPER_H
+
+#include <apr_pools.h>
+#include <apr_time.h>
+
+typedef struct shaper_s shaper_t;
+
+shaper_t *shaper_new(apr_pool_t *pool, apr_size_t rate, apr_size_t burst,
+                     int shared);
+void shaper_stack(shaper_t *self, shaper_t *next);
+shaper_t *shaper_get_next(shaper_t *self);
+void shaper_set_rate(shaper_t *self, apr_size_t rate, apr_size_t burst);
+apr_size_t shaper_get_burst(shaper_t *self);
+apr_interval_time_t shaper_take(shaper_t *self, apr_size_t len);
+
+#endif
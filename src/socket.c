@@ -47,17 +47,34 @@
 
 struct sockreader_s {
   apr_pool_t *pool;
+  /* body buffers of the current response */
+  apr_pool_t *pbody;
   transport_t *transport;
   apr_size_t i;
   apr_size_t len;
   char *buf;
   char *swap;
+  /* lines spanning a refill are joined here */
+  char *scratch;
+  apr_size_t scratch_size;
   apr_bucket_alloc_t *alloc;
   apr_bucket_brigade *cache;
-  apr_bucket_brigade *line;
   int options; 
+  /* streamed bodies are handed to window_f in windows of window bytes */
+  apr_size_t window;
+  apr_size_t window_size;
+  char *wbuf;
+  apr_size_t wlen;
+  apr_size_t wtotal;
+  apr_status_t wstatus;
+  sockreader_window_f window_f;
+  void *window_data;
 };
 
+/* bodies are streamed and not stored */
+#define SOCKREADER_STREAM(self) ((self)->window_f && \
+    !((self)->options & SOCKREADER_OPTIONS_IGNORE_BODY))
+
 
 /************************************************************************
  * Forward declaration 
@@ -88,12 +105,12 @@ apr_status_t sockreader_new(sockreader_t ** sockreader, transport_t *transport,
   *sockreader = apr_pcalloc(pool, sizeof(sockreader_t));
   (*sockreader)->buf = apr_pcalloc(pool, BLOCK_MAX + 1);
   (*sockreader)->alloc = apr_bucket_alloc_create(pool);
-  (*sockreader)->line = apr_brigade_create(pool, (*sockreader)->alloc);
 
   (*sockreader)->transport = transport;
   allocator = apr_pool_allocator_get(pool);
   apr_allocator_max_free_set(allocator, 1024*1024);
   (*sockreader)->pool = pool;
+  apr_pool_create(&(*sockreader)->pbody, pool);
 
   if (len > BLOCK_MAX) {
     return APR_ENOMEM;
@@ -146,6 +163,87 @@ void sockreader_set_options(sockreader_t *self, int options) {
   self->options = options;
 }
 
+/**
+ * Release the body buffers of the last read response, the memory is kept
+ * for the next response on this sockreader
+ *
+ * @param self IN sockreader object
+ */
+void sockreader_release(sockreader_t *self) {
+  apr_pool_clear(self->pbody);
+}
+
+/**
+ * Stream bodies, the body readers hand every <size> bytes to func and do 
+ * not return the body
+ *
+ * @param self IN sockreader object
+ * @param size IN window size
+ * @param func IN window handler, NULL to read whole bodies
+ * @param data IN data for window handler
+ */
+void sockreader_set_window(sockreader_t *self, apr_size_t size,
+                           sockreader_window_f func, void *data) {
+  if (func && size > self->window_size) {
+    self->wbuf = apr_palloc(self->pool, size);
+    self->window_size = size;
+  }
+  self->window = size;
+  self->window_f = size ? func : NULL;
+  self->window_data = data;
+  self->wlen = 0;
+  self->wtotal = 0;
+  self->wstatus = APR_SUCCESS;
+}
+
+/**
+ * Hand the filled part of the window to the window handler, a failing
+ * handler is not called again
+ *
+ * @param self IN sockreader object
+ */
+static void sockreader_window_flush(sockreader_t *self) {
+  if (self->wlen && self->wstatus == APR_SUCCESS) {
+    self->wstatus = self->window_f(self->window_data, self->wbuf, self->wlen);
+  }
+  self->wlen = 0;
+}
+
+/**
+ * Read into the window, hand every full window to the window handler
+ *
+ * @param self IN sockreader object
+ * @param length INOUT bytes to read, on return bytes read
+ *
+ * @return APR_SUCCESS else APR error of read
+ */
+static apr_status_t sockreader_window_read(sockreader_t *self, 
+                                           apr_size_t *length) {
+  apr_status_t status = APR_SUCCESS;
+  apr_size_t len = *length;
+  apr_size_t i = 0;
+
+  while (i < len) {
+    apr_size_t block = self->window - self->wlen;
+    if (block > len - i) {
+      block = len - i;
+    }
+    status = sockreader_read_block(self, &self->wbuf[self->wlen], &block);
+    self->wlen += block;
+    self->wtotal += block;
+    i += block;
+    if (self->wlen == self->window) {
+      sockreader_window_flush(self);
+    }
+    if (status != APR_SUCCESS || block == 0) {
+      break;
+    }
+  }
+
+  *length = i;
+  return status;
+}
+
 /**
  * Push back a line
  *
@@ -181,50 +279,100 @@ apr_status_t sockreader_push_line(sockreader_t * self, const char *line) {
   return status;
 }
 
+/**
+ * Append bytes to the scratch line, grow scratch if needed
+ *
+ * @param self IN sockreader object
+ * @param used IN bytes already in scratch
+ * @param buf IN bytes to append
+ * @param len IN number of bytes
+ */
+static void sockreader_scratch_add(sockreader_t *self, apr_size_t used,
+                                   const char *buf, apr_size_t len) {
+  if (used + len + 1 > self->scratch_size) {
+    char *scratch;
+    apr_size_t size = self->scratch_size ? self->scratch_size : 256;
+
+    while (used + len + 1 > size) {
+      size *= 2;
+    }
+    scratch = apr_palloc(self->pool, size);
+    if (used) {
+      memcpy(scratch, self->scratch, used);
+    }
+    self->scratch = scratch;
+    self->scratch_size = size;
+  }
+  if (len) {
+    memcpy(&self->scratch[used], buf, len);
+  }
+}
+
 /**
  * read line
  *
  * @param self IN sockreader object
- * @param line OUT read line
+ * @param line OUT read line, valid till next read on this sockreader
  *
  * @return APR_SUCCESS else an APR error
+ * @note: a line within the read buffer is returned in place, only lines 
+ *        spanning a refill are copied
  */
 apr_status_t sockreader_read_line(sockreader_t * self, char **line) {
-  char c;
+  char *start;
+  char *end;
   apr_size_t i;
+  apr_size_t len;
   apr_status_t status = APR_SUCCESS;
 
   *line = NULL;
 
   i = 0;
-  c = 0;
-  apr_brigade_cleanup(self->line);
-  while (c != '\n') {
+  for (;;) {
     if (self->i >= self->len) {
       if ((status = sockreader_fill(self)) != APR_SUCCESS) {
         break;
       }
+      continue;
+    }
+
+    start = &self->buf[self->i];
+    len = self->len - self->i;
+    if ((end = memchr(start, '\n', len))) {
+      len = end - start + 1;
     }
+    self->i += len;
 
-    if (self->i < self->len) {
-      c = self->buf[self->i];
-      apr_brigade_putc(self->line, NULL, NULL, c);
-      self->i++;
+    if (!i && end) {
+      /* whole line in buffer */
+      *line = start;
+      i = len;
+      break;
+    }
+    sockreader_scratch_add(self, i, start, len);
+    i += len;
+    if (end) {
+      break;
     }
   }
 
-  apr_brigade_pflatten(self->line, line, &i, self->pool);
-  apr_brigade_cleanup(self->line);
+  if (!*line) {
+    if (!self->scratch) {
+      sockreader_scratch_add(self, 0, NULL, 0);
+    }
+    *line = self->scratch;
+  }
 
+  /* do not terminate behind the line, a slice is followed by unread data */
   if (i) {
     (*line)[i - 1] = 0;
   }
+  else {
+    (*line)[0] = 0;
+  }
   if (i > 1 && (*line)[i - 2] == '\r') {
     (*line)[i - 2] = 0;
   }
-  else {
-    (*line)[i] = 0;
-  }
 
   return status;
 }
@@ -315,11 +463,26 @@ apr_status_t content_length_reader(sockreader_t * self,
     return status;
   }
   
+  if (SOCKREADER_STREAM(self)) {
+    self->wtotal = 0;
+    sockreader_window_read(self, &len);
+    sockreader_window_flush(self);
+    *buf = NULL;
+    if (self->wstatus != APR_SUCCESS) {
+      status = self->wstatus;
+    }
+    else if (len != *ct) {
+      status = APR_INCOMPLETE;
+    }
+    *ct = len;
+    return status;
+  }
+
   if (self->options & SOCKREADER_OPTIONS_IGNORE_BODY) {
     read = NULL;
   }
   else {
-    read = apr_pcalloc(self->pool, len);
+    read = apr_pcalloc(self->pbody, len);
   }
   sockreader_read_block(self, read, &len);
   *buf = read;
@@ -341,7 +504,7 @@ apr_status_t content_length_reader(sockreader_t * self,
  * Transfer encoding reader (only chunked implemented) 
  *
  * @param sockreader IN sockreader object
- * @param bb OUT content buffer
+ * @param bb OUT content buffer, NULL if body is ignored or streamed
  * @param val IN type of encoding 
  *
  * @return APR_SUCCESS else an APR error
@@ -372,8 +535,11 @@ static apr_status_t transfer_enc_reader_bb(sockreader_t *self,
       if (chunk == 0) {
 	break;
       }
-      if (!(self->options & SOCKREADER_OPTIONS_IGNORE_BODY)) {
-	read = apr_pcalloc(self->pool, chunk);
+      if (!bb) {
+	read = NULL;
+      }
+      else {
+	read = apr_pcalloc(self->pbody, chunk);
       }
       chunk_len = 0;
       while (chunk_len < chunk) {
@@ -381,6 +547,9 @@ static apr_status_t transfer_enc_reader_bb(sockreader_t *self,
 	if (self->options & SOCKREADER_OPTIONS_IGNORE_BODY) {
 	  status = sockreader_read_block(self, NULL, &chunk_cur);
 	}
+	else if (SOCKREADER_STREAM(self)) {
+	  status = sockreader_window_read(self, &chunk_cur);
+	}
 	else {
 	  status = sockreader_read_block(self, &read[chunk_len], 
 	                                 &chunk_cur);
@@ -390,8 +559,8 @@ static apr_status_t transfer_enc_reader_bb(sockreader_t *self,
 	}
 	chunk_len += chunk_cur;
       }
-      if (!(self->options & SOCKREADER_OPTIONS_IGNORE_BODY)) {
-	b = apr_bucket_pool_create(read, chunk_len, self->pool, 
+      if (bb) {
+	b = apr_bucket_pool_create(read, chunk_len, self->pbody, 
 				   self->alloc);
 	APR_BRIGADE_INSERT_TAIL(bb, b);
       }
@@ -428,21 +597,31 @@ apr_status_t transfer_enc_reader(sockreader_t * self,
   apr_bucket_brigade *bb;
   apr_status_t status = APR_SUCCESS;
 
-  if (self->options & SOCKREADER_OPTIONS_IGNORE_BODY) {
+  if (self->options & SOCKREADER_OPTIONS_IGNORE_BODY || 
+      SOCKREADER_STREAM(self)) {
     bb = NULL;
   }
   else {
-    bb = apr_brigade_create(self->pool, self->alloc);
+    bb = apr_brigade_create(self->pbody, self->alloc);
   }
 
+  self->wtotal = 0;
   status = transfer_enc_reader_bb(self, bb, val);
 
   if (self->options & SOCKREADER_OPTIONS_IGNORE_BODY) {
     *buf = NULL;
     *len = 0;
   }
+  else if (SOCKREADER_STREAM(self)) {
+    sockreader_window_flush(self);
+    *buf = NULL;
+    *len = self->wtotal;
+    if (self->wstatus != APR_SUCCESS) {
+      return self->wstatus;
+    }
+  }
   else {
-    apr_brigade_pflatten(bb, buf, len, self->pool);
+    apr_brigade_pflatten(bb, buf, len, self->pbody);
     apr_brigade_destroy(bb);
   }
 
@@ -482,18 +661,35 @@ apr_status_t eof_reader(sockreader_t * self, char **buf,
     return APR_ENOTIMPL;
   }
 
+  if (SOCKREADER_STREAM(self)) {
+    self->wtotal = 0;
+    do {
+      block = BLOCK_MAX;
+      status = sockreader_window_read(self, &block);
+    } while (status == APR_SUCCESS); 
+    sockreader_window_flush(self);
+    *len = self->wtotal;
+    if (self->wstatus != APR_SUCCESS) {
+      return self->wstatus;
+    }
+    if (status == APR_SUCCESS || status == APR_EOF) {
+      return APR_SUCCESS;
+    }
+    return status;
+  }
+
   if (self->options & SOCKREADER_OPTIONS_IGNORE_BODY) {
     bb = NULL;
   }
   else {
-    bb = apr_brigade_create(self->pool, self->alloc);
+    bb = apr_brigade_create(self->pbody, self->alloc);
   }
 
   if (self->options & SOCKREADER_OPTIONS_IGNORE_BODY) {
     read = NULL;
   }
   else {
-    read = apr_pcalloc(self->pool, BLOCK_MAX);
+    read = apr_pcalloc(self->pbody, BLOCK_MAX);
   }
   do {
     block = BLOCK_MAX;
@@ -504,9 +700,9 @@ apr_status_t eof_reader(sockreader_t * self, char **buf,
       status = sockreader_read_block(self, read, &block);
     }
     if (!self->options & SOCKREADER_OPTIONS_IGNORE_BODY) {
-      b = apr_bucket_pool_create(read, block, self->pool, self->alloc);
+      b = apr_bucket_pool_create(read, block, self->pbody, self->alloc);
       APR_BRIGADE_INSERT_TAIL(bb, b);
-      read = apr_pcalloc(self->pool, BLOCK_MAX);
+      read = apr_pcalloc(self->pbody, BLOCK_MAX);
     }
   } while (status == APR_SUCCESS); 
 
@@ -515,7 +711,7 @@ apr_status_t eof_reader(sockreader_t * self, char **buf,
     *len = 0;
   }
   else {
-    apr_brigade_pflatten(bb, buf, len, self->pool);
+    apr_brigade_pflatten(bb, buf, len, self->pbody);
     apr_brigade_destroy(bb);
   }
 
@@ -548,8 +744,9 @@ apr_status_t encapsulated_reader(sockreader_t * self, char **buf,
   apr_status_t status;
   apr_size_t size;
   apr_size_t size2;
+  sockreader_window_f window_f = self->window_f;
   
-  tmp = apr_pstrdup(self->pool, enc_info);
+  tmp = apr_pstrdup(self->pbody, enc_info);
   cur = apr_strtok(tmp, ",", &last);
   val = cur;
   while (cur) {
@@ -578,17 +775,20 @@ apr_status_t encapsulated_reader(sockreader_t * self, char **buf,
     read = NULL;
   }
   else {
-    read = apr_pcalloc(self->pool, size);
+    read = apr_pcalloc(self->pbody, size);
   }
   sockreader_read_block(self, read, &size);
 
   if (strcasecmp(key, "null-body") != 0 && (!preview || strcasecmp(preview, "0") != 0)) {
-    if ((status = transfer_enc_reader(self, &read2, &size2, "chunked")) 
-	!= APR_SUCCESS) {
+    /* encapsulated messages are not streamed */
+    self->window_f = NULL;
+    status = transfer_enc_reader(self, &read2, &size2, "chunked");
+    self->window_f = window_f;
+    if (status != APR_SUCCESS) {
       return status;
     }
     if (!self->options & SOCKREADER_OPTIONS_IGNORE_BODY) {
-      *buf = apr_pcalloc(self->pool, size + size2);
+      *buf = apr_pcalloc(self->pbody, size + size2);
       memcpy(*buf, read, size);
       memcpy(&(*buf)[size], read2, size2);
       *len = size + size2;
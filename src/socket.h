@@ -31,6 +31,8 @@
 #define SOCKREADER_OPTIONS_IGNORE_BODY 1
 
 typedef struct sockreader_s sockreader_t;
+typedef apr_status_t (*sockreader_window_f)(void *data, char *buf, 
+                                            apr_size_t len);
 
 apr_status_t sockreader_new(sockreader_t ** sockreader, transport_t * transport,
                             char *rest, apr_size_t len);
@@ -39,6 +41,9 @@ void sockreader_set_transport(sockreader_t *sockreader,
                               transport_t *transport); 
 apr_socket_t * sockreader_get_socket(sockreader_t *self);
 void sockreader_set_options(sockreader_t *self, int options); 
+void sockreader_release(sockreader_t *self);
+void sockreader_set_window(sockreader_t *self, apr_size_t size,
+                           sockreader_window_f func, void *data);
 apr_status_t sockreader_push_back(sockreader_t * self, const char *buf, 
                                   apr_size_t len); 
 apr_status_t sockreader_push_line(sockreader_t * self, const char *line);
@@ -210,12 +210,16 @@ void ssl_rand_seed(void) {
  *
  * @param ssl IN ssl object
  * @param error OUT error text
+ * @param pool IN pool for error text
+ * @param tmo IN socket timeout while waiting in an engine user
  *
  * @return APR_EINVAL if no ssl context or
  *         APR_ECONNREFUSED if could not handshake or
+ *         APR_TIMEUP if the peer did not answer in time or
  *         APR_SUCCESS
  */
-apr_status_t ssl_handshake(SSL *ssl, char **error, apr_pool_t *pool) {
+apr_status_t ssl_handshake(SSL *ssl, char **error, apr_pool_t *pool,
+                           apr_interval_time_t tmo) {
   apr_status_t status = APR_SUCCESS;
   int do_next = 1;
 
@@ -230,7 +234,9 @@ apr_status_t ssl_handshake(SSL *ssl, char **error, apr_pool_t *pool) {
   while (do_next) {
     int ret, ecode;
 
-    apr_sleep(1);
+    if (!engine_is_user()) {
+      apr_sleep(1);
+    }
     
     ret = SSL_do_handshake(ssl);
     ecode = SSL_get_error(ssl, ret);
@@ -241,12 +247,18 @@ apr_status_t ssl_handshake(SSL *ssl, char **error, apr_pool_t *pool) {
       do_next = 0;
       break;
     case SSL_ERROR_WANT_READ:
-      /* Try again */
-      do_next = 1;
-      break;
     case SSL_ERROR_WANT_WRITE:
       /* Try again */
-      do_next = 1;
+      if (engine_wait_fd(SSL_get_fd(ssl), ecode == SSL_ERROR_WANT_READ ?
+                                          ENGINE_READ : ENGINE_WRITE, 
+                         tmo) == APR_TIMEUP) {
+	*error = apr_pstrdup(pool, "Handshake timeout");
+	status = APR_TIMEUP;
+	do_next = 0;
+      }
+      else {
+	do_next = 1;
+      }
       break;
     case SSL_ERROR_WANT_CONNECT:
     case SSL_ERROR_SSL:
@@ -277,11 +289,16 @@ apr_status_t ssl_handshake(SSL *ssl, char **error, apr_pool_t *pool) {
 /**
  * ssl accept
  *
- * @param worker IN thread data object
+ * @param ssl IN ssl object
+ * @param error OUT error text
+ * @param pool IN pool for error text
+ * @param tmo IN socket timeout while waiting in an engine user
  *
- * @return APR_SUCCESS
+ * @return APR_SUCCESS, APR_TIMEUP if the peer did not answer in time
+ *         or apr error
  */
-apr_status_t ssl_accept(SSL *ssl, char **error, apr_pool_t *pool) {
+apr_status_t ssl_accept(SSL *ssl, char **error, apr_pool_t *pool,
+                        apr_interval_time_t tmo) {
   int rc;
   int err;
 
@@ -294,7 +311,9 @@ apr_status_t ssl_accept(SSL *ssl, char **error, apr_pool_t *pool) {
   }
   
 tryagain:
-  apr_sleep(1);
+  if (!engine_is_user()) {
+    apr_sleep(1);
+  }
   if (SSL_is_init_finished(ssl)) {
     return APR_SUCCESS;
   }
@@ -308,6 +327,10 @@ tryagain:
     }
     else if (err == SSL_ERROR_WANT_READ) {
       *error = apr_pstrdup(pool, "SSL accept SSL_ERROR_WANT_READ.");
+      if (engine_wait_fd(SSL_get_fd(ssl), ENGINE_READ, tmo) == APR_TIMEUP) {
+        *error = apr_pstrdup(pool, "SSL accept timeout");
+        return APR_TIMEUP;
+      }
       goto tryagain;
     }
     else if (ERR_GET_LIB(ERR_peek_error()) == ERR_LIB_SSL &&
@@ -168,7 +168,8 @@ static apr_status_t worker_ssl_handshake(worker_t * worker) {
   char *error;
   ssl_sconf_t *sconfig = ssl_get_socket_config(worker);
   
-  if ((status = ssl_handshake(sconfig->ssl, &error, worker->pbody)) 
+  if ((status = ssl_handshake(sconfig->ssl, &error, worker->pbody,
+                              worker->socktmo)) 
       != APR_SUCCESS) {
     worker_log(worker, LOG_ERR, "%s", error);
   }
@@ -860,6 +861,8 @@ static apr_status_t ssl_new_instance(worker_t *worker) {
   }
   worker_new(&config->msg_worker, NULL, worker->global, worker->interpret); 
   config->msg_worker->config = worker->config;
+  config->msg_worker->dispatch = worker->dispatch;
+  config->msg_worker->modules = worker->modules;
 
   if ((sconfig->ssl = SSL_new(config->ssl_ctx)) == NULL) {
     worker_log(worker, LOG_ERR, "SSL_new failed.");
@@ -925,7 +928,8 @@ static apr_status_t worker_ssl_accept(worker_t * worker) {
     return APR_SUCCESS;
   }
 
-  if ((status = ssl_accept(sconfig->ssl, &error, worker->pbody)) 
+  if ((status = ssl_accept(sconfig->ssl, &error, worker->pbody,
+                           worker->socktmo)) 
       != APR_SUCCESS) {
     worker_log(worker, LOG_ERR, "%s", error);
   }
@@ -937,10 +941,12 @@ static apr_status_t worker_ssl_accept(worker_t * worker) {
  *
  * @param data IN void pointer to socket
  * @param desc OUT os socket descriptor
- * @return APR_ENOENT
+ * @return apr status
  */
 static apr_status_t ssl_transport_os_desc_get(void *data, int *desc) {
-  return APR_ENOENT;
+  ssl_transport_t *ssl_transport = data;
+
+  return transport_os_desc_get(ssl_transport->tcp_transport, desc);
 }
 
 /**
@@ -990,7 +996,9 @@ tryagain:
     return APR_TIMEUP;
   }
   
-  apr_sleep(1);
+  if (!engine_is_user()) {
+    apr_sleep(1);
+  }
   status = SSL_read(ssl_transport->ssl, buf, *size);
   if (status <= 0) {
     int scode = SSL_get_error(ssl_transport->ssl, status);
@@ -1012,6 +1020,10 @@ tryagain:
       *size = 0;
       return APR_ECONNABORTED;
     }
+    else if (engine_is_user()) {
+      /* transport_read waits on the socket and calls again */
+      return APR_EAGAIN;
+    }
     else {
       goto tryagain;
     }
@@ -1037,11 +1049,17 @@ static apr_status_t ssl_transport_write(void *data, const char *buf, apr_size_t
   apr_size_t e_ssl;
 
 tryagain:
-  apr_sleep(1);
+  if (!engine_is_user()) {
+    apr_sleep(1);
+  }
   e_ssl = SSL_write(ssl_transport->ssl, buf, size);
   if (e_ssl != size) {
     int scode = SSL_get_error(ssl_transport->ssl, e_ssl);
-    if (scode == SSL_ERROR_WANT_WRITE) {
+    if (scode == SSL_ERROR_WANT_WRITE && engine_is_user()) {
+      /* transport_write waits on the socket and calls again */
+      return APR_EAGAIN;
+    }
+    else if (scode == SSL_ERROR_WANT_WRITE) {
       goto tryagain;
     }
     return APR_ECONNABORTED;
@@ -1898,9 +1916,11 @@ static apr_status_t ssl_hook_connect(worker_t *worker) {
       worker_log(worker, LOG_DEBUG, "No session to set");
 	}
     SSL_set_connect_state(sconfig->ssl);
+    htt_run_phase(worker, PHASE_TLS_BEGIN);
     if ((status = worker_ssl_handshake(worker)) != APR_SUCCESS) {
       return status;
     }
+    htt_run_phase(worker, PHASE_TLS_END);
     ssl_transport = ssl_get_transport(worker, sconfig);
     transport = transport_new(ssl_transport, worker->pbody, 
             ssl_transport_os_desc_get, 
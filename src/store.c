@@ -20,6 +20,24 @@
  * @Author christian liesch <liesch@gmx.ch>
  *
  * Implementation of the HTTP Test Tool store.
+ *
+ * Open addressing hash with linear probing. Keys are copied once and stay
+ * in their slot, an unset only marks the slot as unset, so no tombstones
+ * are needed. Values live in buffers of power of two size classes which
+ * are reused in place if a new value fits and are kept on per store free
+ * lists otherwise. Huge values get their own pool like before, so they
+ * are freed on replace. Keys and the slot array come from the same free
+ * lists, a rehash gives back the old array and the keys of the unset
+ * slots it drops, so a store does not grow with the keys it ever had.
+ *
+ * A copy is copy on write. On copy the visible entries of the source are
+ * frozen into a read only base store in its own pool, which is shared by
+ * reference count between all copies. The source itself is not touched,
+ * pointers got with store_get stay valid. The source remembers the frozen
+ * store until its next write. Writes of a copy go to its own slots, which
+ * are looked up first, an unset slot masks a key of the base. So the first
+ * copy costs O(n), every further copy of an unchanged store is O(1) until
+ * it writes.
  */
 
 /************************************************************************
@@ -34,21 +52,63 @@
 #include <apr_hash.h>
 #include <apr_tables.h>
 #include <apr_strings.h>
+#include <apr_atomic.h>
+#include "defines.h"
 #include "store.h"
 
 
 /************************************************************************
  * Definitions 
  ***********************************************************************/
-struct store_s {
+/* smallest value buffer is 1 << STORE_MIN_SHIFT */
+#define STORE_MIN_SHIFT 4
+/* number of size classes, bigger values get an own pool */
+#define STORE_CLASSES 13
+#define STORE_MAX_SIZE (1 << (STORE_MIN_SHIFT + STORE_CLASSES - 1))
+#define STORE_MIN_CAPACITY 16
+
+typedef struct store_entry_s {
+  /* NULL if slot was never used */
+  const char *key;
+  unsigned int hash;
+  int is_set;
+  /* value, NULL is a valid value */
+  const char *value;
+  /* value buffer and its size */
+  char *buf;
+  apr_size_t size;
+  /* own pool for huge values */
   apr_pool_t *pool;
-  apr_hash_t *hash;
+} store_entry_t;
+
+typedef struct store_free_s store_free_t;
+struct store_free_s {
+  store_free_t *next;
 };
 
-typedef struct store_element_s {
+struct store_s {
   apr_pool_t *pool;
-  const char *value;
-} store_element_t;
+  store_entry_t *entries;
+  /* power of two or 0 */
+  apr_size_t capacity;
+  /* slots with a key */
+  apr_size_t used;
+  /* visible keys, including the ones of base */
+  apr_size_t count;
+  store_free_t *free[STORE_CLASSES];
+  /* own pool of a slot array too big for the free lists or NULL */
+  apr_pool_t *entries_pool;
+  /* frozen shared entries or NULL */
+  store_t *base;
+  /* references of a base store */
+  apr_uint32_t refs;
+  /* frozen visible entries of this store for copies or NULL */
+  store_t *frozen;
+  /* count of writes, frozen is valid while it has frozen_version */
+  apr_uint32_t version;
+  apr_uint32_t frozen_version;
+  int has_cleanup;
+};
 
 /************************************************************************
  * Globals 
@@ -57,6 +117,369 @@ typedef struct store_element_s {
 /************************************************************************
  * Implementation
  ***********************************************************************/
+/**
+ * Hash a key
+ * @param key IN zero terminated key
+ * @return hash
+ */
+static unsigned int store_hash(const char *key) {
+  unsigned int hash = 0;
+  const unsigned char *cur;
+
+  for (cur = (const unsigned char *)key; *cur; cur++) {
+    hash = hash * 33 + *cur;
+  }
+  return hash;
+}
+
+/**
+ * Find slot of key or the empty slot where it belongs
+ * @param store IN store hook
+ * @param name IN key
+ * @param hash IN hash of key
+ * @return slot, NULL if store has no slots
+ */
+static store_entry_t *store_lookup(store_t *store, const char *name, 
+                                   unsigned int hash) {
+  apr_size_t i;
+  apr_size_t mask = store->capacity - 1;
+
+  if (!store->capacity) {
+    return NULL;
+  }
+  for (i = hash & mask; store->entries[i].key; i = (i + 1) & mask) {
+    if (store->entries[i].hash == hash && 
+        strcmp(store->entries[i].key, name) == 0) {
+      break;
+    }
+  }
+  return &store->entries[i];
+}
+
+/**
+ * Get value of key from base of store
+ * @param store IN store hook
+ * @param name IN key
+ * @param hash IN hash of key
+ * @param value OUT value
+ * @return 1 if base has the key else 0
+ */
+static int store_base_get(store_t *store, const char *name, 
+                          unsigned int hash, const char **value) {
+  store_entry_t *entry;
+
+  if (!store->base) {
+    return 0;
+  }
+  entry = store_lookup(store->base, name, hash);
+  if (entry && entry->key && entry->is_set) {
+    *value = entry->value;
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Call fn for every visible key/value of store
+ * @param store IN store hook
+ * @param fn IN function to call
+ * @param data IN custom data for fn
+ */
+static void store_do(store_t *store, 
+                     void (*fn)(void *data, const char *key, 
+                                const char *value),
+                     void *data) {
+  apr_size_t i;
+
+  for (i = 0; i < store->capacity; i++) {
+    store_entry_t *entry = &store->entries[i];
+    if (entry->key && entry->is_set) {
+      fn(data, entry->key, entry->value);
+    }
+  }
+  if (store->base) {
+    store_t *base = store->base;
+    for (i = 0; i < base->capacity; i++) {
+      store_entry_t *entry = &base->entries[i];
+      store_entry_t *own;
+      if (!entry->key || !entry->is_set) {
+        continue;
+      }
+      own = store_lookup(store, entry->key, entry->hash);
+      if (!own || !own->key) {
+        fn(data, entry->key, entry->value);
+      }
+    }
+  }
+}
+
+/**
+ * Get size class for a buffer size
+ * @param size IN needed size
+ * @return size class
+ */
+static int store_class(apr_size_t size) {
+  int class = 0;
+
+  while (((apr_size_t)1 << (STORE_MIN_SHIFT + class)) < size) {
+    ++class;
+  }
+  return class;
+}
+
+/**
+ * Get a buffer from the free list of its size class
+ * @param store IN store hook
+ * @param size IN needed size, at most STORE_MAX_SIZE
+ * @param got OUT size of the buffer
+ * @return buffer
+ */
+static char *store_buf_get(store_t *store, apr_size_t size, 
+                           apr_size_t *got) {
+  char *buf;
+  int class = store_class(size);
+
+  *got = (apr_size_t)1 << (STORE_MIN_SHIFT + class);
+  if (store->free[class]) {
+    buf = (char *)store->free[class];
+    store->free[class] = store->free[class]->next;
+  }
+  else {
+    buf = apr_palloc(store->pool, *got);
+  }
+  return buf;
+}
+
+/**
+ * Give a buffer back to the free list of its size class
+ * @param store IN store hook
+ * @param buf IN buffer from store_buf_get
+ * @param size IN size asked for or got from store_buf_get
+ */
+static void store_buf_put(store_t *store, char *buf, apr_size_t size) {
+  store_free_t *free_buf = (store_free_t *)buf;
+  int class = store_class(size);
+
+  free_buf->next = store->free[class];
+  store->free[class] = free_buf;
+}
+
+/**
+ * Copy a key into a buffer of the free lists
+ * @param store IN store hook
+ * @param name IN key
+ * @return key copy
+ */
+static const char *store_key_make(store_t *store, const char *name) {
+  apr_size_t got;
+  apr_size_t len = strlen(name) + 1;
+  char *key;
+
+  if (len > STORE_MAX_SIZE) {
+    /* stays in the store pool */
+    return apr_pstrmemdup(store->pool, name, len - 1);
+  }
+  key = store_buf_get(store, len, &got);
+  memcpy(key, name, len);
+  return key;
+}
+
+/**
+ * Give a key back to the free lists
+ * @param store IN store hook
+ * @param key IN key from store_key_make
+ */
+static void store_key_release(store_t *store, const char *key) {
+  apr_size_t len = strlen(key) + 1;
+
+  if (len <= STORE_MAX_SIZE) {
+    store_buf_put(store, (char *)key, len);
+  }
+}
+
+/**
+ * Release value buffer of an entry, buffers go back to the free list
+ * @param store IN store hook
+ * @param entry IN entry
+ */
+static void store_release(store_t *store, store_entry_t *entry) {
+  if (entry->pool) {
+    apr_pool_destroy(entry->pool);
+  }
+  else if (entry->buf) {
+    store_buf_put(store, entry->buf, entry->size);
+  }
+  entry->pool = NULL;
+  entry->buf = NULL;
+  entry->size = 0;
+}
+
+/**
+ * Get a value buffer of at least size bytes for entry
+ * @param store IN store hook
+ * @param entry IN entry
+ * @param size IN needed size
+ */
+static void store_alloc(store_t *store, store_entry_t *entry, 
+                        apr_size_t size) {
+  if (size > STORE_MAX_SIZE) {
+    apr_pool_create(&entry->pool, store->pool);
+    entry->buf = apr_palloc(entry->pool, size);
+    entry->size = size;
+  }
+  else {
+    entry->pool = NULL;
+    entry->buf = store_buf_get(store, size, &entry->size);
+  }
+}
+
+/**
+ * Grow or clean up slots, unset entries are dropped unless they mask a
+ * key of the base
+ * @param store IN store hook
+ */
+static void store_rehash(store_t *store) {
+  apr_size_t i;
+  apr_size_t got;
+  apr_size_t size;
+  apr_size_t capacity = STORE_MIN_CAPACITY;
+  apr_pool_t *entries_pool = store->entries_pool;
+  store_entry_t *entries = store->entries;
+  apr_size_t old_capacity = store->capacity;
+  apr_size_t keep = 0;
+
+  /* size for the slots which survive */
+  for (i = 0; i < old_capacity; i++) {
+    const char *value;
+    if (entries[i].key && (entries[i].is_set || 
+        store_base_get(store, entries[i].key, entries[i].hash, &value))) {
+      ++keep;
+    }
+  }
+  while (capacity < (keep + 1) * 2) {
+    capacity *= 2;
+  }
+  size = capacity * sizeof(store_entry_t);
+  if (size > STORE_MAX_SIZE) {
+    apr_pool_create(&store->entries_pool, store->pool);
+    store->entries = apr_pcalloc(store->entries_pool, size);
+  }
+  else {
+    store->entries_pool = NULL;
+    store->entries = (store_entry_t *)store_buf_get(store, size, &got);
+    memset(store->entries, 0, size);
+  }
+  store->capacity = capacity;
+  store->used = 0;
+  for (i = 0; i < old_capacity; i++) {
+    if (entries[i].key) {
+      const char *value;
+      if (entries[i].is_set || 
+          store_base_get(store, entries[i].key, entries[i].hash, &value)) {
+        store_entry_t *entry = store_lookup(store, entries[i].key, 
+                                            entries[i].hash);
+        *entry = entries[i];
+        ++store->used;
+      }
+      else {
+        store_release(store, &entries[i]);
+        store_key_release(store, entries[i].key);
+      }
+    }
+  }
+  /* give back the old array */
+  if (entries_pool) {
+    apr_pool_destroy(entries_pool);
+  }
+  else if (entries) {
+    store_buf_put(store, (char *)entries, 
+                  old_capacity * sizeof(store_entry_t));
+  }
+}
+
+/**
+ * Release a reference of a base store, the last one destroys it
+ * @param base IN base store
+ */
+static void store_base_release(store_t *base) {
+  if (base && !apr_atomic_dec32(&base->refs)) {
+    apr_pool_destroy(base->pool);
+  }
+}
+
+/**
+ * Pool cleanup to release the base and the frozen entries of a store
+ * @param data IN store hook
+ * @return APR_SUCCESS
+ */
+static apr_status_t store_cleanup(void *data) {
+  store_t *store = data;
+  store_base_release(store->base);
+  store->base = NULL;
+  store_base_release(store->frozen);
+  store->frozen = NULL;
+  return APR_SUCCESS;
+}
+
+/**
+ * Register the cleanup of store once
+ * @param store IN store hook
+ */
+static void store_register_cleanup(store_t *store) {
+  if (!store->has_cleanup) {
+    apr_pool_cleanup_register(store->pool, store, store_cleanup, 
+                              apr_pool_cleanup_null);
+    store->has_cleanup = 1;
+  }
+}
+
+/**
+ * Set base of a store and take a reference
+ * @param store IN store hook
+ * @param base IN base store
+ */
+static void store_set_base(store_t *store, store_t *base) {
+  store_register_cleanup(store);
+  apr_atomic_inc32(&base->refs);
+  store_base_release(store->base);
+  store->base = base;
+}
+
+/**
+ * Add key/value to store, callback for store_do
+ * @param data IN store hook
+ * @param key IN key
+ * @param value IN value
+ */
+static void store_add(void *data, const char *key, const char *value) {
+  store_set(data, key, value);
+}
+
+/**
+ * Get all visible entries of store frozen into a base for copies, the
+ * entries of store are only read. The frozen store is kept until store
+ * is written.
+ * @param store IN store hook
+ * @return frozen store
+ */
+static store_t *store_freeze(store_t *store) {
+  apr_pool_t *pool;
+  store_t *frozen;
+
+  if (store->frozen && store->frozen_version == store->version) {
+    return store->frozen;
+  }
+  HT_POOL_CREATE(&pool);
+  frozen = store_make(pool);
+  store_do(store, store_add, frozen);
+  store_register_cleanup(store);
+  apr_atomic_inc32(&frozen->refs);
+  store_base_release(store->frozen);
+  store->frozen = frozen;
+  store->frozen_version = store->version;
+  return frozen;
+}
+
 /**
  * Create store for reusable entries without memory loss
  * @param pool IN pool to alloc this store
@@ -65,7 +488,6 @@ typedef struct store_element_s {
 store_t *store_make(apr_pool_t *pool) {
   store_t *store = apr_pcalloc(pool, sizeof(*store));
   store->pool = pool;
-  store->hash = apr_hash_make(pool);
   return store;
 }
 
@@ -76,13 +498,15 @@ store_t *store_make(apr_pool_t *pool) {
  * @return value
  */
 const char *store_get(store_t *store, const char *name) {
-  store_element_t *element = apr_hash_get(store->hash, name, APR_HASH_KEY_STRING);
-  if (element) {
-    return element->value;
-  }
-  else {
-    return NULL;
+  const char *value = NULL;
+  unsigned int hash = store_hash(name);
+  store_entry_t *entry = store_lookup(store, name, hash);
+
+  if (entry && entry->key) {
+    return entry->is_set ? entry->value : NULL;
   }
+  store_base_get(store, name, hash, &value);
+  return value;
 }
 
 /**
@@ -103,7 +527,7 @@ char *store_get_copy(store_t *store, apr_pool_t *pool, const char *name) {
 }
 
 /**
- * Store value in name, if already exists delete old value and remove name entry.
+ * Store value in name, if already exists the old value is overwritten.
  * Always adds the terminating zero to the stored value.
  * So if you want to store an already zero terminated string "myStr", then pass "strlen(myStr)" in len.
  * @param store IN store hook
@@ -112,27 +536,55 @@ char *store_get_copy(store_t *store, apr_pool_t *pool, const char *name) {
  * @param len IN length of value string (without terminating zero)
  */
 void store_set_and_zero_terminate(store_t *store, const char *name, const char *value, apr_size_t len) {
-  apr_pool_t *pool;
-  store_element_t *element = apr_hash_get(store->hash, name, APR_HASH_KEY_STRING);
-  if (element) {
+  unsigned int hash = store_hash(name);
+  store_entry_t *entry = store_lookup(store, name, hash);
+
+  if (entry && entry->key && entry->is_set && value == entry->value) {
     /* check if the new value is same pointer as stored value */
-    if (value == element->value) {
-      /* nothing to do */
-      return;
+    /* nothing to do */
+    return;
+  }
+  ++store->version;
+  if (!entry || (!entry->key && (store->used + 1) * 4 > store->capacity * 3)) {
+    store_rehash(store);
+    entry = store_lookup(store, name, hash);
+  }
+  if (!entry->key) {
+    const char *old;
+    entry->key = store_key_make(store, name);
+    entry->hash = hash;
+    ++store->used;
+    if (store_base_get(store, name, hash, &old)) {
+      /* already visible through base */
+      entry->is_set = 1;
     }
-    apr_hash_set(store->hash, name, APR_HASH_KEY_STRING, NULL);
-    apr_pool_destroy(element->pool);
   }
-  apr_pool_create(&pool, store->pool);
-  element = apr_pcalloc(pool, sizeof(*element));
-  element->pool = pool;
-  element->value = apr_pstrmemdup(element->pool, value, len);	/*add terminating zero*/
-  apr_hash_set(store->hash, apr_pstrdup(element->pool, name), 
-	       APR_HASH_KEY_STRING, element);
+  if (!entry->is_set) {
+    entry->is_set = 1;
+    ++store->count;
+  }
+
+  if (!value) {
+    entry->value = NULL;
+    return;
+  }
+  if (len + 1 > entry->size) {
+    /* value can be part of the old value, release old buffer after copy */
+    store_entry_t old = *entry;
+    store_alloc(store, entry, len + 1);
+    memcpy(entry->buf, value, len);
+    store_release(store, &old);
+  }
+  else {
+    /* value may overlap the old value */
+    memmove(entry->buf, value, len);
+  }
+  entry->buf[len] = 0;	/*add terminating zero*/
+  entry->value = entry->buf;
 }
 
 /**
- * Set name value, if already exists delete old name value and remove name entry.
+ * Set name value, if already exists the old value is overwritten.
  * @param store IN store hook
  * @param name IN key
  * @param value IN zero terminated string value to store
@@ -143,16 +595,38 @@ void store_set(store_t *store, const char *name, const char *value) {
 }
 
 /**
- * Unset name value.
+ * Unset name value, the slot and its buffer are kept for a later set.
+ * A key of the base gets an unset slot which masks it.
  * @param store IN store hook
  * @param name IN key
  */
 void store_unset(store_t *store, const char *name) {
-  store_element_t *element = apr_hash_get(store->hash, name, APR_HASH_KEY_STRING);
-  if (element) {
-    apr_hash_set(store->hash, name, APR_HASH_KEY_STRING, NULL);
-    apr_pool_destroy(element->pool);
+  const char *value;
+  unsigned int hash = store_hash(name);
+  store_entry_t *entry = store_lookup(store, name, hash);
+
+  ++store->version;
+  if (entry && entry->key) {
+    if (entry->is_set) {
+      entry->is_set = 0;
+      entry->value = NULL;
+      --store->count;
+    }
+    return;
   }
+  if (!store_base_get(store, name, hash, &value)) {
+    return;
+  }
+  if (!entry || (store->used + 1) * 4 > store->capacity * 3) {
+    store_rehash(store);
+    entry = store_lookup(store, name, hash);
+  }
+  entry->key = store_key_make(store, name);
+  entry->hash = hash;
+  entry->is_set = 0;
+  entry->value = NULL;
+  ++store->used;
+  --store->count;
 }
 
 /**
@@ -161,20 +635,10 @@ void store_unset(store_t *store, const char *name) {
  * @param other IN foreign store hook
  */
 void store_merge(store_t *store, store_t *other) {
-  apr_hash_index_t *i;
-  const void *key;
-  void *val;
-  store_element_t *element;
-
   if (!store || !other) {
     return;
   }
-
-  for (i = apr_hash_first(other->pool, other->hash); i; i = apr_hash_next(i)) {
-    apr_hash_this(i, &key, NULL, &val);
-    element = val;
-    store_set(store, key, element->value);
-  }
+  store_do(other, store_add, store);
 }
 
 /**
@@ -183,21 +647,42 @@ void store_merge(store_t *store, store_t *other) {
  * @return count
  */
 apr_size_t store_get_size(store_t *store) {
-  return apr_hash_count(store->hash);
+  return store->count;
 }
 
 /**
- * Copy store
+ * Copy store, the copy shares the frozen entries of store until it writes.
+ * Store is not modified, only the frozen entries it remembers. So copies
+ * of the same store and writes to it must be serialized by the caller,
+ * readers of store are not disturbed.
  * @param store IN store hook
  * @param pool IN pool for new store 
  * @return new store
  */
 store_t *store_copy(store_t *store, apr_pool_t *pool) {
   store_t *copy = store_make(pool);
-  store_merge(copy, store);
+  store_t *base = store->base;
+
+  if (store->used) {
+    base = store_freeze(store);
+  }
+  if (base) {
+    store_set_base(copy, base);
+    copy->count = store->count;
+  }
   return copy;
 }
 
+/**
+ * Add key/value to table, callback for store_do
+ * @param data IN table
+ * @param key IN key
+ * @param value IN value
+ */
+static void store_add_table(void *data, const char *key, const char *value) {
+  apr_table_set(data, key, value);
+}
+
 /**
  * Get table of key/values for iteration
  * @param store IN store hook
@@ -205,17 +690,7 @@ store_t *store_copy(store_t *store, apr_pool_t *pool) {
  * @return table of key/values
  */
 apr_table_t *store_get_table(store_t *store, apr_pool_t *pool) {
-  apr_hash_index_t *i;
-  const void *key;
-  void *val;
-  store_element_t *element;
   apr_table_t *table = apr_table_make(pool, 5);
-
-  for (i = apr_hash_first(pool, store->hash); i; i = apr_hash_next(i)) {
-    apr_hash_this(i, &key, NULL, &val);
-    element = val;
-    apr_table_set(table, key, element->value);
-  }
+  store_do(store, store_add_table, table);
   return table;
 }
-
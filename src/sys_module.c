@@ -26,13 +26,17 @@
  * Includes
  ***********************************************************************/
 #include "module.h"
+#include "engine.h"
 
 /************************************************************************
  * Definitions 
  ***********************************************************************/
 const char * sys_module = "sys_module";
 typedef struct sys_gconf_s {
-  apr_thread_mutex_t *sync;
+  /* _LOCK is a flag guarded by mutex, so event users can wait on cond */
+  apr_thread_mutex_t *mutex;
+  engine_cond_t *cond;
+  int locked;
 } sys_gconf_t;
 
 /************************************************************************
@@ -57,8 +61,9 @@ static sys_gconf_t *sys_get_global_config(global_t *global) {
     if (config == NULL) {
       config = apr_pcalloc(global->pool, sizeof(*config));
       module_set_config(global->config, apr_pstrdup(global->pool, sys_module), config);
-      if (apr_thread_mutex_create(&config->sync, APR_THREAD_MUTEX_DEFAULT, 
-                                  global->pool) != APR_SUCCESS) {
+      if (apr_thread_mutex_create(&config->mutex, APR_THREAD_MUTEX_DEFAULT, 
+                                  global->pool) != APR_SUCCESS ||
+          engine_cond_create(&config->cond, global->pool) != APR_SUCCESS) {
         config = NULL;
       }
     }
@@ -109,9 +114,16 @@ static apr_status_t block_PROC_LOCK(worker_t *worker, worker_t *parent, apr_pool
     return APR_EGENERAL;
   }
 
-  if ((status = apr_thread_mutex_lock(gconf->sync)) != APR_SUCCESS) {
-    return status;
+  lock(gconf->mutex);
+  while (gconf->locked) {
+    if ((status = engine_cond_wait(gconf->cond, gconf->mutex)) 
+        != APR_SUCCESS) {
+      unlock(gconf->mutex);
+      return status;
+    }
   }
+  gconf->locked = 1;
+  unlock(gconf->mutex);
 
   return APR_SUCCESS;
 }
@@ -134,11 +146,12 @@ static apr_status_t block_PROC_UNLOCK(worker_t *worker, worker_t *parent, apr_po
     return APR_EGENERAL;
   }
 
-  if ((status = apr_thread_mutex_unlock(gconf->sync)) != APR_SUCCESS) {
-    return status;
-  }
+  lock(gconf->mutex);
+  gconf->locked = 0;
+  status = engine_cond_signal(gconf->cond);
+  unlock(gconf->mutex);
 
-  return APR_SUCCESS;
+  return status;
 }
 
 /**
@@ -190,7 +203,7 @@ static apr_status_t block_SYS_SLEEP(worker_t *worker, worker_t *parent, apr_pool
     return status;
   }
 
-  apr_sleep(apr_atoi64(copy) * 1000);
+  engine_sleep(apr_atoi64(copy) * 1000);
   return APR_SUCCESS;
 }
 
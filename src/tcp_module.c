@@ -89,7 +89,7 @@ static apr_status_t tcp_transport_read(void *data, char *buf, apr_size_t *size)
   if (!socket) {
     return APR_ENOSOCKET;
   }
-  return apr_socket_recv(socket, buf, size);
+  return engine_socket_recv(socket, buf, size);
 }
 
 /**
@@ -111,7 +111,7 @@ static apr_status_t tcp_transport_write(void *data, const char *buf, apr_size_t
   }
   while (total != count) {
     len = total - count;
-    if ((status = apr_socket_send(socket, &buf[count], &len)) 
+    if ((status = engine_socket_send(socket, &buf[count], &len)) 
 	!= APR_SUCCESS) {
       return status;
     }
@@ -121,6 +121,83 @@ static apr_status_t tcp_transport_write(void *data, const char *buf, apr_size_t
   return APR_SUCCESS;
 }
 
+/**
+ * write several buffers to socket with as few calls as possible
+ * @param data IN void pointer to socket
+ * @param vec IN buffers, advanced over sent bytes
+ * @param nvec IN number of buffers
+ * @return apr status
+ */
+static apr_status_t tcp_transport_writev(void *data, struct iovec *vec, 
+                                         apr_int32_t nvec) {
+  apr_socket_t *socket = data;
+  apr_status_t status;
+  apr_size_t len;
+
+  if (!socket) {
+    return APR_ENOSOCKET;
+  }
+  while (nvec) {
+    if ((status = engine_socket_sendv(socket, vec, nvec, &len)) 
+	!= APR_SUCCESS) {
+      return status;
+    }
+    /* skip what is sent, continue with the rest */
+    while (nvec && len >= vec->iov_len) {
+      len -= vec->iov_len;
+      ++vec;
+      --nvec;
+    }
+    if (nvec) {
+      vec->iov_base = (char *)vec->iov_base + len;
+      vec->iov_len -= len;
+    }
+  }
+
+  return APR_SUCCESS;
+}
+
+/**
+ * send a file region to socket without copy
+ * @param data IN void pointer to socket
+ * @param file IN file to send from
+ * @param offset IN file offset
+ * @param len IN bytes to send
+ * @return APR_SUCCESS, APR_ENOTIMPL if this file or socket can not be sent
+ *         with sendfile and nothing is sent yet, or any apr status
+ */
+static apr_status_t tcp_transport_sendfile(void *data, apr_file_t *file,
+                                           apr_off_t offset, apr_size_t len) {
+  apr_socket_t *socket = data;
+  apr_status_t status;
+  apr_size_t sent;
+  apr_off_t start = offset;
+
+  if (!socket) {
+    return APR_ENOSOCKET;
+  }
+  while (len) {
+    sent = len;
+    if ((status = engine_socket_sendfile(socket, file, offset, &sent)) 
+	!= APR_SUCCESS) {
+      /* EINVAL if the kernel can not sendfile this, the caller may still 
+       * write it as long as no byte went out */
+      if (APR_STATUS_IS_EINVAL(status) && offset == start && !sent) {
+        return APR_ENOTIMPL;
+      }
+      return status;
+    }
+    if (!sent) {
+      /* file is shorter than told */
+      return APR_EOF;
+    }
+    offset += sent;
+    len -= sent;
+  }
+
+  return APR_SUCCESS;
+}
+
 /************************************************************************
  * Hooks
 ************************************************************************/
@@ -138,6 +215,8 @@ static apr_status_t tcp_hook_connect(worker_t *worker) {
 			    tcp_transport_get_timeout,
 			    tcp_transport_read, 
 			    tcp_transport_write);
+  transport_set_writev(transport, tcp_transport_writev);
+  transport_set_sendfile(transport, tcp_transport_sendfile);
 
   transport_register(worker->socket, transport);
 
@@ -161,6 +240,8 @@ static apr_status_t tcp_hook_accept(worker_t *worker, char *data) {
 			    tcp_transport_get_timeout,
 			    tcp_transport_read, 
 			    tcp_transport_write);
+  transport_set_writev(transport, tcp_transport_writev);
+  transport_set_sendfile(transport, tcp_transport_sendfile);
   transport_register(worker->socket, transport);
 
   worker_log(worker, LOG_DEBUG, "tcp accept socket: %"APR_UINT64_T_HEX_FMT" "
@@ -276,16 +357,20 @@ apr_status_t tcp_connect(worker_t *worker, char *hostname, char *portname) {
     return status;
   }
 
+  htt_run_phase(worker, PHASE_DNS_BEGIN);
   if ((status = apr_sockaddr_info_get(&remote_addr, hostname, AF_UNSPEC, port,
                                       APR_IPV4_ADDR_OK, worker->pbody))
       != APR_SUCCESS) {
     return status;
   }
+  htt_run_phase(worker, PHASE_DNS_END);
 
-  if ((status = apr_socket_connect(worker->socket->socket, remote_addr)) 
+  htt_run_phase(worker, PHASE_CONNECT_BEGIN);
+  if ((status = engine_socket_connect(worker->socket->socket, remote_addr)) 
       != APR_SUCCESS) {
     return status;
   }
+  htt_run_phase(worker, PHASE_CONNECT_END);
 
   if ((status = apr_socket_opt_set(worker->socket->socket, APR_SO_KEEPALIVE, 1)) 
       != APR_SUCCESS) {
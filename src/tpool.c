@@ -0,0 +1,320 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Implementation of the HTTP Test Tool thread pool.
+ *
+ * Tasks are queued and picked up by idle pool threads, a new thread is
+ * only created if there are more queued tasks than idle threads. Threads
+ * never end, they wait for the next task, so a second START or the next
+ * accepted connection reuses them. A task gets NULL as thread, functions
+ * written for apr_thread_create must not call apr_thread_exit then.
+ */
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <apr.h>
+#include <apr_time.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+
+#include "defines.h"
+#include "engine.h"
+#include "tpool.h"
+
+
+/************************************************************************
+ * Definitions
+ ***********************************************************************/
+struct tpool_task_s {
+  tpool_t *tpool;
+  apr_thread_start_t func;
+  void *data;
+  int done;
+  /* nobody joins, the pool thread frees the task */
+  int detached;
+  tpool_task_t *next;
+};
+
+struct tpool_s {
+  apr_pool_t *pool;
+  apr_size_t stacksize;
+  apr_thread_mutex_t *mutex;
+  /* signaled on new tasks and on finished tasks, joining event users do
+   * not block their carrier */
+  apr_thread_cond_t *work;
+  engine_cond_t *done;
+  tpool_task_t *head;
+  tpool_task_t *tail;
+  int queued;
+  int idle;
+  int busy;
+  tpool_stat_t stat;
+};
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+
+/**
+ * Pool thread, runs queued tasks forever
+ * @param thread IN thread
+ * @param data IN thread pool
+ * @return never
+ */
+static void * APR_THREAD_FUNC tpool_thread(apr_thread_t *thread, void *data) {
+  tpool_t *self = data;
+  tpool_task_t *task;
+
+  apr_thread_mutex_lock(self->mutex);
+  for (;;) {
+    while (!self->head) {
+      ++self->idle;
+      apr_thread_cond_wait(self->work, self->mutex);
+      --self->idle;
+    }
+    task = self->head;
+    self->head = task->next;
+    if (!self->head) {
+      self->tail = NULL;
+    }
+    --self->queued;
+    if (++self->busy > self->stat.peak_busy) {
+      self->stat.peak_busy = self->busy;
+    }
+    apr_thread_mutex_unlock(self->mutex);
+
+    task->func(NULL, task->data);
+
+    apr_thread_mutex_lock(self->mutex);
+    --self->busy;
+    if (task->detached) {
+      free(task);
+    }
+    else {
+      task->done = 1;
+      engine_cond_broadcast(self->done);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Create a thread pool without threads
+ * @param tpool OUT new thread pool
+ * @param pool IN parent pool, must live until exit
+ * @param stacksize IN stack size of new threads
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t tpool_create(tpool_t **tpool, apr_pool_t *pool, 
+                          apr_size_t stacksize) {
+  apr_status_t status;
+  tpool_t *self = apr_pcalloc(pool, sizeof(*self));
+
+  /* own pool, threads are created from any thread under our mutex */
+  if ((status = apr_pool_create(&self->pool, pool)) != APR_SUCCESS) {
+    return status;
+  }
+  self->stacksize = stacksize;
+  if ((status = apr_thread_mutex_create(&self->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                        pool)) != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_thread_cond_create(&self->work, pool)) != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = engine_cond_create(&self->done, pool)) != APR_SUCCESS) {
+    return status;
+  }
+  *tpool = self;
+  return APR_SUCCESS;
+}
+
+/**
+ * Set stack size of threads created from now on
+ * @param tpool IN thread pool
+ * @param stacksize IN stack size in bytes
+ */
+void tpool_set_stacksize(tpool_t *tpool, apr_size_t stacksize) {
+  apr_thread_mutex_lock(tpool->mutex);
+  tpool->stacksize = stacksize;
+  apr_thread_mutex_unlock(tpool->mutex);
+}
+
+/**
+ * Create a pool thread, call with locked mutex
+ * @param self IN thread pool
+ * @return APR_SUCCESS or apr error
+ */
+static apr_status_t tpool_spawn(tpool_t *self) {
+  apr_status_t status;
+  apr_threadattr_t *tattr;
+  apr_thread_t *thread;
+  apr_time_t start = apr_time_now();
+
+  if ((status = apr_threadattr_create(&tattr, self->pool)) != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_threadattr_stacksize_set(tattr, self->stacksize))
+      != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_threadattr_detach_set(tattr, 1)) != APR_SUCCESS) {
+    return status;
+  }
+  if ((status = apr_thread_create(&thread, tattr, tpool_thread, self, 
+                                  self->pool)) != APR_SUCCESS) {
+    return status;
+  }
+  ++self->stat.spawned;
+  self->stat.spawn_time += apr_time_now() - start;
+  return APR_SUCCESS;
+}
+
+/**
+ * Remove a task not yet picked up from the queue, call with locked mutex
+ * @param self IN thread pool
+ * @param task IN queued task
+ */
+static void tpool_unqueue(tpool_t *self, tpool_task_t *task) {
+  tpool_task_t *prev = NULL;
+  tpool_task_t *cur = self->head;
+
+  while (cur && cur != task) {
+    prev = cur;
+    cur = cur->next;
+  }
+  if (!cur) {
+    return;
+  }
+  if (prev) {
+    prev->next = task->next;
+  }
+  else {
+    self->head = task->next;
+  }
+  if (self->tail == task) {
+    self->tail = prev;
+  }
+  --self->queued;
+  --self->stat.tasks;
+}
+
+/**
+ * Run a function on a pool thread
+ * @param tpool IN thread pool
+ * @param func IN function, gets NULL as thread
+ * @param data IN data for function
+ * @param task OUT task to join, untouched on error
+ * @return APR_SUCCESS or apr error
+ */
+apr_status_t tpool_push(tpool_t *tpool, apr_thread_start_t func, void *data,
+                        tpool_task_t **task) {
+  apr_status_t status = APR_SUCCESS;
+  tpool_task_t *new_task = calloc(1, sizeof(*new_task));
+
+  if (!new_task) {
+    return APR_ENOMEM;
+  }
+  new_task->tpool = tpool;
+  new_task->func = func;
+  new_task->data = data;
+
+  apr_thread_mutex_lock(tpool->mutex);
+  if (tpool->tail) {
+    tpool->tail->next = new_task;
+  }
+  else {
+    tpool->head = new_task;
+  }
+  tpool->tail = new_task;
+  ++tpool->queued;
+  ++tpool->stat.tasks;
+  if (tpool->idle >= tpool->queued) {
+    apr_thread_cond_signal(tpool->work);
+  }
+  else if ((status = tpool_spawn(tpool)) != APR_SUCCESS) {
+    tpool_unqueue(tpool, new_task);
+    apr_thread_mutex_unlock(tpool->mutex);
+    free(new_task);
+    return status;
+  }
+  apr_thread_mutex_unlock(tpool->mutex);
+
+  *task = new_task;
+  return APR_SUCCESS;
+}
+
+/**
+ * Wait for a task to end and free it
+ * @param task IN task from tpool_push
+ * @return APR_SUCCESS
+ */
+apr_status_t tpool_join(tpool_task_t *task) {
+  tpool_t *self = task->tpool;
+
+  apr_thread_mutex_lock(self->mutex);
+  while (!task->done) {
+    engine_cond_wait(self->done, self->mutex);
+  }
+  apr_thread_mutex_unlock(self->mutex);
+  free(task);
+  return APR_SUCCESS;
+}
+
+/**
+ * Never join a task, it is freed as soon as it ended
+ * @param task IN task from tpool_push
+ */
+void tpool_detach(tpool_task_t *task) {
+  tpool_t *self = task->tpool;
+
+  apr_thread_mutex_lock(self->mutex);
+  if (task->done) {
+    free(task);
+  }
+  else {
+    task->detached = 1;
+  }
+  apr_thread_mutex_unlock(self->mutex);
+}
+
+/**
+ * Get statistics of a thread pool
+ * @param tpool IN thread pool
+ * @param stat OUT statistics
+ */
+void tpool_get_stat(tpool_t *tpool, tpool_stat_t *stat) {
+  apr_thread_mutex_lock(tpool->mutex);
+  *stat = tpool->stat;
+  apr_thread_mutex_unlock(tpool->mutex);
+}
@@ -0,0 +1,54 @@
+/**
+ * Copyright 2006 Christian Liesch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Interface of the HTTP Test Tool thread pool.
+ */
+
+#ifndef HTTEST_TPOOL_H
+#define HTTEST_TPOOL_H
+
+#include <apr_pools.h>
+#include <apr_time.h>
+#include <apr_thread_proc.h>
+
+typedef struct tpool_s tpool_t;
+typedef struct tpool_task_s tpool_task_t;
+
+typedef struct tpool_stat_s {
+  /* threads created, pool threads never end */
+  int spawned;
+  /* tasks run and most tasks running at once */
+  int tasks;
+  int peak_busy;
+  /* time spent creating threads */
+  apr_time_t spawn_time;
+} tpool_stat_t;
+
+apr_status_t tpool_create(tpool_t **tpool, apr_pool_t *pool, 
+                          apr_size_t stacksize);
+void tpool_set_stacksize(tpool_t *tpool, apr_size_t stacksize);
+apr_status_t tpool_push(tpool_t *tpool, apr_thread_start_t func, void *data,
+                        tpool_task_t **task);
+apr_status_t tpool_join(tpool_task_t *task);
+void tpool_detach(tpool_task_t *task);
+void tpool_get_stat(tpool_t *tpool, tpool_stat_t *stat);
+
+#endif
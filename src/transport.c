@@ -29,6 +29,8 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <apr.h>
 #include <apr_lib.h>
 #include <apr_errno.h>
@@ -44,18 +46,26 @@
 
 
 #include "defines.h"
+#include "engine.h"
 #include "transport.h"
 
 /************************************************************************
  * Definitions 
  ***********************************************************************/
+/* coalescing buffer for transports without gather write */
+#define TRANSPORT_BUF 8192
+
 struct transport_s {
   void *data;
+  apr_pool_t *pool;
   transport_os_desc_get_f os_desc_get;
   transport_set_timeout_f set_timeout;
   transport_get_timeout_f get_timeout;
   transport_read_f read;
   transport_write_f write;
+  transport_writev_f writev;
+  transport_sendfile_f sendfile;
+  char *buf;
 };
 
 /************************************************************************
@@ -82,6 +92,7 @@ transport_t *transport_new(void *data,
   transport_t *hook = apr_pcalloc(pool, sizeof(*hook));
 
   hook->data = data;
+  hook->pool = pool;
   hook->os_desc_get = os_desc_get;
   hook->set_timeout = set_timeout;
   hook->get_timeout = get_timeout;
@@ -91,6 +102,24 @@ transport_t *transport_new(void *data,
   return hook;
 }
 
+/**
+ * set gather write method
+ * @param hook IN transport hook
+ * @param writev IN gather write method
+ */
+void transport_set_writev(transport_t *hook, transport_writev_f writev) {
+  hook->writev = writev;
+}
+
+/**
+ * set sendfile method
+ * @param hook IN transport hook
+ * @param sendfile IN sendfile method
+ */
+void transport_set_sendfile(transport_t *hook, transport_sendfile_f sendfile) {
+  hook->sendfile = sendfile;
+}
+
 /**
  * set new user data
  * @param hook IN transport hook
@@ -163,6 +192,25 @@ apr_status_t transport_get_timeout(transport_t *hook, apr_interval_time_t *t) {
   }
 }
 
+/**
+ * Wait on the descriptor of a transport which returned APR_EAGAIN, lets
+ * other users of the event engine run meanwhile
+ * @param hook IN transport hook
+ * @param events IN ENGINE_READ or ENGINE_WRITE
+ * @return APR_SUCCESS if ready, APR_TIMEUP or APR_ENOTIMPL if not in an
+ *         engine user or transport has no descriptor
+ */
+static apr_status_t transport_wait(transport_t *hook, int events) {
+  int desc;
+  apr_interval_time_t tmo = -1;
+
+  if (!engine_is_user() || transport_os_desc_get(hook, &desc) != APR_SUCCESS) {
+    return APR_ENOTIMPL;
+  }
+  transport_get_timeout(hook, &tmo);
+  return engine_wait_fd(desc, events, tmo);
+}
+
 /** 
  * call registered transport method
  * @param transport IN hook
@@ -172,7 +220,17 @@ apr_status_t transport_get_timeout(transport_t *hook, apr_interval_time_t *t) {
  */
 apr_status_t transport_read(transport_t *hook, char *buf, apr_size_t *size) {
   if (hook && hook->read) {
-    return hook->read(hook->data, buf, size);
+    apr_size_t len = *size;
+    apr_status_t status;
+
+    while ((status = hook->read(hook->data, buf, size)) == APR_EAGAIN) {
+      if ((status = transport_wait(hook, ENGINE_READ)) != APR_SUCCESS) {
+        *size = 0;
+        return status == APR_ENOTIMPL ? APR_EAGAIN : status;
+      }
+      *size = len;
+    }
+    return status;
   }
   else {
     *size = 0;
@@ -189,10 +247,90 @@ apr_status_t transport_read(transport_t *hook, char *buf, apr_size_t *size) {
  */
 apr_status_t transport_write(transport_t *hook, const char *buf, apr_size_t size) {
   if (hook && hook->write) {
-    return hook->write(hook->data, buf, size);
+    apr_status_t status;
+
+    while ((status = hook->write(hook->data, buf, size)) == APR_EAGAIN) {
+      if ((status = transport_wait(hook, ENGINE_WRITE)) != APR_SUCCESS) {
+        return status == APR_ENOTIMPL ? APR_EAGAIN : status;
+      }
+    }
+    return status;
   }
   else {
     return APR_EGENERAL;
   }
 }
 
+
+/** 
+ * write several buffers, with one call if the transport has a gather
+ * write method, else coalesced in a buffer
+ * @param hook IN transport hook
+ * @param vec IN buffers, may be modified
+ * @param nvec IN number of buffers
+ * @return APR_SUCCESS, APR_NOSOCK if no transport hook or any apr status
+ */
+apr_status_t transport_writev(transport_t *hook, struct iovec *vec, 
+                             apr_int32_t nvec) {
+  apr_status_t status;
+  apr_size_t len = 0;
+  apr_int32_t i;
+
+  if (hook && hook->writev) {
+    while ((status = hook->writev(hook->data, vec, nvec)) == APR_EAGAIN) {
+      if ((status = transport_wait(hook, ENGINE_WRITE)) != APR_SUCCESS) {
+        return status == APR_ENOTIMPL ? APR_EAGAIN : status;
+      }
+    }
+    return status;
+  }
+  if (!hook || !hook->write) {
+    return APR_EGENERAL;
+  }
+
+  if (!hook->buf) {
+    hook->buf = apr_palloc(hook->pool, TRANSPORT_BUF);
+  }
+  for (i = 0; i < nvec; i++) {
+    if (len && len + vec[i].iov_len > TRANSPORT_BUF) {
+      if ((status = transport_write(hook, hook->buf, len)) != APR_SUCCESS) {
+        return status;
+      }
+      len = 0;
+    }
+    if (vec[i].iov_len >= TRANSPORT_BUF) {
+      /* too big to coalesce, no copy */
+      if ((status = transport_write(hook, vec[i].iov_base, vec[i].iov_len)) 
+          != APR_SUCCESS) {
+        return status;
+      }
+    }
+    else {
+      memcpy(hook->buf + len, vec[i].iov_base, vec[i].iov_len);
+      len += vec[i].iov_len;
+    }
+  }
+  if (len) {
+    return transport_write(hook, hook->buf, len);
+  }
+  return APR_SUCCESS;
+}
+
+/** 
+ * send a file region with the sendfile method of the transport
+ * @param hook IN transport hook
+ * @param file IN file to send from
+ * @param offset IN file offset to start from
+ * @param len IN bytes to send
+ * @return APR_SUCCESS, APR_ENOTIMPL if the transport can not send files
+ *         or any apr status
+ */
+apr_status_t transport_sendfile(transport_t *hook, apr_file_t *file,
+                                apr_off_t offset, apr_size_t len) {
+  if (hook && hook->sendfile) {
+    return hook->sendfile(hook->data, file, offset, len);
+  }
+  else {
+    return APR_ENOTIMPL;
+  }
+}
@@ -71,6 +71,27 @@ typedef apr_status_t (*transport_read_f)(void *data, char *buf,
 typedef apr_status_t (*transport_write_f)(void *data, const char *buf, 
                                           apr_size_t size);
 
+/**
+ * optional gather write method, must send all buffers
+ * @param data IN custom data
+ * @param vec IN buffers, may be modified
+ * @param nvec IN number of buffers
+ * @return APR_SUCCESS or any apr status
+ */
+typedef apr_status_t (*transport_writev_f)(void *data, struct iovec *vec, 
+                                           apr_int32_t nvec);
+
+/**
+ * optional method to send a file region without copy, must send all
+ * @param data IN custom data
+ * @param file IN file to send from
+ * @param offset IN file offset to start from
+ * @param len IN bytes to send
+ * @return APR_SUCCESS or any apr status
+ */
+typedef apr_status_t (*transport_sendfile_f)(void *data, apr_file_t *file,
+                                             apr_off_t offset, apr_size_t len);
+
 /**
  * create transport object
  * @param data IN custom data
@@ -86,6 +107,20 @@ transport_t *transport_new(void *data,
                            transport_read_f read, 
 			   transport_write_f write);
 
+/**
+ * set gather write method
+ * @param hook IN transport hook
+ * @param writev IN gather write method
+ */
+void transport_set_writev(transport_t *hook, transport_writev_f writev);
+
+/**
+ * set sendfile method
+ * @param hook IN transport hook
+ * @param sendfile IN sendfile method
+ */
+void transport_set_sendfile(transport_t *hook, transport_sendfile_f sendfile);
+
 /**
  * set new user data
  * @param hook IN transport hook
@@ -143,4 +178,27 @@ apr_status_t transport_read(transport_t *hook, char *buf, apr_size_t *size);
  */
 apr_status_t transport_write(transport_t *hook, const char *buf, apr_size_t size);
 
+/** 
+ * write several buffers, with one call if the transport has a gather
+ * write method, else coalesced in a buffer
+ * @param hook IN transport hook
+ * @param vec IN buffers, may be modified
+ * @param nvec IN number of buffers
+ * @return APR_SUCCESS, APR_NOSOCK if no transport hook or any apr status
+ */
+apr_status_t transport_writev(transport_t *hook, struct iovec *vec, 
+                             apr_int32_t nvec);
+
+/** 
+ * send a file region with the sendfile method of the transport
+ * @param hook IN transport hook
+ * @param file IN file to send from
+ * @param offset IN file offset to start from
+ * @param len IN bytes to send
+ * @return APR_SUCCESS, APR_ENOTIMPL if the transport can not send files
+ *         or any apr status
+ */
+apr_status_t transport_sendfile(transport_t *hook, apr_file_t *file,
+                                apr_off_t offset, apr_size_t len);
+
 #endif
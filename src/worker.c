@@ -58,7 +58,10 @@
 #include "socket.h"
 #include "worker.h"
 #include "module.h"
+#include "dispatch.h"
 #include "eval.h"
+#include "shaper.h"
+#include "tpool.h"
 #include "tcp_module.h"
 
 
@@ -77,6 +80,26 @@ typedef struct tunnel_s {
   socket_t *sendto;
 } tunnel_t;
 
+/* lines gathered into one send */
+#define WORKER_FLUSH_LINES 64
+
+/* smallest window of streamed bodies */
+#define WORKER_WINDOW_MIN 1024
+
+typedef struct stream_s {
+  worker_t *worker;
+  /* rest of the last window followed by the current window */
+  char *buf;
+  apr_size_t size;
+  apr_size_t carry;
+  /* start of the earliest partial match in buf */
+  apr_size_t keep;
+  /* _MATCH and _GREP regexs which matched in this body already */
+  apr_hash_t *matched;
+  /* body ended, the carried rest is checked without partial matching */
+  int end;
+} stream_t;
+
 typedef struct flush_s {
 #define FLUSH_DO_NONE 0
 #define FLUSH_DO_SKIP 1
@@ -362,7 +385,8 @@ static const char * replacer_env_upcall(void *udata, const char *name) {
 }
 
 /**
- * replace variables in a line
+ * replace variables in a line, if the line are the arguments of the op in
+ * execution the variable slots compiled with the program are used
  *
  * @param worker IN thread data object
  * @param line IN line to replace in
@@ -372,11 +396,18 @@ static const char * replacer_env_upcall(void *udata, const char *name) {
 char * worker_replace_vars(worker_t * worker, char *line, int *unresolved,
                            apr_pool_t *ptmp) {
   char *new_line;
+  op_t *op = worker->op;
   replacer_t *upcall_hook = apr_pcalloc(ptmp, sizeof(*upcall_hook));
 
   upcall_hook->worker = worker;
   upcall_hook->ptmp = ptmp;
-  new_line = replacer(ptmp, line, upcall_hook, replacer_env_upcall); 
+  if (op && op->vars && (line == op->args || strcmp(line, op->args) == 0)) {
+    new_line = replacer_template(ptmp, op->vars, upcall_hook, 
+                                 replacer_env_upcall);
+  }
+  else {
+    new_line = replacer(ptmp, line, upcall_hook, replacer_env_upcall); 
+  }
 
   if (unresolved) {
     *unresolved = upcall_hook->unresolved;
@@ -417,7 +448,9 @@ static void * APR_THREAD_FUNC streamer(apr_thread_t * thread, void *selfv) {
   if (APR_STATUS_IS_EOF(status)) {
     status = APR_SUCCESS;
   }
-  apr_thread_exit(thread, APR_SUCCESS);
+  if (thread) {
+    apr_thread_exit(thread, APR_SUCCESS);
+  }
   return NULL;
 }
 
@@ -649,11 +682,14 @@ go_out:
  * @param worker IN thread data object
  * @param htt_regexs IN table of regular expressions to get the values from data
  * @param data IN data to match
+ * @param stream IN streamed body data belongs to or NULL
  *
  * @return APR_SUCCESS
  */
-apr_status_t worker_match(worker_t * worker, apr_table_t * htt_regexs, 
-                          const char *data, apr_size_t len) {
+static apr_status_t worker_match_ex(worker_t * worker, 
+                                    apr_table_t * htt_regexs, 
+                                    const char *data, apr_size_t len,
+                                    stream_t *stream) {
   apr_table_entry_t *e;
   apr_table_entry_t *v;
   regmatch_t regmatch[11];
@@ -677,6 +713,12 @@ apr_status_t worker_match(worker_t * worker, apr_table_t * htt_regexs,
   
   e = (apr_table_entry_t *) apr_table_elts(htt_regexs)->elts;
   for (i = 0; i < apr_table_elts(htt_regexs)->nelts; ++i) {
+    int rc = -1;
+    /* only the first match of a streamed body counts */
+    if (stream && e[i].val && 
+        apr_hash_get(stream->matched, &e[i].val, sizeof(e[i].val))) {
+      continue;
+    }
     /* prepare vars if multiple */
     apr_table_clear(vtbl);
     tmp = apr_pstrdup(pool, e[i].key);
@@ -693,9 +735,22 @@ apr_status_t worker_match(worker_t * worker, apr_table_t * htt_regexs,
       goto error;
     }
     
-    if (e[i].val
-        && htt_regexec((htt_regex_t *) e[i].val, data, len, n + 1, regmatch,
-                   PCRE_MULTILINE) == 0) {
+    if (e[i].val && stream && !stream->end) {
+      apr_size_t partial;
+      rc = htt_regexec_partial((htt_regex_t *) e[i].val, data, len, n + 1, 
+                               regmatch, PCRE_MULTILINE, &partial);
+      if (partial < stream->keep) {
+        stream->keep = partial;
+      }
+      if (rc == 0) {
+        apr_hash_set(stream->matched, &e[i].val, sizeof(e[i].val), e[i].val);
+      }
+    }
+    else if (e[i].val) {
+      rc = htt_regexec((htt_regex_t *) e[i].val, data, len, n + 1, regmatch,
+                       PCRE_MULTILINE);
+    }
+    if (rc == 0) {
       v = (apr_table_entry_t *) apr_table_elts(vtbl)->elts;
       for (j = 0; j < n; j++) {
 	val =
@@ -722,17 +777,34 @@ error:
   return status;
 }
 
+/**
+ * gets values from data and store it in the variable table
+ *
+ * @param worker IN thread data object
+ * @param htt_regexs IN table of regular expressions to get the values from data
+ * @param data IN data to match
+ *
+ * @return APR_SUCCESS
+ */
+apr_status_t worker_match(worker_t * worker, apr_table_t * htt_regexs, 
+                          const char *data, apr_size_t len) {
+  return worker_match_ex(worker, htt_regexs, data, len, NULL);
+}
+
 /**
  * checks if data contains a given pattern
  *
  * @param self IN thread data object
  * @param htt_regexs IN table of regular expressions
  * @param data IN data to check
+ * @param stream IN streamed body data belongs to or NULL
  *
  * @return APR_SUCCESS
  */
-apr_status_t worker_expect(worker_t * self, apr_table_t * htt_regexs, 
-                           const char *data, apr_size_t len) {
+static apr_status_t worker_expect_ex(worker_t * self, 
+                                     apr_table_t * htt_regexs, 
+                                     const char *data, apr_size_t len,
+                                     stream_t *stream) {
   apr_table_entry_t *e;
   int i;
 
@@ -742,7 +814,15 @@ apr_status_t worker_expect(worker_t * self, apr_table_t * htt_regexs,
 
   e = (apr_table_entry_t *) apr_table_elts(htt_regexs)->elts;
   for (i = 0; i < apr_table_elts(htt_regexs)->nelts; ++i) {
-    if (e[i].val
+    if (e[i].val && stream && !stream->end) {
+      apr_size_t partial;
+      htt_regexec_partial((htt_regex_t *) e[i].val, data, len, 0, NULL,
+                          PCRE_MULTILINE, &partial);
+      if (partial < stream->keep) {
+        stream->keep = partial;
+      }
+    }
+    else if (e[i].val
         && htt_regexec((htt_regex_t *) e[i].val, data, len, 0, NULL,
                    PCRE_MULTILINE) == 0) {
     }
@@ -751,6 +831,20 @@ apr_status_t worker_expect(worker_t * self, apr_table_t * htt_regexs,
   return APR_SUCCESS;
 }
 
+/**
+ * checks if data contains a given pattern
+ *
+ * @param self IN thread data object
+ * @param htt_regexs IN table of regular expressions
+ * @param data IN data to check
+ *
+ * @return APR_SUCCESS
+ */
+apr_status_t worker_expect(worker_t * self, apr_table_t * htt_regexs, 
+                           const char *data, apr_size_t len) {
+  return worker_expect_ex(self, htt_regexs, data, len, NULL);
+}
+
 /**
  * Throws assertions if specified match did have noch hit.
  * @param worker IN
@@ -1144,6 +1238,78 @@ apr_status_t worker_handle_buf(worker_t *worker, apr_pool_t *pool, char *buf,
   return status;
 }
 
+/**
+ * Handle a window of a streamed body as worker_handle_buf does a whole 
+ * body. Regexs see the window behind the rest of the last window where a
+ * partial match started, so matches may span windows up to a window size.
+ *
+ * @param data IN stream object
+ * @param buf IN window
+ * @param len IN window length
+ *
+ * @return apr status
+ */
+static apr_status_t worker_stream_window(void *data, char *buf, 
+                                         apr_size_t len) {
+  stream_t *stream = data;
+  worker_t *worker = stream->worker;
+  apr_size_t text;
+  apr_status_t status;
+
+  if ((status = htt_run_read_buf(worker, buf, len)) != APR_SUCCESS) {
+    return status;
+  }
+  worker_buf_convert(worker, &buf, &len);
+  worker_log_buf(worker, LOG_INFO, '<', buf, len);
+
+  memcpy(&stream->buf[stream->carry], buf, len);
+  text = stream->carry + len;
+  stream->keep = text;
+  worker_match_ex(worker, worker->match.dot, stream->buf, text, stream);
+  worker_match_ex(worker, worker->match.body, stream->buf, text, stream);
+  worker_match_ex(worker, worker->grep.dot, stream->buf, text, stream);
+  worker_match_ex(worker, worker->grep.body, stream->buf, text, stream);
+  worker_expect_ex(worker, worker->expect.dot, stream->buf, text, stream);
+  worker_expect_ex(worker, worker->expect.body, stream->buf, text, stream);
+
+  /* carry the rest a partial match started in, at most a window */
+  if (text - stream->keep > stream->size) {
+    stream->keep = text - stream->size;
+  }
+  stream->carry = text - stream->keep;
+  memmove(stream->buf, &stream->buf[stream->keep], stream->carry);
+
+  return APR_SUCCESS;
+}
+
+/**
+ * Check the rest carried after the last window once more without partial
+ * matching, a match touching the end of the body is only partial before.
+ *
+ * @param stream IN stream object
+ */
+static void worker_stream_end(stream_t *stream) {
+  worker_t *worker = stream->worker;
+
+  if (!stream->carry) {
+    return;
+  }
+  stream->end = 1;
+  worker_match_ex(worker, worker->match.dot, stream->buf, stream->carry, 
+                  stream);
+  worker_match_ex(worker, worker->match.body, stream->buf, stream->carry, 
+                  stream);
+  worker_match_ex(worker, worker->grep.dot, stream->buf, stream->carry, 
+                  stream);
+  worker_match_ex(worker, worker->grep.body, stream->buf, stream->carry, 
+                  stream);
+  worker_expect_ex(worker, worker->expect.dot, stream->buf, stream->carry, 
+                   stream);
+  worker_expect_ex(worker, worker->expect.body, stream->buf, stream->carry, 
+                   stream);
+  stream->carry = 0;
+}
+
 /**
  * Store all cookies in the header table of worker in a cookie line
  *
@@ -1218,6 +1384,80 @@ const char *worker_get_value_from_param(worker_t *worker, const char *param, apr
   return val;
 }
 
+/**
+ * Get a cleared pool for a new call frame
+ *
+ * @param worker IN thread data object
+ *
+ * @return frame pool
+ */
+static apr_pool_t *worker_frame_push(worker_t *worker) {
+  frames_t *frames = worker->frames;
+  apr_pool_t *pool;
+
+  if (frames->depth == frames->pools->nelts) {
+    apr_pool_create(&pool, frames->pool);
+    APR_ARRAY_PUSH(frames->pools, apr_pool_t *) = pool;
+  }
+  pool = APR_ARRAY_IDX(frames->pools, frames->depth, apr_pool_t *);
+  ++frames->depth;
+
+  return pool;
+}
+
+/**
+ * Release the current call frame, the pool is kept for the next call
+ *
+ * @param worker IN thread data object
+ */
+static void worker_frame_pop(worker_t *worker) {
+  frames_t *frames = worker->frames;
+
+  --frames->depth;
+  apr_pool_clear(APR_ARRAY_IDX(frames->pools, frames->depth, apr_pool_t *));
+}
+
+/**
+ * Get the dispatch index of a worker, a worker started by START keeps the
+ * index built by this START, the index of global can be replaced by the
+ * next START while the worker runs
+ *
+ * @param worker IN thread data object
+ *
+ * @return dispatch index
+ */
+struct dispatch_s *worker_get_dispatch(worker_t *worker) {
+  return worker->dispatch ? worker->dispatch : worker->global->dispatch;
+}
+
+/**
+ * Lookup a block in a blocks hash, read the snapshot of the dispatch index
+ * if there is one, this needs no lock, a name not in the snapshot is no 
+ * block. Block hashes of modules defined after the last START are only 
+ * live, which the parser may still write, so they are read under the 
+ * global mutex.
+ *
+ * @param worker IN thread data object
+ * @param blocks IN blocks hash
+ * @param name IN block name
+ * @param len IN length of name or APR_HASH_KEY_STRING
+ *
+ * @return block or NULL
+ */
+worker_t *worker_get_block(worker_t *worker, apr_hash_t *blocks, 
+                           const char *name, apr_ssize_t len) {
+  worker_t *block;
+
+  if (dispatch_get_local_block(worker_get_dispatch(worker), blocks, name, 
+                               len, &block) != APR_SUCCESS) {
+    /* defined after last START */
+    lock(worker->mutex);
+    block = apr_hash_get(blocks, name, len);
+    unlock(worker->mutex);
+  }
+  return block;
+}
+
 /**
  * CALL command calls a defined block
  *
@@ -1233,9 +1473,20 @@ apr_status_t command_CALL(command_t *self, worker_t *worker, char *data,
   char *copy;
   const char *block_name;
   char *last;
-  worker_t *block, *call;
-  apr_table_t *lines = NULL;
+  worker_t *block;
+  worker_t *caller_block;
+  store_t *caller_params;
+  store_t *caller_retvars;
+  store_t *caller_locals;
+  apr_table_t *lines;
+  program_t *program;
   int cmd;
+  int log_mode; 
+  int i;
+  int j;
+  char *index;
+  const char *arg;
+  const char *val;
   apr_pool_t *call_pool;
   char *module;
   apr_hash_t *blocks;
@@ -1243,8 +1494,8 @@ apr_status_t command_CALL(command_t *self, worker_t *worker, char *data,
   store_t *retvars;
   store_t *locals;
 
-  /** a pool for this call */
-  HT_POOL_CREATE(&call_pool);
+  /** a frame for this call */
+  call_pool = worker_frame_push(worker);
 
   /** temporary tables for param, local vars and return vars */
   params = store_make(call_pool);
@@ -1262,7 +1513,14 @@ apr_status_t command_CALL(command_t *self, worker_t *worker, char *data,
   module = apr_pstrdup(call_pool, block_name);
 
   /** get module worker */
-  if ((last = strchr(block_name, ':'))) {
+  block = NULL;
+  blocks = NULL;
+  if (strchr(block_name, ':') && 
+      (block = dispatch_get_block(worker_get_dispatch(worker), block_name, 
+                                  APR_HASH_KEY_STRING))) {
+    /* module block found in dispatch index */
+  }
+  else if ((last = strchr(block_name, ':'))) {
     module = apr_strtok(module, ":", &last);
     if (*module == '_') {
       module++;
@@ -1273,7 +1531,8 @@ apr_status_t command_CALL(command_t *self, worker_t *worker, char *data,
     }
     if (!(blocks = apr_hash_get(worker->modules, module, APR_HASH_KEY_STRING))) {
       worker_log(worker, LOG_ERR, "Could not find module \"%s\"", module);
-      return APR_EINVAL;
+      status = APR_EINVAL;
+      goto error;
     }
   }
   else {
@@ -1281,127 +1540,105 @@ apr_status_t command_CALL(command_t *self, worker_t *worker, char *data,
   }
 
   /** get block from module */
-  /* CR BEGIN */
-  apr_thread_mutex_lock(worker->mutex);
-  if (!(block = apr_hash_get(blocks, block_name, APR_HASH_KEY_STRING))) {
+  if (!block && 
+      !(block = worker_get_block(worker, blocks, block_name, 
+                                 APR_HASH_KEY_STRING))) {
     worker_log(worker, LOG_ERR, "Could not find block %s", block_name);
-    /* CR END */
-    apr_thread_mutex_unlock(worker->mutex);
     status = APR_ENOENT;
     goto error;
   }
-  else { 
-    int log_mode; 
-    int i;
-    int j;
-    char *index;
-    const char *arg;
-    const char *val;
-    char *all = "";
-
-    /** prepare call */
-    /* iterate over indexed params and resolve VAR(foo) stuff*/
-    for (i = 1; i < store_get_size(params); i++) {
-      index = apr_itoa(ptmp, i);
-      if ((val = store_get(params, index))) {
-        val = worker_get_value_from_param(worker, val, ptmp);
-        store_set(params, index, val);
-      }
-    }
 
-    for (i = 1; i < store_get_size(params); i++) {
-      index = apr_itoa(ptmp, i);
-      if ((val = store_get(params, index))) {
-        all = apr_pstrcat(ptmp, all, val, " ", NULL);
-      }
+  /** prepare call */
+  /* blocks are not modified after load, no lock needed to read them */
+  /* iterate over indexed params and resolve VAR(foo) stuff*/
+  for (i = 1; i < store_get_size(params); i++) {
+    index = apr_itoa(call_pool, i);
+    if ((val = store_get(params, index))) {
+      val = worker_get_value_from_param(worker, val, call_pool);
+      store_set(params, index, val);
     }
+  }
 
-    /* handle parameters first */
-    for (i = 1; i < store_get_size(block->params); i++) {
-      index = apr_itoa(ptmp, i);
-      if (!(arg = store_get(block->params, index))) {
-        worker_log(worker, LOG_ERR, "Param missmatch for block \"%s\"", block->name);
-        apr_thread_mutex_unlock(worker->mutex);
-        status = APR_EGENERAL;
-        goto error;
-      }
-      if (!(val = store_get(params, index))) {
-        worker_log(worker, LOG_ERR, "Param missmatch for block \"%s\"", block->name);
-        apr_thread_mutex_unlock(worker->mutex);
-        status = APR_EGENERAL;
-        goto error;
-      }
-      if (arg && val) {
-        val = worker_get_value_from_param(worker, val, ptmp);
-        store_set(params, arg, val);
-      }
+  /* handle parameters first */
+  for (i = 1; i < store_get_size(block->params); i++) {
+    index = apr_itoa(call_pool, i);
+    if (!(arg = store_get(block->params, index))) {
+      worker_log(worker, LOG_ERR, "Param missmatch for block \"%s\"", block->name);
+      status = APR_EGENERAL;
+      goto error;
     }
-
-    /* handle return variables second */
-    j = i;
-    for (i = 0; i < store_get_size(block->retvars); i++, j++) {
-      index = apr_itoa(call_pool, j);
-      if (!(arg = store_get(block->retvars, index))) {
-        worker_log(worker, LOG_ERR, "Return variables missmatch for block \"%s\"", block->name);
-        apr_thread_mutex_unlock(worker->mutex);
-        status = APR_EGENERAL;
-        goto error;
-      }
-      if (!(val = store_get(params, index))) {
-        worker_log(worker, LOG_ERR, "Return variables missmatch for block \"%s\"", block->name);
-        apr_thread_mutex_unlock(worker->mutex);
-        status = APR_EGENERAL;
-        goto error;
-      }
-      if (arg && val) {
-        store_set(retvars, arg, val);
-      }
+    if (!(val = store_get(params, index))) {
+      worker_log(worker, LOG_ERR, "Param missmatch for block \"%s\"", block->name);
+      status = APR_EGENERAL;
+      goto error;
+    }
+    if (arg && val) {
+      val = worker_get_value_from_param(worker, val, call_pool);
+      store_set(params, arg, val);
     }
+  }
 
-    if (block->lines) {
-      lines = my_table_deep_copy(call_pool, block->lines);
+  /* handle return variables second */
+  j = i;
+  for (i = 0; i < store_get_size(block->retvars); i++, j++) {
+    index = apr_itoa(call_pool, j);
+    if (!(arg = store_get(block->retvars, index))) {
+      worker_log(worker, LOG_ERR, "Return variables missmatch for block \"%s\"", block->name);
+      status = APR_EGENERAL;
+      goto error;
     }
-    else {
-      lines = worker->lines; 
+    if (!(val = store_get(params, index))) {
+      worker_log(worker, LOG_ERR, "Return variables missmatch for block \"%s\"", block->name);
+      status = APR_EGENERAL;
+      goto error;
     }
-    apr_thread_mutex_unlock(worker->mutex);
-    /* CR END */
-
-    call = apr_pcalloc(call_pool, sizeof(*call));
-    memcpy(call, worker, sizeof(*call));
-    call->block = block;
-    call->params = params;
-    call->retvars = retvars;
-    call->locals = locals;
-    call->lines = lines;
-    log_mode = logger_get_mode(call->logger);
-    if (log_mode == LOG_CMD) {
-      logger_set_mode(call->logger, LOG_INFO);
-    }
-    status = block->interpret(call, worker, call_pool);
-
-    /** get infos from call back to worker */
-    logger_set_mode(call->logger, log_mode);
-    cmd = worker->cmd;
-    lines = worker->lines;
-    params = worker->params;
-    retvars = worker->retvars;
-    locals = worker->locals;
-    memcpy(worker, call, sizeof(*worker));
-    store_merge(worker->vars, call->retvars); 
-    worker->params = params;
-    worker->retvars = retvars;
-    worker->locals = locals;
-    worker->lines = lines;
-    worker->cmd = cmd;
-    worker->block = NULL;
-
-    goto error;
-  }
+    if (arg && val) {
+      store_set(retvars, arg, val);
+    }
+  }
+
+  /* save the callers frame, the call runs in place on this worker */
+  cmd = worker->cmd;
+  lines = worker->lines;
+  program = worker->program;
+  caller_block = worker->block;
+  caller_params = worker->params;
+  caller_retvars = worker->retvars;
+  caller_locals = worker->locals;
+
+  if (block->lines && block->program) {
+    /* compiled at load time, lines are shared read only */
+    worker->lines = block->lines;
+    worker->program = block->program;
+  }
+  else if (block->lines) {
+    worker->lines = my_table_deep_copy(call_pool, block->lines);
+    worker->program = NULL;
+  }
+  worker->block = block;
+  worker->params = params;
+  worker->retvars = retvars;
+  worker->locals = locals;
+  log_mode = logger_get_mode(worker->logger);
+  if (log_mode == LOG_CMD) {
+    logger_set_mode(worker->logger, LOG_INFO);
+  }
+  status = block->interpret(worker, worker, call_pool);
+
+  /** restore callers frame */
+  logger_set_mode(worker->logger, log_mode);
+  store_merge(worker->vars, retvars); 
+  worker->params = caller_params;
+  worker->retvars = caller_retvars;
+  worker->locals = caller_locals;
+  worker->lines = lines;
+  worker->program = program;
+  worker->cmd = cmd;
+  worker->block = caller_block;
 
 error:
   /** all ends here */
-  apr_pool_destroy(call_pool);
+  worker_frame_pop(worker);
   return status;
 }
  
@@ -1519,6 +1756,8 @@ apr_status_t command_WAIT(command_t * self, worker_t * worker,
   apr_size_t len;
   apr_ssize_t recv_len = -1;
   apr_size_t peeklen;
+  stream_t *stream = NULL;
+  sockreader_t *streaming = NULL;
 
   recorder_t *recorder = worker_get_recorder(worker);
   buf = NULL;
@@ -1602,6 +1841,7 @@ apr_status_t command_WAIT(command_t * self, worker_t * worker,
   while ((status = sockreader_read_line(sockreader, &line)) == APR_SUCCESS && 
       line[0] == 0);
   if (line[0] != 0) { 
+    htt_run_phase(worker, PHASE_FIRST_BYTE);
     if ((status = htt_run_read_status_line(worker, line)) != APR_SUCCESS) {
       goto out_err;
     }
@@ -1636,6 +1876,21 @@ apr_status_t command_WAIT(command_t * self, worker_t * worker,
 http_0_9:
   if (status == APR_SUCCESS) {
     int doreadtrailing = 0;
+    /* stream the body if nothing needs it as a whole */
+    if (worker->window && !var && 
+        !(worker->flags & (FLAGS_PIPE_IN | FLAGS_FILTER | FLAGS_PRINT_HEX |
+                           FLAGS_IGNORE_BODY)) &&
+        !(recorder->on == RECORDER_RECORD && 
+          recorder->flags & RECORDER_RECORD_BODY)) {
+      stream = apr_pcalloc(ptmp, sizeof(*stream));
+      stream->worker = worker;
+      stream->size = worker->window;
+      stream->buf = apr_palloc(ptmp, 2 * worker->window);
+      stream->matched = apr_hash_make(ptmp);
+      sockreader_set_window(sockreader, worker->window, worker_stream_window,
+                            stream);
+      streaming = sockreader;
+    }
     /* if recv len is specified use this */
     if (recv_len > 0) {
       len = recv_len;
@@ -1678,11 +1933,21 @@ http_0_9:
         goto out_err;
       }
     }
-    if ((status = htt_run_read_buf(worker, buf, len)) != APR_SUCCESS) {
-      goto out_err;
+    if (streaming) {
+      /* windows went through read_buf, _MATCH and _EXPECT while read */
+      sockreader_set_window(streaming, 0, NULL, NULL);
+      streaming = NULL;
+      worker_stream_end(stream);
     }
-    if ((status = worker_handle_buf(worker, ptmp, buf, len)) != APR_SUCCESS) {
-      goto out_err;
+    htt_run_phase(worker, PHASE_BODY_END);
+    if (!stream) {
+      if ((status = htt_run_read_buf(worker, buf, len)) != APR_SUCCESS) {
+        goto out_err;
+      }
+      if ((status = worker_handle_buf(worker, ptmp, buf, len)) 
+          != APR_SUCCESS) {
+        goto out_err;
+      }
     }
     if (recorder->on == RECORDER_RECORD && 
         recorder->flags & RECORDER_RECORD_BODY) {
@@ -1692,6 +1957,8 @@ http_0_9:
     if (var) {
       worker_var_set_and_zero_terminate(worker, var, buf, len);
     }
+    /* body is handled, keep memory flat on keep-alive connections */
+    sockreader_release(sockreader);
     if (doreadtrailing) {
       /* read trailing headers */
       if ((status = worker_get_headers(worker, sockreader)) != APR_SUCCESS) {
@@ -1712,6 +1979,9 @@ http_0_9:
   }
 
 out_err:
+  if (streaming) {
+    sockreader_set_window(streaming, 0, NULL, NULL);
+  }
   if (recorder->on == RECORDER_PLAY) {
     sockreader_destroy(&recorder->sockreader);
     recorder->on = RECORDER_OFF;
@@ -2000,6 +2270,64 @@ apr_status_t command_TIMEOUT(command_t * self, worker_t * worker,
   return APR_SUCCESS;
 }
 
+/**
+ * Limit bandwidth of sent data with a token bucket
+ *
+ * @param self IN command object
+ * @param worker IN thread data object
+ * @param data IN CONN|WORKER|GLOBAL <bytes/s> [<burst>]
+ *
+ * @return an apr status
+ */
+apr_status_t command_THROTTLE(command_t * self, worker_t * worker,
+                              char *data, apr_pool_t *ptmp) {
+  char *copy;
+  char **argv;
+  apr_size_t rate;
+  apr_size_t burst;
+  global_t *global = worker->global;
+
+  COMMAND_NEED_ARG("CONN|WORKER|GLOBAL <bytes/s> [<burst>]");
+
+  my_tokenize_to_argv(copy, &argv, ptmp, 0);
+  if (!argv[0] || !argv[1]) {
+    worker_log(worker, LOG_ERR, "Need scope and bytes per second");
+    return APR_EGENERAL;
+  }
+  rate = apr_atoi64(argv[1]);
+  burst = argv[2] ? apr_atoi64(argv[2]) : 0;
+
+  if (strcmp(argv[0], "CONN") == 0) {
+    worker->conn_rate = rate;
+    worker->conn_burst = burst;
+    if (worker->socket) {
+      worker->socket->shaper = rate ? 
+        shaper_new(worker->pbody, rate, burst, 0) : NULL;
+    }
+  }
+  else if (strcmp(argv[0], "WORKER") == 0) {
+    worker->shaper = rate ? shaper_new(worker->pbody, rate, burst, 0) : NULL;
+  }
+  else if (strcmp(argv[0], "GLOBAL") == 0) {
+    /* created once and changed later on, other workers may use it now */
+    lock(global->mutex);
+    if (global->shaper) {
+      shaper_set_rate(global->shaper, rate, burst);
+    }
+    else if (rate) {
+      global->shaper = shaper_new(global->pool, rate, burst, 1);
+    }
+    unlock(global->mutex);
+  }
+  else {
+    worker_log(worker, LOG_ERR, "Unknown scope \"%s\", need CONN, WORKER or "
+               "GLOBAL", argv[0]);
+    return APR_EGENERAL;
+  }
+
+  return APR_SUCCESS;
+}
+
 /**
  * Define an expect
  *
@@ -2057,7 +2385,7 @@ apr_status_t command_EXPECT(command_t * self, worker_t * worker,
     ++interm;
   }
   
-  if (!(compiled = htt_regexcomp(pool, interm, &err, &off))) {
+  if (!(compiled = htt_regexcomp_cached(pool, interm, 0, &err, &off))) {
     worker_log(worker, LOG_ERR, "EXPECT regcomp failed: \"%s\"", last);
     return APR_EINVAL;
   }
@@ -2166,7 +2494,7 @@ apr_status_t command_MATCH(command_t * self, worker_t * worker,
     return APR_EINVAL;
   }
 
-  if (!(compiled = htt_regexcomp(pool, match, &err, &off))) {
+  if (!(compiled = htt_regexcomp_cached(pool, match, 0, &err, &off))) {
     worker_log(worker, LOG_ERR, "MATCH regcomp failed: %s", last);
     return APR_EINVAL;
   }
@@ -2273,7 +2601,7 @@ apr_status_t command_GREP(command_t * self, worker_t * worker,
     return APR_EINVAL;
   }
 
-  if (!(compiled = htt_regexcomp(pool, grep, &err, &off))) {
+  if (!(compiled = htt_regexcomp_cached(pool, grep, 0, &err, &off))) {
     worker_log(worker, LOG_ERR, "MATCH regcomp failed: %s", last);
     return APR_EINVAL;
   }
@@ -2829,7 +3157,8 @@ exit:
 }
 
 /**
- * Send file
+ * Send file, if not chunked only the file name and size is cached and the
+ * file is sent on flush without reading it into memory
  *
  * @param self IN command object
  * @param worker IN thread data object
@@ -2844,6 +3173,7 @@ apr_status_t command_SENDFILE(command_t * self, worker_t * worker,
   apr_status_t status;
   int flags;
   apr_file_t *fp;
+  apr_finfo_t finfo;
   int i;
 
   COMMAND_NEED_ARG("Need a file name");
@@ -2862,9 +3192,23 @@ apr_status_t command_SENDFILE(command_t * self, worker_t * worker,
       return APR_ENOENT;
     }
     
-    if ((status = worker_file_to_http(worker, fp, flags, ptmp)) 
-                                != APR_SUCCESS) {
-      return status;
+    if (flags & FLAGS_CHUNKED) {
+      if ((status = worker_file_to_http(worker, fp, flags, ptmp)) 
+                                  != APR_SUCCESS) {
+        return status;
+      }
+    }
+    else {
+      if ((status = apr_file_info_get(&finfo, APR_FINFO_SIZE, fp)) 
+          != APR_SUCCESS) {
+        worker_log(worker, LOG_ERR, "\nCan not send file: No size of \"%s\"", 
+                   argv[i]);
+        return status;
+      }
+      apr_table_addn(worker->cache, 
+                     apr_psprintf(worker->pcache, "NOCRLF:%"APR_OFF_T_FMT";file",
+                                  finfo.size), 
+                     apr_pstrdup(worker->pcache, argv[i]));
     }
 
     apr_file_close(fp);
@@ -3222,6 +3566,7 @@ apr_status_t command_RECV(command_t *self, worker_t *worker, char *data,
       != APR_SUCCESS) {
     goto out_err;
   }
+  sockreader_release(sockreader);
 
 out_err:
   if (strcasecmp(last, "DO_NOT_CHECK") != 0) {
@@ -3487,9 +3832,7 @@ apr_status_t command_ADD_HEADER(command_t *self, worker_t *worker, char *data,
 apr_status_t command_TUNNEL(command_t *self, worker_t *worker, char *data, 
                             apr_pool_t *ptmp) {
   apr_status_t status;
-  apr_threadattr_t *tattr;
-  apr_thread_t *client_thread;
-  apr_thread_t *backend_thread;
+  tpool_task_t *client_task;
   tunnel_t client;
   tunnel_t backend;
   apr_size_t peeklen;
@@ -3540,38 +3883,14 @@ apr_status_t command_TUNNEL(command_t *self, worker_t *worker, char *data,
   }
   client.sendto = worker->socket;
 
-  /* need two threads reading/writing from/to backend */
-  if ((status = apr_threadattr_create(&tattr, worker->pbody)) != APR_SUCCESS) {
-    goto error2;
-  }
-
-  if ((status = apr_threadattr_stacksize_set(tattr, DEFAULT_THREAD_STACKSIZE))
-      != APR_SUCCESS) {
-    goto error2;
-  }
-
-  if ((status = apr_threadattr_detach_set(tattr, 0)) != APR_SUCCESS) {
-    goto error2;
-  }
-
-  if ((status = apr_thread_create(&client_thread, tattr, streamer, 
-	                          &client, worker->pbody)) != APR_SUCCESS) {
-    goto error2;
-  }
-
-  if ((status = apr_thread_create(&backend_thread, tattr, streamer, 
-	                          &backend, worker->pbody)) != APR_SUCCESS) {
-    goto error2;
-  }
-
-  apr_thread_join(&status, client_thread);
-  if (status != APR_SUCCESS) {
-    goto error2;
-  }
-  apr_thread_join(&status, backend_thread);
-  if (status != APR_SUCCESS) {
+  /* the client side streams on a pool thread, the backend side on ours,
+   * so there is no second task which could fail to start */
+  if ((status = tpool_push(worker->global->tpool, streamer, &client, 
+                           &client_task)) != APR_SUCCESS) {
     goto error2;
   }
+  streamer(NULL, &backend);
+  tpool_join(client_task);
 
 error2:
   command_CLOSE(self, worker, "do not test expects", ptmp);
@@ -3820,6 +4139,36 @@ apr_status_t command_IGNORE_BODY(command_t *self, worker_t *worker, char *data,
   return APR_SUCCESS;
 }
 
+/**
+ * STREAM_WINDOW command
+ *
+ * @param self IN command
+ * @param worker IN thread data object
+ * @param data IN window size in bytes or off
+ *
+ * @return APR_SUCCESS or apr error code
+ */
+apr_status_t command_STREAM_WINDOW(command_t *self, worker_t *worker, 
+                                   char *data, apr_pool_t *ptmp) {
+  char *copy;
+  apr_int64_t window;
+  COMMAND_NEED_ARG("<bytes>|off, default off");
+
+  apr_collapse_spaces(copy, copy);
+  if (strcasecmp(copy, "off") == 0) {
+    worker->window = 0;
+    return APR_SUCCESS;
+  }
+  window = apr_atoi64(copy);
+  if (!apr_isdigit(copy[0]) || window < WORKER_WINDOW_MIN) {
+    worker_log(worker, LOG_ERR, "Window \"%s\" must be at least %d bytes", 
+               copy, WORKER_WINDOW_MIN);
+    return APR_EINVAL;
+  }
+  worker->window = window;
+  return APR_SUCCESS;
+}
+
 /**
  * VERSION command
  *
@@ -3907,8 +4256,13 @@ void worker_new(worker_t ** self, char *additional, global_t *global,
     (*self)->params = store_make(p);
     (*self)->retvars = store_make(p);
     (*self)->locals = store_make(p);
+    (*self)->frames = apr_pcalloc(p, sizeof(frames_t));
+    (*self)->frames->pool = (*self)->heartbeat;
+    (*self)->frames->pools = apr_array_make(p, 4, sizeof(apr_pool_t *));
     (*self)->vars = store_copy(global->vars, p);
-    (*self)->modules = apr_hash_copy(p, global->modules);
+    /* the parser may still add modules, START gives workers the snapshot
+     * of its dispatch index */
+    (*self)->modules = global->modules;
     (*self)->blocks = global->blocks;
     (*self)->logger = global->logger;
     (*self)->flags = global->flags;
@@ -3934,6 +4288,7 @@ void worker_new(worker_t ** self, char *additional, global_t *global,
  */
 void worker_clone(worker_t ** self, worker_t * orig) {
   global_t *global = orig->global;
+  apr_time_t start = apr_time_now();
   
   worker_new(self, orig->additional, global, orig->interpret);
   
@@ -3942,8 +4297,15 @@ void worker_clone(worker_t ** self, worker_t * orig) {
     apr_pool_t *p;
     p = (*self)->pbody;
     (*self)->flags = orig->flags;
-    (*self)->lines = my_table_deep_copy(p, orig->lines);
+    /* lines are read only after parsing, share them and the program
+     * compiled from them, see global_END */
+    (*self)->lines = orig->lines;
+    if (orig->program && orig->program->lines == orig->lines) {
+      (*self)->program = orig->program;
+    }
     (*self)->listener = NULL;
+    (*self)->dispatch = orig->dispatch;
+    (*self)->modules = orig->modules;
     (*self)->vars = store_copy(orig->vars, p);
     (*self)->listener_addr = apr_pstrdup(p, orig->listener_addr);
     (*self)->group = orig->group;
@@ -3951,6 +4313,8 @@ void worker_clone(worker_t ** self, worker_t * orig) {
     worker_log((*self), LOG_DEBUG, 
                "worker_clone: pool: %"APR_UINT64_T_HEX_FMT", pbody: %"APR_UINT64_T_HEX_FMT, 
                (*self)->pbody, (*self)->pbody);
+    ++global->clones;
+    global->clone_time += apr_time_now() - start;
   }
   if (global->mutex) apr_thread_mutex_unlock(global->mutex);
 }
@@ -3992,11 +4356,92 @@ apr_status_t worker_add_line(worker_t * worker, const char *file_and_line,
  */
 apr_status_t worker_socket_send(worker_t *worker, char *buf, 
                                 apr_size_t len) {
+  shaper_t *shapers[3];
+  int n = 0;
+  socket_t *socket = worker->socket;
 
   worker_log(worker, LOG_DEBUG, 
              "send socket: %"APR_UINT64_T_HEX_FMT" transport: %"APR_UINT64_T_HEX_FMT, 
              worker->socket, worker->socket->transport);
-  return transport_write(worker->socket->transport, buf, len);
+
+  if (worker->conn_rate && !socket->shaper) {
+    socket->shaper = shaper_new(worker->pbody, worker->conn_rate, 
+                                worker->conn_burst, 0);
+  }
+  if (socket->shaper) {
+    shapers[n++] = socket->shaper;
+  }
+  if (worker->shaper) {
+    shapers[n++] = worker->shaper;
+  }
+  if (worker->global->shaper) {
+    shapers[n++] = worker->global->shaper;
+  }
+  if (!n) {
+    return transport_write(socket->transport, buf, len);
+  }
+
+  /* send in chunks the buckets grant */
+  while (len) {
+    apr_status_t status;
+    apr_interval_time_t wait;
+    apr_size_t chunk = len;
+    shaper_t *shaper;
+    int i;
+
+    for (i = 0; i < n; i++) {
+      for (shaper = shapers[i]; shaper; shaper = shaper_get_next(shaper)) {
+        if (shaper_get_burst(shaper) < chunk) {
+          chunk = shaper_get_burst(shaper);
+        }
+      }
+    }
+    for (i = 0; i < n; i++) {
+      for (shaper = shapers[i]; shaper; shaper = shaper_get_next(shaper)) {
+        while ((wait = shaper_take(shaper, chunk))) {
+          engine_sleep(wait);
+        }
+      }
+    }
+    if ((status = transport_write(socket->transport, buf, chunk)) 
+        != APR_SUCCESS) {
+      return status;
+    }
+    buf += chunk;
+    len -= chunk;
+  }
+  return APR_SUCCESS;
+}
+
+/**
+ * Send several buffers, with one call if nothing shapes the bandwidth
+ * 
+ * @param worker IN thread data object
+ * @param vec IN buffers, may be modified
+ * @param nvec IN number of buffers
+ *
+ * @return apr status
+ */
+static apr_status_t worker_socket_sendv(worker_t *worker, struct iovec *vec,
+                                        apr_int32_t nvec) {
+  apr_status_t status;
+  apr_int32_t i;
+
+  if (worker->conn_rate || worker->socket->shaper || worker->shaper || 
+      worker->global->shaper) {
+    /* shapers grant bytes per buffer */
+    for (i = 0; i < nvec; i++) {
+      if ((status = worker_socket_send(worker, vec[i].iov_base, 
+                                       vec[i].iov_len)) != APR_SUCCESS) {
+        return status;
+      }
+    }
+    return APR_SUCCESS;
+  }
+  worker_log(worker, LOG_DEBUG, 
+             "sendv socket: %"APR_UINT64_T_HEX_FMT" transport: %"APR_UINT64_T_HEX_FMT, 
+             worker->socket, worker->socket->transport);
+  return transport_writev(worker->socket->transport, vec, nvec);
 }
 
 /**
@@ -4057,29 +4502,124 @@ apr_status_t worker_get_line_length(worker_t *worker,
 }
 
 /**
- * flush partial data 
+ * Send a file cached by _SENDFILE, with the sendfile method of the
+ * transport if nothing shapes the bandwidth and the body is not logged,
+ * else read and write it through one reused buffer
  *
  * @param worker IN worker object
+ * @param path IN file name
+ * @param len IN file size at _SENDFILE
+ * @param dir IN log direction '>' or '+'
+ * @param ptmp IN temporary pool
+ *
+ * @return an apr status
+ */
+static apr_status_t worker_sendfile(worker_t *worker, const char *path,
+                                    apr_size_t len, char dir, 
+                                    apr_pool_t *ptmp) {
+  apr_status_t status;
+  apr_file_t *fp;
+  apr_size_t block;
+  char *buf;
+
+  if ((status = apr_file_open(&fp, path, APR_READ, APR_OS_DEFAULT, ptmp)) 
+      != APR_SUCCESS) {
+    worker_log(worker, LOG_ERR, "Can not send file \"%s\"", path);
+    return status;
+  }
+
+  if (!worker->conn_rate && !worker->socket->shaper && !worker->shaper &&
+      !worker->global->shaper && 
+      logger_get_mode(worker->logger) < LOG_INFO) {
+    status = transport_sendfile(worker->socket->transport, fp, 0, len);
+    /* nothing is sent if the transport can not send this file */
+    if (status != APR_ENOTIMPL) {
+      apr_file_close(fp);
+      return status;
+    }
+  }
+
+  buf = apr_palloc(ptmp, BLOCK_MAX);
+  while (len) {
+    block = len < BLOCK_MAX ? len : BLOCK_MAX;
+    if ((status = apr_file_read_full(fp, buf, block, &block)) 
+        != APR_SUCCESS) {
+      break;
+    }
+    worker_log_buf(worker, LOG_INFO, dir, buf, block);
+    dir = '+';
+    if ((status = worker_socket_send(worker, buf, block)) != APR_SUCCESS) {
+      break;
+    }
+    len -= block;
+  }
+  apr_file_close(fp);
+
+  if (APR_STATUS_IS_EOF(status)) {
+    worker_log(worker, LOG_ERR, "File \"%s\" got shorter since _SENDFILE", 
+               path);
+  }
+  return status;
+}
+
+/**
+ * flush lines with optional chunk info before, lines are gathered and
+ * sent with one call per WORKER_FLUSH_LINES lines
+ *
+ * @param worker IN worker object
+ * @param chunked IN chunk info to flush before data or NULL
  * @param from IN start cache line
  * @param to IN end cache line
  * @param ptmp IN temporary pool
  *
  * @return an apr status
  */
-apr_status_t worker_flush_part(worker_t *worker, int from, int to, 
-                               apr_pool_t *ptmp) {
+static apr_status_t worker_flush_lines(worker_t *worker, char *chunked, 
+                                       int from, int to, apr_pool_t *ptmp) {
   int i;
-  int len;
+  int j;
+  int n = 0;
   int nocrlf = 0;
+  apr_int32_t nvec = 0;
+  apr_size_t sent = 0;
+  line_t lines[WORKER_FLUSH_LINES];
+  struct iovec vec[2 * WORKER_FLUSH_LINES + 1];
 
   apr_status_t status = APR_SUCCESS;
 
   apr_table_entry_t *e =
     (apr_table_entry_t *) apr_table_elts(worker->cache)->elts;
 
+  if (chunked) {
+    vec[nvec].iov_base = chunked;
+    vec[nvec++].iov_len = strlen(chunked);
+    sent = strlen(chunked);
+  }
+
   /* iterate through all cached lines and send them */
-  for (i = from; i < to; ++i) {
+  for (i = from; i <= to; ++i) {
     line_t line; 
+
+    if (i == to || n == WORKER_FLUSH_LINES || strstr(e[i].key, ";file")) {
+      /* send gathered lines, then tell modules they are sent */
+      if (nvec && (status = worker_socket_sendv(worker, vec, nvec)) 
+          != APR_SUCCESS) {
+        return status;
+      }
+      worker->sent += sent;
+      for (j = 0; j < n; j++) {
+        if((status = htt_run_line_sent(worker, &lines[j])) != APR_SUCCESS) {
+          return status;
+        }
+      }
+      nvec = 0;
+      n = 0;
+      sent = 0;
+      if (i == to) {
+        break;
+      }
+    }
+
     line.info = e[i].key;
     line.buf = e[i].val;
     /* use in this case the copied key */
@@ -4091,6 +4631,21 @@ apr_status_t worker_flush_part(worker_t *worker, int from, int to,
       /* replace all vars */
       line.buf = worker_replace_vars(worker, line.buf, &unresolved, ptmp); 
     }
+    if (strstr(line.info, ";file")) {
+      /* file of _SENDFILE, send it between the gathered lines */
+      line.len = apr_atoi64(&line.info[7]);
+      if ((status = worker_sendfile(worker, line.buf, line.len, 
+                                    nocrlf ? '+' : '>', ptmp)) 
+          != APR_SUCCESS) {
+        return status;
+      }
+      worker->sent += line.len;
+      if((status = htt_run_line_sent(worker, &line)) != APR_SUCCESS) {
+        return status;
+      }
+      nocrlf = 1;
+      continue;
+    }
     if((status = htt_run_line_flush(worker, &line)) != APR_SUCCESS) {
       return status;
     }
@@ -4125,29 +4680,37 @@ apr_status_t worker_flush_part(worker_t *worker, int from, int to,
       nocrlf = 0;
     }
 
-    if ((status = worker_socket_send(worker, line.buf, line.len)) 
-	!= APR_SUCCESS) {
-      goto error;
-    }
-    if((status = htt_run_line_sent(worker, &line)) != APR_SUCCESS) {
-      return status;
-    }
-    worker->sent += line.len;
+    vec[nvec].iov_base = line.buf;
+    vec[nvec++].iov_len = line.len;
+    sent += line.len;
     if (strncasecmp(line.info, "NOCRLF", 6) != 0) {
-      len = 2;
-      if ((status = worker_socket_send(worker, "\r\n", len)) != APR_SUCCESS) {
-	goto error;
-      }
-      worker->sent += len;
+      vec[nvec].iov_base = "\r\n";
+      vec[nvec++].iov_len = 2;
+      sent += 2;
     }
+    lines[n++] = line;
   }
 
-error:
   return status;
 }
 
 /**
- * Flush a chunk part
+ * flush partial data 
+ *
+ * @param worker IN worker object
+ * @param from IN start cache line
+ * @param to IN end cache line
+ * @param ptmp IN temporary pool
+ *
+ * @return an apr status
+ */
+apr_status_t worker_flush_part(worker_t *worker, int from, int to, 
+                               apr_pool_t *ptmp) {
+  return worker_flush_lines(worker, NULL, from, to, ptmp);
+}
+
+/**
+ * Flush a chunk part, chunk info and lines go out together
  * 
  * @param worker IN worker object
  * @param chunked IN chunk info to flush before data
@@ -4159,22 +4722,11 @@ error:
  */
 apr_status_t worker_flush_chunk(worker_t *worker, char *chunked, int from, int to,
                                 apr_pool_t *ptmp) {
-  apr_status_t status;
-  int len;
-
   if (chunked) {
     worker_log_buf(worker, LOG_INFO, '>', chunked, strlen(chunked));
   }
 
-  if (chunked) {
-    len = strlen(chunked);
-    if ((status = worker_socket_send(worker, chunked, len)) != APR_SUCCESS) {
-      return status;
-    }
-    worker->sent += len;
-  }
-
-  return worker_flush_part(worker, from, to, ptmp);
+  return worker_flush_lines(worker, chunked, from, to, ptmp);
 }
 
 /**
@@ -4539,6 +5091,7 @@ APR_HOOK_STRUCT(
   APR_HOOK_LINK(read_header)
   APR_HOOK_LINK(read_buf)
   APR_HOOK_LINK(WAIT_end)
+  APR_HOOK_LINK(phase)
 )
 
 
@@ -4607,4 +5160,8 @@ APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, WAIT_end,
                                       (worker_t *worker, apr_status_t status), 
 				      (worker, status), APR_SUCCESS)
 
+APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(htt, HTT, apr_status_t, phase, 
+                                      (worker_t *worker, int phase), 
+				      (worker, phase), APR_SUCCESS)
+
 
@@ -33,6 +33,8 @@
 #include "socket.h" 
 
 typedef struct command_s command_t;
+/* data points into the script lines, which are shared read only between
+ * workers after parsing, a command copies data before it modifies it */
 typedef apr_status_t(*command_f) (command_t * self, void * type, char *data, 
                                   apr_pool_t *ptmp);
 
@@ -63,6 +65,8 @@ typedef struct socket_s {
   apr_table_t *cookies;
   char *cookie;
   sockreader_t *sockreader;
+  /* per connection bandwidth limit or NULL, see shaper.h */
+  struct shaper_s *shaper;
 } socket_t;
 
 typedef struct validation_s {
@@ -75,6 +79,41 @@ typedef struct validation_s {
   apr_table_t *exec;
 } validation_t;
 
+typedef struct op_s {
+#define OP_TYPE_COMMAND 0
+#define OP_TYPE_LINK    1
+#define OP_TYPE_CALL    2
+  int type;
+  /* length of a possible block name at line start, 0 if none */
+  apr_size_t name_len;
+  /* resolved command for OP_TYPE_COMMAND */
+  command_t *command;
+  /* arguments after command name, expanded call line for links */
+  char *args;
+  /* variable slots of args, NULL if args hold no variables */
+  struct replacer_template_s *vars;
+  /* original script line */
+  char *line;
+  const char *file_and_line;
+  /* compiled body of a body command, NULL if none */
+  struct program_s *body;
+} op_t;
+
+typedef struct program_s {
+  /* lines this program was compiled from */
+  apr_table_t *lines;
+  int nelts;
+  op_t *ops;
+} program_t;
+
+typedef struct frames_s {
+  /* parent pool of the frame pools */
+  apr_pool_t *pool;
+  /* one pool per call depth, cleared and reused on every call */
+  apr_array_header_t *pools;
+  int depth;
+} frames_t;
+
 typedef struct worker_s worker_t;
 typedef struct global_s global_t;
 typedef apr_status_t(*interpret_f)(worker_t *worker, worker_t *parent, 
@@ -104,6 +143,8 @@ struct worker_s {
   store_t *retvars;
   /* block local variables */
   store_t *locals;
+  /* call frames, shared with bodies */
+  frames_t *frames;
   /* buffered stdout */
   apr_file_t *out;
   /* buffered errout */
@@ -137,7 +178,18 @@ struct worker_s {
   const char *desc;
   int chunksize;
   apr_size_t sent;
+  /* bandwidth limit of this worker or NULL */
+  struct shaper_s *shaper;
+  /* bandwidth limit of every new connection, 0 if none */
+  apr_size_t conn_rate;
+  apr_size_t conn_burst;
+  /* window of streamed bodies, 0 reads bodies as a whole */
+  apr_size_t window;
   int req_cnt;
+  /* intended start of the current open loop _RPS arrival, 0 if none */
+  apr_time_t sched_start;
+  /* open loop _RPS arrivals which could not be started in time */
+  int sched_missed;
   char *match_seq;
   apr_time_t socktmo;
   apr_thread_t *mythread;
@@ -145,6 +197,12 @@ struct worker_s {
   apr_thread_mutex_t *log_mutex;
   apr_thread_mutex_t *mutex;
   apr_table_t *lines;
+  /* pre-parsed lines, see worker_interpret */
+  program_t *program;
+  /* op in execution, see worker_replace_vars */
+  op_t *op;
+  /* dispatch index of the START which started this worker or NULL */
+  struct dispatch_s *dispatch;
   apr_table_t *cache;
   validation_t match;
   validation_t grep;
@@ -174,8 +232,28 @@ struct global_s {
   store_t *shared;
   apr_hash_t *modules;
   apr_hash_t *blocks;
+  /* command and module block index, see dispatch.h */
+  struct dispatch_s *dispatch;
+  /* pool of dispatch or NULL if it lives in pool */
+  apr_pool_t *dispatch_pool;
+  /* pools of replaced indices, released on JOIN */
+  apr_array_header_t *dispatch_pools;
+  /* event engine for clients or NULL, see engine.h */
+  struct engine_s *engine;
+  /* bandwidth limit over all workers or NULL */
+  struct shaper_s *shaper;
+  /* open loop _RPS schedules by script line, guarded by mutex */
+  apr_hash_t *rps_scheds;
   apr_table_t *files;
   apr_table_t *threads;
+  /* workers on pool threads, see tpool.h */
+  struct tpool_s *tpool;
+  apr_table_t *tasks;
+  /* client processes of --processes and index of this one, -1 in parent */
+  apr_array_header_t *procs;
+  int process;
+  /* pipe releasing the client processes once the servers listen */
+  apr_file_t *procs_ready;
   apr_table_t *clients;
   apr_table_t *servers;
   apr_table_t *daemons;
@@ -184,6 +262,9 @@ struct global_s {
   int SRVs;
   int cur_threads; 
   int tot_threads; 
+  /* worker clones and time spent to create them, see --stats */
+  int clones;
+  apr_time_t clone_time;
   int groups;
   apr_thread_mutex_t *sync_mutex;
   apr_thread_mutex_t *mutex;
@@ -227,6 +308,16 @@ typedef struct line_s {
 #define RSA_SERVER_KEY "server.key.pem"
 
 #define LISTENBACKLOG_DEFAULT 511
+
+/** request phases passed to the phase hook */
+#define PHASE_DNS_BEGIN     0
+#define PHASE_DNS_END       1
+#define PHASE_CONNECT_BEGIN 2
+#define PHASE_CONNECT_END   3
+#define PHASE_TLS_BEGIN     4
+#define PHASE_TLS_END       5
+#define PHASE_FIRST_BYTE    6
+#define PHASE_BODY_END      7
 	
 #define COMMAND_NEED_ARG(err_text) \
 { \
@@ -318,6 +409,8 @@ APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, read_buf,
                           (worker_t *worker, char *buf, apr_size_t len))
 APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, WAIT_end,
                           (worker_t *worker, apr_status_t status))
+APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, phase,
+                          (worker_t *worker, int phase))
 APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, worker_clone,
                           (worker_t *worker, worker_t *clone))
 APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, read_line,
@@ -326,8 +419,12 @@ APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, block_start,
                           (global_t *global, char **line))
 APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, block_end,
                           (global_t *global))
+APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, clients_start,
+                          (global_t *global))
 APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, client_create,
                           (worker_t *worker, apr_thread_start_t func, apr_thread_t **new_thread))
+APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, client_run,
+                          (worker_t *worker))
 APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, server_create,
                           (worker_t *worker, apr_thread_start_t func, apr_thread_t **new_thread))
 APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, worker_finally,
@@ -338,6 +435,14 @@ APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, thread_join,
                           (global_t *global, apr_thread_t *thread))
 APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, worker_joined,
                           (global_t *global))
+APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, process_fork,
+                          (global_t *global, int processes))
+APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, process_init,
+                          (global_t *global, int process))
+APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, process_exit,
+                          (global_t *global, int process))
+APR_DECLARE_EXTERNAL_HOOK(htt, HTT, apr_status_t, process_joined,
+                          (global_t *global, int process))
 
 apr_status_t transport_register(socket_t *socket, transport_t *transport);
 apr_status_t transport_unregister(socket_t *socket, transport_t *transport);
@@ -353,6 +458,7 @@ apr_status_t command_SLEEP(command_t * self, worker_t * worker, char *data, apr_
 apr_status_t command_EXPECT(command_t * self, worker_t * worker, char *data, apr_pool_t *ptmp);
 apr_status_t command_CLOSE(command_t * self, worker_t * worker, char *data, apr_pool_t *ptmp);
 apr_status_t command_TIMEOUT(command_t * self, worker_t * worker, char *data, apr_pool_t *ptmp);
+apr_status_t command_THROTTLE(command_t * self, worker_t * worker, char *data, apr_pool_t *ptmp);
 apr_status_t command_MATCH(command_t * self, worker_t * worker, char *data, apr_pool_t *ptmp);
 apr_status_t command_GREP(command_t * self, worker_t * worker, char *data, apr_pool_t *ptmp);
 apr_status_t command_ASSERT(command_t * self, worker_t * worker, char *data, apr_pool_t *ptmp);
@@ -404,6 +510,7 @@ apr_status_t command_LOCAL(command_t *self, worker_t *worker, char *data, apr_po
 apr_status_t command_LOCK(command_t *self, worker_t *worker, char *data, apr_pool_t *ptmp); 
 apr_status_t command_UNLOCK(command_t *self, worker_t *worker, char *data, apr_pool_t *ptmp); 
 apr_status_t command_IGNORE_BODY(command_t *self, worker_t *worker, char *data, apr_pool_t *ptmp); 
+apr_status_t command_STREAM_WINDOW(command_t *self, worker_t *worker, char *data, apr_pool_t *ptmp); 
 apr_status_t command_VERSION(command_t *self, worker_t *worker, char *data, apr_pool_t *ptmp); 
 apr_status_t command_DUMMY(command_t *self, worker_t *worker, char *data, apr_pool_t *ptmp); 
 
@@ -414,6 +521,9 @@ void worker_var_set_and_zero_terminate(worker_t * worker, const char *var, const
 void worker_new(worker_t ** self, char *additional,
                 global_t *global, interpret_f interpret);
 void worker_clone(worker_t ** self, worker_t * orig); 
+worker_t *worker_get_block(worker_t *worker, apr_hash_t *blocks, 
+                           const char *name, apr_ssize_t len); 
+struct dispatch_s *worker_get_dispatch(worker_t *worker);
 apr_status_t worker_handle_buf(worker_t *worker, apr_pool_t *pool, char *buf, 
                                apr_size_t len); 
 
@@ -7,7 +7,14 @@ echo
 echo
 echo "test_store_SOURCES=test_store.c \$(top_srcdir)/src/store.c"
 echo "test_file_SOURCES=test_file.c \$(top_srcdir)/src/file.c \$(top_srcdir)/src/util.c \$(top_srcdir)/src/store.c"
+echo "test_dispatch_SOURCES=test_dispatch.c \$(top_srcdir)/src/dispatch.c"
+echo "test_regex_SOURCES=test_regex.c \$(top_srcdir)/src/regex.c"
+echo "test_shaper_SOURCES=test_shaper.c \$(top_srcdir)/src/shaper.c"
+echo "test_tpool_SOURCES=test_tpool.c \$(top_srcdir)/src/tpool.c \$(top_srcdir)/src/engine.c"
+echo "test_hdr_SOURCES=test_hdr.c \$(top_srcdir)/src/hdr.c"
+echo "test_ring_SOURCES=test_ring.c \$(top_srcdir)/src/ring.c"
+echo "test_replacer_SOURCES=test_replacer.c \$(top_srcdir)/src/replacer.c"
 echo "AM_CFLAGS=-I\$(top_srcdir)/src"
-echo "check_PROGRAMS=test_store test_file"
-echo "TESTS = test_store test_file test_run_help.sh test_run_all.sh test_run_errors.sh test_run_visual.sh test_run_ntlm.sh test_check_coredumps.sh"
+echo "check_PROGRAMS=test_store test_file test_dispatch test_regex test_shaper test_tpool test_hdr test_ring test_replacer"
+echo "TESTS = test_store test_file test_dispatch test_regex test_shaper test_tpool test_hdr test_ring test_replacer test_run_help.sh test_run_all.sh test_run_errors.sh test_run_visual.sh test_run_ntlm.sh test_run_processes.sh test_run_sendfile.sh test_check_coredumps.sh"
 
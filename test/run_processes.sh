@@ -0,0 +1,31 @@
+#!/bin/bash
+
+if [ -z $srcdir ]; then
+  srcdir=.
+fi
+
+. $srcdir/run_lib.sh
+
+function run_single {
+  E=$1
+  OUT=$2
+
+  ./run.sh --processes=2 $E >/tmp/tmp.txt 2>$OUT
+  ret=$?
+  if [ $ret -eq 2 ]; then
+    return 2
+  elif [ $ret -ne 0 ]; then
+    return 1
+  fi
+  grep -q "^total reqs: 20$" /tmp/tmp.txt
+  if [ $? -ne 0 ]; then
+    echo "expected 20 requests" >>$OUT
+    grep "^total reqs" /tmp/tmp.txt >>$OUT
+    return 1
+  fi
+}
+
+echo processes tests
+LIST="processes.htt"
+COUNT=1
+run_all "$LIST" $COUNT
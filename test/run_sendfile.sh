@@ -0,0 +1,25 @@
+#!/bin/bash
+
+if [ -z $srcdir ]; then
+  srcdir=.
+fi
+
+. $srcdir/run_lib.sh
+
+function run_single {
+  E=$1
+  OUT=$2
+
+  # silent, else the body is logged and sent through a buffer
+  ./run.sh -s $E >$OUT 2>&1
+  ret=$?
+  if [ $ret -ne 0 ]; then
+    return $ret
+  fi
+  ./run.sh -s --engine=event:1 $E >>$OUT 2>&1
+}
+
+echo sendfile tests
+LIST=`ls sendfile*.htt`
+COUNT=`ls sendfile*.htt | wc -l`
+run_all "$LIST" $COUNT
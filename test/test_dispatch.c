@@ -0,0 +1,248 @@
+/* contributor license agreements.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Dispatch index unit test and microbenchmark
+ */
+
+/* affects include files on Solaris */
+#define BSD_COMP
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <assert.h>
+#include "defines.h"
+
+#include <apr.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+#include <apr_hash.h>
+#include <apr_time.h>
+
+#include "worker.h"
+#include "dispatch.h"
+
+/************************************************************************
+ * Defines
+ ***********************************************************************/
+#define LOOKUPS 100000
+
+/************************************************************************
+ * Typedefs
+ ***********************************************************************/
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+/* names and order like local_commands, including the prefix cases */
+command_t commands[] = {
+  {"__", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_-", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_FLUSH", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_CHUNK", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_REQ", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_RESWAIT", NULL, "", "", COMMAND_FLAGS_DEPRECIATED},
+  {"_RES", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_WAIT", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_CLOSE", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_EXPECT", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_MATCH", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_GREP", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_ASSERT", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_SEQUENCE", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_BREAK", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_TIMEOUT", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_SET", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_UNSET", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_EXEC", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_PIPE", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_SOCKSTATE", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_IGNORE_ERR", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_IGNORE_BODY", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_IF", NULL, "", "", COMMAND_FLAGS_BODY},
+  {"_LOOP", NULL, "", "", COMMAND_FLAGS_BODY},
+  {"_FOR", NULL, "", "", COMMAND_FLAGS_BODY},
+  {"_END", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_SLEEP", NULL, "_SYS:SLEEP", "", COMMAND_FLAGS_LINK},
+  {"_DEBUG", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_LOG_LEVEL_SET", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_LOG_LEVEL", NULL, "", "", COMMAND_FLAGS_NONE},
+  {"_CALL", NULL, "", "", COMMAND_FLAGS_NONE},
+  {NULL, NULL, NULL, NULL, COMMAND_FLAGS_NONE}
+};
+
+const char *lines[] = {
+  "__GET / HTTP/1.1",
+  "__Host: localhost",
+  "_-foo",
+  "_REQ localhost 8080",
+  "_RES",
+  "_RESWAIT",
+  "_RES IGNORE_MONITORS",
+  "_EXPECT . \"200 OK\"",
+  "_EXEC echo foo",
+  "_IGNORE_BODY on",
+  "_IF \"$a\" EQUAL \"b\"",
+  "_LOG_LEVEL_SET 4",
+  "_LOG_LEVEL 4",
+  "_SLEEP 100",
+  "_WAIT",
+  "_END",
+  "_UNKNOWN foo",
+  "BLOCK_NAME param",
+  "",
+  NULL
+};
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+/**
+ * Linear lookup like it was done before the dispatch index
+ * @param commands IN command table
+ * @param line IN line
+ * @return command
+ */
+static command_t *linear_lookup(command_t *commands, const char *line) {
+  int k;
+  apr_size_t len;
+
+  k = 0;
+  while (commands[k].name) {
+    len = strlen(commands[k].name);
+    if (len <= strlen(line)
+	&& strncmp(line, commands[k].name, len) == 0) {
+      break;
+    }
+    ++k;
+  }
+
+  return &commands[k];
+}
+
+int main(int argc, const char *const argv[]) {
+  apr_pool_t *pool;
+  apr_hash_t *modules;
+  apr_hash_t *blocks;
+  dispatch_t *dispatch;
+  apr_time_t start;
+  apr_time_t linear;
+  apr_time_t indexed;
+  int i;
+  int j;
+  int n;
+  worker_t sleep_block;
+  worker_t user_block;
+  volatile command_t *command;
+
+  apr_app_initialize(&argc, &argv, NULL);
+  apr_pool_create(&pool, NULL);
+
+  modules = apr_hash_make(pool);
+  blocks = apr_hash_make(pool);
+  apr_hash_set(blocks, "_SLEEP", APR_HASH_KEY_STRING, &sleep_block);
+  apr_hash_set(modules, "SYS", APR_HASH_KEY_STRING, blocks);
+  blocks = apr_hash_make(pool);
+  apr_hash_set(blocks, "LOGIN", APR_HASH_KEY_STRING, &user_block);
+  apr_hash_set(modules, "MYMOD", APR_HASH_KEY_STRING, blocks);
+
+  dispatch = dispatch_new(pool, commands, modules);
+
+  fprintf(stdout, "index lookup equals linear lookup\n");
+  for (i = 0; commands[i].name; i++) {
+    assert(dispatch_get_command(dispatch, commands[i].name) ==
+           linear_lookup(commands, commands[i].name));
+  }
+  for (i = 0; lines[i]; i++) {
+    assert(dispatch_get_command(dispatch, lines[i]) ==
+           linear_lookup(commands, lines[i]));
+  }
+  assert(dispatch_get_command(dispatch, "_RES")->name == commands[6].name);
+  assert(dispatch_get_command(dispatch, "_RESWAIT")->name == commands[5].name);
+  assert(dispatch_get_command(dispatch, "__GET")->name == commands[0].name);
+  assert(dispatch_get_command(dispatch, "_UNKNOWN")->name == NULL);
+
+  fprintf(stdout, "module blocks by calling name\n");
+  assert(dispatch_get_block(dispatch, "_SYS:SLEEP", APR_HASH_KEY_STRING) ==
+         &sleep_block);
+  assert(dispatch_get_block(dispatch, "SYS:_SLEEP", APR_HASH_KEY_STRING) ==
+         &sleep_block);
+  assert(dispatch_get_block(dispatch, "MYMOD:LOGIN", APR_HASH_KEY_STRING) ==
+         &user_block);
+  assert(dispatch_get_block(dispatch, "MYMOD:LOGIN foo", 11) == &user_block);
+  assert(dispatch_get_block(dispatch, "SYS:SLEEP", APR_HASH_KEY_STRING) ==
+         NULL);
+  assert(dispatch_get_block(NULL, "SYS:SLEEP", APR_HASH_KEY_STRING) == NULL);
+
+  fprintf(stdout, "local blocks from the snapshot\n");
+  {
+    worker_t *block;
+    apr_hash_t *later = apr_hash_make(pool);
+
+    assert(dispatch_get_local_block(dispatch, blocks, "LOGIN", 
+                                    APR_HASH_KEY_STRING, &block) 
+           == APR_SUCCESS && block == &user_block);
+    apr_hash_set(blocks, "LOGOUT", APR_HASH_KEY_STRING, &user_block);
+    assert(dispatch_get_local_block(dispatch, blocks, "LOGOUT", 
+                                    APR_HASH_KEY_STRING, &block) 
+           == APR_SUCCESS && block == NULL);
+    assert(dispatch_get_local_block(dispatch, later, "LOGIN", 
+                                    APR_HASH_KEY_STRING, &block) 
+           == APR_ENOENT && block == NULL);
+    assert(dispatch_get_local_block(NULL, blocks, "LOGIN", 
+                                    APR_HASH_KEY_STRING, &block) 
+           == APR_ENOENT);
+  }
+
+  fprintf(stdout, "modules as they were at creation\n");
+  apr_hash_set(modules, "LATER", APR_HASH_KEY_STRING, blocks);
+  assert(apr_hash_get(dispatch_get_modules(dispatch), "MYMOD", 
+                      APR_HASH_KEY_STRING) == blocks);
+  assert(apr_hash_get(dispatch_get_modules(dispatch), "LATER", 
+                      APR_HASH_KEY_STRING) == NULL);
+
+  for (n = 0; lines[n]; n++);
+
+  start = apr_time_now();
+  for (i = 0; i < LOOKUPS; i++) {
+    for (j = 0; j < n; j++) {
+      command = linear_lookup(commands, lines[j]);
+    }
+  }
+  linear = apr_time_now() - start;
+
+  start = apr_time_now();
+  for (i = 0; i < LOOKUPS; i++) {
+    for (j = 0; j < n; j++) {
+      command = dispatch_get_command(dispatch, lines[j]);
+    }
+  }
+  indexed = apr_time_now() - start;
+
+  fprintf(stdout, "linear lookup: %.1f ns per line\n",
+          (double)linear * 1000 / ((double)LOOKUPS * n));
+  fprintf(stdout, "dispatch lookup: %.1f ns per line\n",
+          (double)indexed * 1000 / ((double)LOOKUPS * n));
+
+  return 0;
+}
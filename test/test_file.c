@@ -147,6 +147,59 @@ int main(int argc, const char *const argv[]) {
   fprintf(stdout, "OK\n");
 
   apr_file_close(file);
+
+  fprintf(stdout, "Read line endings and lines spanning a refill...");
+  {
+    char *line;
+    char *tmpl;
+    char *longline;
+    int i;
+    apr_off_t offset = 0;
+    const char *expect[] = { "crlf", "cr", "lf", "blank", "", NULL };
+
+    tmpl = apr_pstrdup(pool, "testXXXXXX");
+    if ((status = apr_file_mktemp(&file, tmpl, 0, pool)) != APR_SUCCESS) {
+      fprintf(stderr, "\nCould not open temp file: %s(%d)\n", 
+              my_status_str(pool, status), status);
+      return 1;
+    }
+
+    longline = apr_palloc(pool, 3 * BLOCK_MAX + 1);
+    memset(longline, 'x', 3 * BLOCK_MAX);
+    longline[3 * BLOCK_MAX] = 0;
+    apr_file_printf(file, "crlf\r\ncr\rlf\n \tblank\n\n%s\nlast\n", 
+                    longline);
+    apr_file_flush(file);
+    apr_file_seek(file, APR_SET, &offset);
+
+    if ((status = bufreader_new(&bufreader, file, pool)) != APR_SUCCESS) {
+      fprintf(stderr, "\nCould not create bufreader: %s(%d)\n", 
+              my_status_str(pool, status), status);
+      return 1;
+    }
+
+    for (i = 0; expect[i]; i++) {
+      if ((status = bufreader_read_line(bufreader, &line)) != APR_SUCCESS ||
+          strcmp(line, expect[i]) != 0) {
+        fprintf(stderr, "\nline %d, expected '%s' got '%s'\n", 
+                i, expect[i], line);
+        return 1;
+      }
+    }
+    if ((status = bufreader_read_line(bufreader, &line)) != APR_SUCCESS ||
+        strcmp(line, longline) != 0) {
+      fprintf(stderr, "\nlong line do not match\n");
+      return 1;
+    }
+    if ((status = bufreader_read_line(bufreader, &line)) != APR_SUCCESS ||
+        strcmp(line, "last") != 0) {
+      fprintf(stderr, "\nlast line do not match and is '%s'\n", line);
+      return 1;
+    }
+    apr_file_close(file);
+  }
+  fprintf(stdout, "OK\n");
+
   return 0;
 }
 
@@ -0,0 +1,114 @@
+/* contributor license agreements.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Latency histogram unit test
+ */
+
+/* affects include files on Solaris */
+#define BSD_COMP
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <assert.h>
+#include "defines.h"
+
+#include <apr.h>
+#include <apr_pools.h>
+
+#include "hdr.h"
+
+/************************************************************************
+ * Defines
+ ***********************************************************************/
+
+/************************************************************************
+ * Typedefs
+ ***********************************************************************/
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+hdr_t a;
+hdr_t b;
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+/**
+ * Test if value is within the histogram precision of expected
+ * @param value IN value from histogram
+ * @param expected IN exact value
+ * @return 1 if near enough
+ */
+static int near(apr_int64_t value, apr_int64_t expected) {
+  apr_int64_t diff = value > expected ? value - expected : expected - value;
+  return diff * HDR_SUB <= expected;
+}
+
+int main(int argc, const char *const argv[]) {
+  apr_int64_t i;
+
+  apr_app_initialize(&argc, &argv, NULL);
+
+  fprintf(stdout, "empty histogram\n");
+  hdr_reset(&a);
+  assert(hdr_percentile(&a, 50) == 0);
+
+  fprintf(stdout, "small values are exact\n");
+  for (i = 1; i <= 100; i++) {
+    hdr_record(&a, i);
+  }
+  assert(a.count == 100 && a.min == 1 && a.max == 100);
+  assert(hdr_percentile(&a, 50) == 50);
+  assert(hdr_percentile(&a, 99) == 99);
+  assert(hdr_percentile(&a, 100) == 100);
+
+  fprintf(stdout, "large values within precision\n");
+  hdr_reset(&a);
+  for (i = 1; i <= 1000000; i++) {
+    hdr_record(&a, i);
+  }
+  assert(near(hdr_percentile(&a, 50), 500000));
+  assert(near(hdr_percentile(&a, 90), 900000));
+  assert(near(hdr_percentile(&a, 99.9), 999000));
+  assert(hdr_percentile(&a, 100) == 1000000);
+
+  fprintf(stdout, "huge values go to the last bucket\n");
+  hdr_reset(&b);
+  hdr_record(&b, APR_INT64_C(1) << 40);
+  assert(b.max == APR_INT64_C(1) << 40);
+  assert(hdr_percentile(&b, 50) <= b.max);
+
+  fprintf(stdout, "merge adds counts\n");
+  hdr_reset(&b);
+  for (i = 0; i < 1000000; i++) {
+    hdr_record(&b, 2000000);
+  }
+  hdr_add(&a, &b);
+  assert(a.count == 2000000 && a.min == 1 && a.max == 2000000);
+  assert(near(hdr_percentile(&a, 25), 500000));
+  assert(near(hdr_percentile(&a, 75), 2000000));
+
+  return 0;
+}
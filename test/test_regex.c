@@ -0,0 +1,287 @@
+/* contributor license agreements.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Regex unit test and match benchmark
+ */
+
+/* affects include files on Solaris */
+#define BSD_COMP
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <assert.h>
+#include "defines.h"
+
+#include <apr.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+#include <apr_time.h>
+
+#include "regex.h"
+
+/************************************************************************
+ * Defines
+ ***********************************************************************/
+#define BODY_SIZE (1024 * 1024)
+#define ROUNDS 4
+
+/************************************************************************
+ * Typedefs
+ ***********************************************************************/
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+/* typical _MATCH and _EXPECT patterns, most do not match the body */
+const char *patterns[] = {
+  "HTTP/1.1 200",
+  "Content-Length: ([0-9]+)",
+  "<title>([^<]*)</title>",
+  "session=([a-zA-Z0-9]+)",
+  "Set-Cookie: ([^;]+);",
+  "href=\"([^\"]+)\"",
+  "name=\"token\" value=\"([^\"]*)\"",
+  "[Ee]rror [0-9]{3}",
+  "Exception in thread",
+  "stack trace",
+  "^Location: (.*)$",
+  "foo[0-9]+bar",
+  "(abc|def|ghi)xyz",
+  "[a-z]+@[a-z]+\\.[a-z]{2,}",
+  "<form[^>]*action=\"([^\"]*)\"",
+  "id=\"result\">([0-9.]+)<",
+  "\\$\\{[A-Z_]+\\}",
+  "Internal Server Error",
+  "charset=([a-zA-Z0-9-]+)",
+  "X-Request-Id: ([0-9a-f-]{36})",
+  "<script[^>]*src=\"([^\"]*)\"",
+  "not found",
+  "denied|forbidden|unauthorized",
+  "[0-9]{4}-[0-9]{2}-[0-9]{2}T[0-9:]+Z",
+  NULL
+};
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+/**
+ * Create a html body of BODY_SIZE bytes
+ * @param pool IN pool
+ * @return body
+ */
+static char *make_body(apr_pool_t *pool) {
+  const char *line = "<tr><td class=\"cell\">lorem ipsum dolor sit amet</td>"
+                     "<td>12345</td></tr>\n";
+  apr_size_t line_len = strlen(line);
+  apr_size_t i;
+  char *body = apr_palloc(pool, BODY_SIZE + 1);
+
+  for (i = 0; i + line_len <= BODY_SIZE; i += line_len) {
+    memcpy(&body[i], line, line_len);
+  }
+  memset(&body[i], ' ', BODY_SIZE - i);
+  body[BODY_SIZE] = 0;
+  return body;
+}
+
+/**
+ * Match all patterns with the pcre interpreter, no study and no JIT
+ * @param pool IN pool
+ * @param body IN body
+ * @return time used
+ */
+static apr_time_t bench_interpreter(apr_pool_t *pool, const char *body) {
+  int i;
+  int j;
+  apr_time_t start;
+#ifdef HAVE_PCRE2
+  int errcode;
+  PCRE2_SIZE erroff;
+  pcre2_code *re[sizeof(patterns)/sizeof(patterns[0])];
+  pcre2_match_data *match_data = pcre2_match_data_create(10, NULL);
+
+  for (i = 0; patterns[i]; i++) {
+    re[i] = pcre2_compile((PCRE2_SPTR)patterns[i], PCRE2_ZERO_TERMINATED,
+                          0, &errcode, &erroff, NULL);
+    assert(re[i] != NULL);
+  }
+  start = apr_time_now();
+  for (j = 0; j < ROUNDS; j++) {
+    for (i = 0; patterns[i]; i++) {
+      pcre2_match(re[i], (PCRE2_SPTR)body, BODY_SIZE, 0, PCRE2_NO_JIT,
+                  match_data, NULL);
+    }
+  }
+  start = apr_time_now() - start;
+  for (i = 0; patterns[i]; i++) {
+    pcre2_code_free(re[i]);
+  }
+  pcre2_match_data_free(match_data);
+#else
+  const char *err;
+  int erroff;
+  int ovector[30];
+  pcre *re[sizeof(patterns)/sizeof(patterns[0])];
+
+  for (i = 0; patterns[i]; i++) {
+    re[i] = pcre_compile(patterns[i], 0, &err, &erroff, NULL);
+    assert(re[i] != NULL);
+  }
+  start = apr_time_now();
+  for (j = 0; j < ROUNDS; j++) {
+    for (i = 0; patterns[i]; i++) {
+      pcre_exec(re[i], NULL, body, BODY_SIZE, 0, 0, ovector, 30);
+    }
+  }
+  start = apr_time_now() - start;
+  for (i = 0; patterns[i]; i++) {
+    pcre_free(re[i]);
+  }
+#endif
+  return start;
+}
+
+/**
+ * Match all patterns with htt_regexec
+ * @param pool IN pool
+ * @param body IN body
+ * @return time used
+ */
+static apr_time_t bench_htt_regex(apr_pool_t *pool, const char *body) {
+  int i;
+  int j;
+  apr_time_t start;
+  const char *err;
+  int off;
+  regmatch_t regmatch[10];
+  htt_regex_t *re[sizeof(patterns)/sizeof(patterns[0])];
+
+  for (i = 0; patterns[i]; i++) {
+    re[i] = htt_regexcomp_cached(pool, patterns[i], 0, &err, 
+                                 &off);
+    assert(re[i] != NULL);
+  }
+  start = apr_time_now();
+  for (j = 0; j < ROUNDS; j++) {
+    for (i = 0; patterns[i]; i++) {
+      htt_regexec(re[i], body, BODY_SIZE, 10, regmatch, PCRE_MULTILINE);
+    }
+  }
+  return apr_time_now() - start;
+}
+
+int main(int argc, const char *const argv[]) {
+  apr_pool_t *pool;
+  htt_regex_t *first;
+  htt_regex_t *second;
+  htt_regex_t *other;
+  const char *err;
+  int off;
+  apr_uint64_t hits;
+  apr_uint64_t misses;
+  int entries;
+  const char *data = "HTTP/1.1 200 OK";
+  char *body;
+  apr_time_t interpreted;
+  apr_time_t compiled;
+  int n;
+
+  apr_app_initialize(&argc, &argv, NULL);
+  apr_pool_create(&pool, NULL);
+
+  fprintf(stdout, "compile without cache\n");
+  first = htt_regexcomp_cached(pool, "200", 0, &err, &off);
+  assert(first != NULL);
+  htt_regex_cache_stat(&hits, &misses, &entries);
+  assert(hits == 0 && misses == 0 && entries == 0);
+
+  fprintf(stdout, "compile with cache\n");
+  assert(htt_regex_cache_init(pool) == APR_SUCCESS);
+  first = htt_regexcomp_cached(pool, "HTTP/1.1 200", 0, &err, &off);
+  second = htt_regexcomp_cached(pool, "HTTP/1.1 200", 0, &err, &off);
+  other = htt_regexcomp_cached(pool, "HTTP/1.1 200", PCRE_CASELESS, &err, 
+                               &off);
+  assert(first != NULL && second != NULL && other != NULL);
+  assert(first != second);
+  htt_regex_cache_stat(&hits, &misses, &entries);
+  assert(hits == 1 && misses == 2 && entries == 2);
+  assert(strcmp(htt_regexpattern(second), "HTTP/1.1 200") == 0);
+
+  fprintf(stdout, "hits are counted per use\n");
+  assert(htt_regexec(first, data, strlen(data), 0, NULL, 0) == 0);
+  assert(htt_regexec(first, data, strlen(data), 0, NULL, 0) == 0);
+  assert(htt_regexhits(first) == 2);
+  assert(htt_regexhits(second) == 0);
+  assert(htt_regexec(second, "foo", 3, 0, NULL, 0) != 0);
+  assert(htt_regexhits(second) == 0);
+
+  fprintf(stdout, "compile options are honoured\n");
+  first = htt_regexcomp_cached(pool, "^200", PCRE_MULTILINE, &err, &off);
+  second = htt_regexcomp_cached(pool, "^200", 0, &err, &off);
+  assert(htt_regexec(first, data, strlen(data), 0, NULL, PCRE_MULTILINE) != 0);
+  assert(htt_regexec(first, "x\n200", 5, 0, NULL, PCRE_MULTILINE) == 0);
+  assert(htt_regexec(second, "x\n200", 5, 0, NULL, PCRE_MULTILINE) != 0);
+  assert(htt_regexec(first, "200", 3, 0, NULL, PCRE_NOTBOL) != 0);
+
+  fprintf(stdout, "partial matches at the end are reported\n");
+  {
+    apr_size_t partial;
+    regmatch_t regmatch[2];
+
+    first = htt_regexcomp_cached(pool, "token=([0-9]+);", 0, &err, &off);
+    assert(htt_regexec_partial(first, "abc token=12", 12, 2, regmatch, 0,
+                               &partial) != 0);
+    assert(partial == 4);
+    assert(htt_regexhits(first) == 0);
+    assert(htt_regexec_partial(first, "token=12;", 9, 2, regmatch, 0,
+                               &partial) == 0);
+    assert(partial == 9);
+    assert(regmatch[1].rm_so == 6 && regmatch[1].rm_eo == 8);
+    assert(htt_regexec_partial(first, "nothing", 7, 0, NULL, 0,
+                               &partial) != 0);
+    assert(partial == 7);
+    assert(htt_regexhits(first) == 1);
+  }
+
+  fprintf(stdout, "invalid patterns are not cached\n");
+  assert(htt_regexcomp_cached(pool, "(", 0, &err, &off) == NULL);
+  assert(htt_regexcomp_cached(pool, "(", 0, &err, &off) == NULL);
+  htt_regex_cache_stat(&hits, &misses, &entries);
+  assert(hits == 1 && misses == 7 && entries == 5);
+
+  body = make_body(pool);
+  interpreted = bench_interpreter(pool, body);
+  compiled = bench_htt_regex(pool, body);
+  for (n = 0; patterns[n]; n++);
+  fprintf(stdout, "interpreter: %.2f ms per MB and pattern\n",
+          (double)interpreted / 1000 / (ROUNDS * n));
+  fprintf(stdout, "htt_regexec: %.2f ms per MB and pattern\n",
+          (double)compiled / 1000 / (ROUNDS * n));
+
+  apr_pool_destroy(pool);
+  htt_regex_cache_stat(&hits, &misses, &entries);
+  assert(entries == 0);
+
+  return 0;
+}
@@ -0,0 +1,145 @@
+/* contributor license agreements.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Replacer unit test and microbenchmark
+ */
+
+/* affects include files on Solaris */
+#define BSD_COMP
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "defines.h"
+
+#include <apr.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <apr_time.h>
+
+#include "replacer.h"
+
+/************************************************************************
+ * Defines
+ ***********************************************************************/
+#define ROUNDS 10000
+
+/************************************************************************
+ * Typedefs
+ ***********************************************************************/
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+/* line and expected result with the variables set in main */
+const char *lines[] = {
+  "no variables", "no variables",
+  "a $x b", "a 1 b",
+  "${x}y", "1y",
+  "$x$x", "11",
+  "$y", "11",
+  "$unknown stays", "$unknown stays",
+  "${unknown} stays", "${unknown} stays",
+  "f=$foo(1,2)", "f=bar",
+  "m=$mod:fn(a)", "m=baz",
+  "$", "$",
+  "end $", "end $",
+  NULL, NULL
+};
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+/**
+ * Lookup variables in a table
+ * @param udata IN table
+ * @param name IN variable name
+ * @return value or NULL
+ */
+static const char *test_replace(void *udata, const char *name) {
+  apr_table_t *vars = udata;
+
+  return apr_table_get(vars, name);
+}
+
+int main(int argc, const char *const argv[]) {
+  apr_pool_t *pool;
+  apr_table_t *vars;
+  replacer_template_t *tmpl;
+  apr_time_t start;
+  apr_time_t per_call;
+  apr_time_t compiled;
+  char *line;
+  int i;
+
+  apr_app_initialize(&argc, &argv, NULL);
+  apr_pool_create(&pool, NULL);
+
+  vars = apr_table_make(pool, 5);
+  apr_table_set(vars, "x", "1");
+  apr_table_set(vars, "y", "$x$x");
+  apr_table_set(vars, "foo(1,2)", "bar");
+  apr_table_set(vars, "mod:fn(a)", "baz");
+
+  fprintf(stdout, "compiled template equals replacer\n");
+  for (i = 0; lines[i]; i += 2) {
+    line = apr_pstrdup(pool, lines[i]);
+    assert(strcmp(replacer(pool, line, vars, test_replace), 
+                  lines[i + 1]) == 0);
+    tmpl = replacer_compile(pool, lines[i]);
+    assert(strcmp(replacer_template(pool, tmpl, vars, test_replace), 
+                  lines[i + 1]) == 0);
+  }
+
+  fprintf(stdout, "template is reused with new values\n");
+  tmpl = replacer_compile(pool, "a $x b");
+  assert(strcmp(replacer_template(pool, tmpl, vars, test_replace), 
+                "a 1 b") == 0);
+  apr_table_set(vars, "x", "2");
+  assert(strcmp(replacer_template(pool, tmpl, vars, test_replace), 
+                "a 2 b") == 0);
+
+  line = "<a href=\"$x\">$x</a><img src=\"${x}.png\"/>$y$y$y$y";
+  start = apr_time_now();
+  for (i = 0; i < ROUNDS; i++) {
+    replacer(pool, apr_pstrdup(pool, line), vars, test_replace);
+  }
+  per_call = apr_time_now() - start;
+
+  tmpl = replacer_compile(pool, line);
+  start = apr_time_now();
+  for (i = 0; i < ROUNDS; i++) {
+    replacer_template(pool, tmpl, vars, test_replace);
+  }
+  compiled = apr_time_now() - start;
+
+  fprintf(stdout, "compile per call: %"APR_TIME_T_FMT" us, "
+          "compiled once: %"APR_TIME_T_FMT" us\n", per_call, compiled);
+
+  apr_pool_destroy(pool);
+  apr_terminate();
+  return 0;
+}
@@ -0,0 +1,128 @@
+/* contributor license agreements.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Single producer single consumer ring unit test
+ */
+
+/* affects include files on Solaris */
+#define BSD_COMP
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <assert.h>
+#include "defines.h"
+
+#include <apr.h>
+#include <apr_pools.h>
+#include <apr_thread_proc.h>
+
+#include "ring.h"
+
+/************************************************************************
+ * Defines
+ ***********************************************************************/
+#define COUNT 1000000
+
+/************************************************************************
+ * Typedefs
+ ***********************************************************************/
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+ring_t *ring;
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+/**
+ * Push numbers 0..COUNT-1, retry if the ring is full
+ * @param thread IN thread
+ * @param data IN unused
+ * @return NULL
+ */
+static void * APR_THREAD_FUNC producer(apr_thread_t *thread, void *data) {
+  apr_uint32_t i;
+
+  for (i = 0; i < COUNT; i++) {
+    apr_uint32_t *elem;
+    while (!(elem = ring_reserve(ring))) {
+      apr_sleep(10);
+    }
+    *elem = i;
+    ring_commit(ring);
+  }
+  apr_thread_exit(thread, APR_SUCCESS);
+  return NULL;
+}
+
+int main(int argc, const char *const argv[]) {
+  apr_pool_t *pool;
+  apr_thread_t *thread;
+  apr_status_t retstat;
+  apr_uint32_t *elem;
+  apr_uint32_t i;
+
+  apr_app_initialize(&argc, &argv, NULL);
+  apr_pool_create(&pool, NULL);
+
+  fprintf(stdout, "size rounds up to a power of two\n");
+  ring = ring_new(pool, 3, sizeof(apr_uint32_t));
+  for (i = 0; i < 4; i++) {
+    assert((elem = ring_reserve(ring)) != NULL);
+    *elem = i;
+    ring_commit(ring);
+  }
+
+  fprintf(stdout, "full ring drops\n");
+  assert(ring_full(ring));
+  assert(ring_get_dropped(ring) == 0);
+  assert(ring_reserve(ring) == NULL);
+  assert(ring_get_dropped(ring) == 1);
+
+  fprintf(stdout, "elements come out in order\n");
+  for (i = 0; i < 4; i++) {
+    assert((elem = ring_peek(ring)) != NULL);
+    assert(*elem == i);
+    ring_release(ring);
+  }
+  assert(ring_peek(ring) == NULL);
+  assert(!ring_full(ring));
+
+  fprintf(stdout, "producer and consumer thread\n");
+  ring = ring_new(pool, 64, sizeof(apr_uint32_t));
+  assert(apr_thread_create(&thread, NULL, producer, NULL, pool) 
+         == APR_SUCCESS);
+  for (i = 0; i < COUNT; i++) {
+    while (!(elem = ring_peek(ring))) {
+      apr_sleep(10);
+    }
+    assert(*elem == i);
+    ring_release(ring);
+  }
+  apr_thread_join(&retstat, thread);
+  assert(ring_peek(ring) == NULL);
+
+  return 0;
+}
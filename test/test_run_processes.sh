@@ -0,0 +1,3 @@
+#!/bin/bash
+
+$srcdir/_wrapper_test.sh run_processes.sh
@@ -0,0 +1,132 @@
+/* contributor license agreements.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Token bucket shaper unit test
+ */
+
+/* affects include files on Solaris */
+#define BSD_COMP
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <assert.h>
+#include "defines.h"
+
+#include <apr.h>
+#include <apr_pools.h>
+#include <apr_time.h>
+
+#include "shaper.h"
+
+/************************************************************************
+ * Defines
+ ***********************************************************************/
+#define RATE 100000
+#define CHUNK 1000
+
+/************************************************************************
+ * Typedefs
+ ***********************************************************************/
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+int main(int argc, const char *const argv[]) {
+  apr_pool_t *pool;
+  shaper_t *shaper;
+  apr_interval_time_t wait;
+  apr_time_t start;
+  apr_time_t duration;
+  apr_size_t sent;
+
+  apr_app_initialize(&argc, &argv, NULL);
+  apr_pool_create(&pool, NULL);
+
+  fprintf(stdout, "default burst is a tenth of rate\n");
+  shaper = shaper_new(pool, RATE, 0, 0);
+  assert(shaper_get_burst(shaper) == RATE / 10);
+  shaper = shaper_new(pool, 5, 0, 0);
+  assert(shaper_get_burst(shaper) == 1);
+
+  fprintf(stdout, "bucket starts full\n");
+  shaper = shaper_new(pool, RATE, CHUNK, 0);
+  assert(shaper_take(shaper, CHUNK) == 0);
+
+  fprintf(stdout, "empty bucket tells how long to wait\n");
+  wait = shaper_take(shaper, CHUNK);
+  assert(wait > 0 && wait <= apr_time_from_msec(11));
+  apr_sleep(wait);
+  assert(shaper_take(shaper, CHUNK) == 0);
+
+  fprintf(stdout, "rate is kept over many chunks\n");
+  shaper = shaper_new(pool, RATE, CHUNK, 1);
+  start = apr_time_now();
+  for (sent = 0; sent < RATE / 2; sent += CHUNK) {
+    while ((wait = shaper_take(shaper, CHUNK))) {
+      apr_sleep(wait);
+    }
+  }
+  duration = apr_time_now() - start;
+  fprintf(stdout, "%"APR_SIZE_T_FMT" bytes in %"APR_TIME_T_FMT" us\n", sent,
+          duration);
+  /* first chunk is free, the rest needs 0.49s */
+  assert(duration >= apr_time_from_msec(480));
+  assert(duration < apr_time_from_msec(1000));
+
+  fprintf(stdout, "stacked shapers are linked\n");
+  {
+    shaper_t *below = shaper_new(pool, RATE, CHUNK, 0);
+    shaper = shaper_new(pool, RATE * 10, 0, 0);
+    assert(shaper_get_next(shaper) == NULL);
+    shaper_stack(shaper, below);
+    assert(shaper_get_next(shaper) == below);
+    assert(shaper_get_next(below) == NULL);
+  }
+
+  fprintf(stdout, "rate can be changed\n");
+  shaper = shaper_new(pool, RATE, CHUNK, 1);
+  assert(shaper_take(shaper, CHUNK) == 0);
+  assert(shaper_take(shaper, CHUNK) > 0);
+  shaper_set_rate(shaper, RATE / 10, CHUNK);
+  assert(shaper_get_burst(shaper) == CHUNK);
+  wait = shaper_take(shaper, CHUNK);
+  /* a tenth of the rate takes ten times longer */
+  assert(wait > apr_time_from_msec(50));
+
+  fprintf(stdout, "rate 0 is unlimited\n");
+  shaper_set_rate(shaper, 0, 0);
+  assert(shaper_get_burst(shaper) == (apr_size_t)-1);
+  for (sent = 0; sent < RATE; sent += CHUNK) {
+    assert(shaper_take(shaper, CHUNK) == 0);
+  }
+  shaper_set_rate(shaper, RATE, CHUNK);
+  assert(shaper_get_burst(shaper) == CHUNK);
+
+  apr_pool_destroy(pool);
+  return 0;
+}
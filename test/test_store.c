@@ -17,7 +17,7 @@
  *
  * @Author christian liesch <liesch@gmx.ch>
  *
- * Store unit test 
+ * Store unit test and benchmark
  */
 
 /* affects include files on Solaris */
@@ -36,20 +36,162 @@
 #include <apr.h>
 #include <apr_pools.h>
 #include <apr_strings.h>
+#include <apr_hash.h>
+#include <apr_time.h>
 
 #include "store.h"
 
 /************************************************************************
  * Defines 
  ***********************************************************************/
+#define BENCH_VARS 64
+#define BENCH_ROUNDS 2000
 
 /************************************************************************
  * Typedefs 
  ***********************************************************************/
+/* pool per entry store like it was before, to compare with */
+typedef struct pool_store_s {
+  apr_pool_t *pool;
+  apr_hash_t *hash;
+} pool_store_t;
+
+typedef struct pool_element_s {
+  apr_pool_t *pool;
+  const char *value;
+} pool_element_t;
 
 /************************************************************************
  * Implementation 
  ***********************************************************************/
+static pool_store_t *pool_store_make(apr_pool_t *pool) {
+  pool_store_t *store = apr_pcalloc(pool, sizeof(*store));
+  store->pool = pool;
+  store->hash = apr_hash_make(pool);
+  return store;
+}
+
+static const char *pool_store_get(pool_store_t *store, const char *name) {
+  pool_element_t *element = apr_hash_get(store->hash, name, 
+                                         APR_HASH_KEY_STRING);
+  return element ? element->value : NULL;
+}
+
+static void pool_store_set(pool_store_t *store, const char *name, 
+                           const char *value) {
+  apr_pool_t *pool;
+  pool_element_t *element = apr_hash_get(store->hash, name, 
+                                         APR_HASH_KEY_STRING);
+  if (element) {
+    apr_hash_set(store->hash, name, APR_HASH_KEY_STRING, NULL);
+    apr_pool_destroy(element->pool);
+  }
+  apr_pool_create(&pool, store->pool);
+  element = apr_pcalloc(pool, sizeof(*element));
+  element->pool = pool;
+  element->value = apr_pstrdup(pool, value);
+  apr_hash_set(store->hash, apr_pstrdup(pool, name), APR_HASH_KEY_STRING, 
+               element);
+}
+
+static pool_store_t *pool_store_copy(pool_store_t *store, apr_pool_t *pool) {
+  apr_hash_index_t *i;
+  const void *key;
+  void *val;
+  pool_store_t *copy = pool_store_make(pool);
+
+  for (i = apr_hash_first(pool, store->hash); i; i = apr_hash_next(i)) {
+    apr_hash_this(i, &key, NULL, &val);
+    pool_store_set(copy, key, ((pool_element_t *)val)->value);
+  }
+  return copy;
+}
+
+/**
+ * Compare set, get and copy throughput with the pool per entry store
+ * @param pool IN pool
+ */
+static void benchmark(apr_pool_t *pool) {
+  int i;
+  int j;
+  apr_time_t start;
+  apr_time_t set_time[2];
+  apr_time_t get_time[2];
+  apr_time_t copy_time[2];
+  apr_pool_t *ptmp;
+  store_t *store;
+  pool_store_t *pool_store;
+  const char *names[BENCH_VARS];
+  const char *values[BENCH_VARS];
+  const char * volatile val;
+
+  for (i = 0; i < BENCH_VARS; i++) {
+    names[i] = apr_psprintf(pool, "MATCH_VAR_%d", i);
+    values[i] = apr_psprintf(pool, "value %d of a _MATCH capture", i);
+  }
+
+  apr_pool_create(&ptmp, pool);
+  pool_store = pool_store_make(ptmp);
+  start = apr_time_now();
+  for (j = 0; j < BENCH_ROUNDS; j++) {
+    for (i = 0; i < BENCH_VARS; i++) {
+      pool_store_set(pool_store, names[i], values[(i + j) % BENCH_VARS]);
+    }
+  }
+  set_time[0] = apr_time_now() - start;
+  start = apr_time_now();
+  for (j = 0; j < BENCH_ROUNDS; j++) {
+    for (i = 0; i < BENCH_VARS; i++) {
+      val = pool_store_get(pool_store, names[i]);
+    }
+  }
+  get_time[0] = apr_time_now() - start;
+  start = apr_time_now();
+  for (j = 0; j < BENCH_ROUNDS / 10; j++) {
+    apr_pool_t *pcopy;
+    apr_pool_create(&pcopy, ptmp);
+    pool_store_copy(pool_store, pcopy);
+    apr_pool_destroy(pcopy);
+  }
+  copy_time[0] = apr_time_now() - start;
+  apr_pool_destroy(ptmp);
+
+  apr_pool_create(&ptmp, pool);
+  store = store_make(ptmp);
+  start = apr_time_now();
+  for (j = 0; j < BENCH_ROUNDS; j++) {
+    for (i = 0; i < BENCH_VARS; i++) {
+      store_set(store, names[i], values[(i + j) % BENCH_VARS]);
+    }
+  }
+  set_time[1] = apr_time_now() - start;
+  start = apr_time_now();
+  for (j = 0; j < BENCH_ROUNDS; j++) {
+    for (i = 0; i < BENCH_VARS; i++) {
+      val = store_get(store, names[i]);
+    }
+  }
+  get_time[1] = apr_time_now() - start;
+  start = apr_time_now();
+  for (j = 0; j < BENCH_ROUNDS / 10; j++) {
+    apr_pool_t *pcopy;
+    apr_pool_create(&pcopy, ptmp);
+    store_copy(store, pcopy);
+    apr_pool_destroy(pcopy);
+  }
+  copy_time[1] = apr_time_now() - start;
+  apr_pool_destroy(ptmp);
+
+  fprintf(stdout, "pool per entry: set %.1f ns, get %.1f ns, copy %.1f us\n",
+          (double)set_time[0] * 1000 / (BENCH_ROUNDS * BENCH_VARS),
+          (double)get_time[0] * 1000 / (BENCH_ROUNDS * BENCH_VARS),
+          (double)copy_time[0] / (BENCH_ROUNDS / 10));
+  fprintf(stdout, "store: set %.1f ns, get %.1f ns, copy %.1f us\n",
+          (double)set_time[1] * 1000 / (BENCH_ROUNDS * BENCH_VARS),
+          (double)get_time[1] * 1000 / (BENCH_ROUNDS * BENCH_VARS),
+          (double)copy_time[1] / (BENCH_ROUNDS / 10));
+}
+
 int main(int argc, const char *const argv[]) {
   apr_pool_t *pool;
   apr_pool_t *subpool;
@@ -121,6 +263,108 @@ int main(int argc, const char *const argv[]) {
     apr_pool_destroy(subpool);
   }
 
+  fprintf(stdout, "unset and set again\n");
+  store_unset(store, "myVar1");
+  assert(store_get(store, "myVar1") == NULL);
+  assert(store_get_size(store) == 999);
+  store_unset(store, "myVar1");
+  assert(store_get_size(store) == 999);
+  store_set(store, "myVar1", "a much longer value than the one before");
+  assert(strcmp(store_get(store, "myVar1"), 
+                "a much longer value than the one before") == 0);
+  assert(store_get_size(store) == 1000);
+
+  fprintf(stdout, "set part of own value\n");
+  val = store_get(store, "myVar1");
+  store_set(store, "myVar1", &val[7]);
+  assert(strcmp(store_get(store, "myVar1"), 
+                "longer value than the one before") == 0);
+  store_set_and_zero_terminate(store, "myVar1", "abcdef", 3);
+  assert(strcmp(store_get(store, "myVar1"), "abc") == 0);
+
+  fprintf(stdout, "copy and merge\n");
+  {
+    store_t *copy = store_copy(store, pool);
+    assert(store_get_size(copy) == 1000);
+    assert(strcmp(store_get(copy, "myVar1"), "abc") == 0);
+    store_set(copy, "myVar1", "def");
+    assert(strcmp(store_get(store, "myVar1"), "abc") == 0);
+    store_merge(store, copy);
+    assert(strcmp(store_get(store, "myVar1"), "def") == 0);
+  }
+
+  fprintf(stdout, "copy on write\n");
+  {
+    apr_pool_t *pcopy;
+    store_t *copy;
+    store_t *copy2;
+    apr_table_t *table;
+
+    apr_pool_create(&pcopy, pool);
+    val = store_get(store, "myVar2");
+    copy = store_copy(store, pcopy);
+    copy2 = store_copy(store, pcopy);
+    /* source is not touched by a copy */
+    assert(store_get(store, "myVar2") == val);
+    assert(store_get_size(copy) == 1000);
+    store_set(store, "myVar2", "store");
+    store_set(copy, "myVar3", "copy");
+    store_unset(copy, "myVar4");
+    store_set(copy, "newVar", "new");
+    assert(strcmp(store_get(store, "myVar2"), "store") == 0);
+    assert(strcmp(store_get(copy, "myVar2"), "MyVaR2") == 0);
+    assert(strcmp(store_get(copy2, "myVar2"), "MyVaR2") == 0);
+    assert(strcmp(store_get(copy, "myVar3"), "copy") == 0);
+    assert(strcmp(store_get(store, "myVar3"), "MyVaR3") == 0);
+    assert(store_get(copy, "myVar4") == NULL);
+    assert(strcmp(store_get(store, "myVar4"), "MyVaR4") == 0);
+    assert(store_get(store, "newVar") == NULL);
+    assert(store_get_size(copy) == 1000);
+    assert(store_get_size(copy2) == 1000);
+    table = store_get_table(copy, pcopy);
+    assert(apr_table_get(table, "myVar4") == NULL);
+    assert(strcmp(apr_table_get(table, "myVar3"), "copy") == 0);
+    assert(strcmp(apr_table_get(table, "myVar5"), "MyVaR5") == 0);
+    assert(apr_table_elts(table)->nelts == 1000);
+    store_set(copy, "myVar4", "again");
+    assert(strcmp(store_get(copy, "myVar4"), "again") == 0);
+    assert(store_get_size(copy) == 1001);
+    /* copy of a copy and of the written source */
+    copy2 = store_copy(copy, pcopy);
+    assert(strcmp(store_get(copy2, "myVar4"), "again") == 0);
+    copy2 = store_copy(store, pcopy);
+    assert(strcmp(store_get(copy2, "myVar2"), "store") == 0);
+    apr_pool_destroy(pcopy);
+    assert(strcmp(store_get(store, "myVar4"), "MyVaR4") == 0);
+    assert(store_get_size(store) == 1000);
+  }
+
+  fprintf(stdout, "set and unset always new keys\n");
+  {
+    store_t *churn = store_make(pool);
+    char name[32];
+    int j;
+
+    for (j = 0; j < 100; j++) {
+      for (i = 0; i < 100; i++) {
+        sprintf(name, "churn%d_%d", j, i);
+        store_set(churn, name, name);
+      }
+      for (i = 0; i < 100; i++) {
+        sprintf(name, "churn%d_%d", j, i);
+        assert(strcmp(store_get(churn, name), name) == 0);
+        store_unset(churn, name);
+      }
+      assert(store_get_size(churn) == 0);
+    }
+    store_set(churn, "last", "value");
+    assert(strcmp(store_get(churn, "last"), "value") == 0);
+    assert(store_get(churn, "churn0_0") == NULL);
+    assert(store_get_size(churn) == 1);
+  }
+
+  benchmark(pool);
+
   return 0;
 }
 
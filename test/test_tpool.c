@@ -0,0 +1,186 @@
+/* contributor license agreements.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ *
+ * @Author christian liesch <liesch@gmx.ch>
+ *
+ * Thread pool unit test
+ */
+
+/* affects include files on Solaris */
+#define BSD_COMP
+
+/************************************************************************
+ * Includes
+ ***********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <assert.h>
+#include "defines.h"
+
+#include <apr.h>
+#include <apr_pools.h>
+#include <apr_time.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+
+#include "tpool.h"
+
+/************************************************************************
+ * Defines
+ ***********************************************************************/
+#define TASKS 50
+
+/************************************************************************
+ * Typedefs
+ ***********************************************************************/
+
+/************************************************************************
+ * Globals
+ ***********************************************************************/
+apr_thread_mutex_t *mutex;
+apr_thread_cond_t *cond;
+int count = 0;
+/* gated tasks wait until open */
+int gate_open = 1;
+int gate_waiting = 0;
+
+/************************************************************************
+ * Implementation
+ ***********************************************************************/
+/**
+ * Task which counts and sleeps a bit
+ * @param thread IN always NULL
+ * @param data IN unused
+ * @return NULL
+ */
+static void * APR_THREAD_FUNC task(apr_thread_t *thread, void *data) {
+  assert(thread == NULL);
+  apr_sleep(apr_time_from_msec(10));
+  apr_thread_mutex_lock(mutex);
+  ++gate_waiting;
+  while (!gate_open) {
+    apr_thread_cond_wait(cond, mutex);
+  }
+  --gate_waiting;
+  ++count;
+  apr_thread_mutex_unlock(mutex);
+  return NULL;
+}
+
+/**
+ * Hold back or release gated tasks
+ * @param state IN 0 to hold back, 1 to release
+ * @param n IN tasks to wait for before releasing
+ */
+static void gate(int state, int n) {
+  apr_thread_mutex_lock(mutex);
+  while (!gate_open && gate_waiting < n) {
+    apr_thread_mutex_unlock(mutex);
+    apr_sleep(apr_time_from_msec(1));
+    apr_thread_mutex_lock(mutex);
+  }
+  gate_open = state;
+  apr_thread_cond_broadcast(cond);
+  apr_thread_mutex_unlock(mutex);
+}
+
+/**
+ * Wait until n tasks did count
+ * @param n IN count to wait for
+ */
+static void wait_count(int n) {
+  int cur;
+
+  do {
+    apr_sleep(apr_time_from_msec(1));
+    apr_thread_mutex_lock(mutex);
+    cur = count;
+    apr_thread_mutex_unlock(mutex);
+  } while (cur < n);
+}
+
+/**
+ * Run TASKS tasks at once and join them
+ * @param tpool IN thread pool
+ * @param n IN number of tasks
+ */
+static void run_tasks(tpool_t *tpool, int n) {
+  tpool_task_t *tasks[TASKS];
+  int i;
+
+  for (i = 0; i < n; i++) {
+    assert(tpool_push(tpool, task, NULL, &tasks[i]) == APR_SUCCESS);
+  }
+  /* a closed gate opens as soon as all tasks are running */
+  gate(1, n);
+  for (i = 0; i < n; i++) {
+    assert(tpool_join(tasks[i]) == APR_SUCCESS);
+  }
+}
+
+int main(int argc, const char *const argv[]) {
+  apr_pool_t *pool;
+  tpool_t *tpool;
+  tpool_stat_t stat;
+
+  apr_app_initialize(&argc, &argv, NULL);
+  apr_pool_create(&pool, NULL);
+  apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+  apr_thread_cond_create(&cond, pool);
+
+  fprintf(stdout, "concurrent tasks get their own thread\n");
+  assert(tpool_create(&tpool, pool, 65536) == APR_SUCCESS);
+  /* no task ends before all run, so no thread is reused */
+  gate(0, 0);
+  run_tasks(tpool, TASKS);
+  assert(count == TASKS);
+  tpool_get_stat(tpool, &stat);
+  assert(stat.tasks == TASKS);
+  assert(stat.spawned == TASKS);
+  assert(stat.peak_busy == TASKS);
+
+  fprintf(stdout, "idle threads are reused\n");
+  apr_sleep(apr_time_from_msec(100));
+  run_tasks(tpool, TASKS / 2);
+  run_tasks(tpool, TASKS);
+  assert(count == 2 * TASKS + TASKS / 2);
+  tpool_get_stat(tpool, &stat);
+  assert(stat.tasks == 2 * TASKS + TASKS / 2);
+  fprintf(stdout, "%d tasks on %d threads, %"APR_TIME_T_FMT" us to spawn\n",
+          stat.tasks, stat.spawned, stat.spawn_time);
+  assert(stat.spawned < 2 * TASKS);
+
+  fprintf(stdout, "detached tasks free themselves\n");
+  {
+    tpool_task_t *detached;
+
+    gate(0, 0);
+    assert(tpool_push(tpool, task, NULL, &detached) == APR_SUCCESS);
+    tpool_detach(detached);
+    gate(1, 1);
+    wait_count(2 * TASKS + TASKS / 2 + 1);
+    /* detach a task which may have ended already */
+    assert(tpool_push(tpool, task, NULL, &detached) == APR_SUCCESS);
+    wait_count(2 * TASKS + TASKS / 2 + 2);
+    tpool_detach(detached);
+  }
+
+  return 0;
+}